@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "host_shim.h"
+#include "io.h"
+#include "memory.h"
+#include "multiboot.h"
+#include "page_allocator.h"
+#include "paging.h"
+#include "terminal.h"
+
+// Symbols normally provided by linker.ld. The page allocator reserves the
+// range between them, which is empty here.
+uint32_t kernel_start;
+uint32_t kernel_end;
+
+static struct multiboot_info host_multiboot_info;
+static struct memory_map_entry host_memory_map[1];
+
+void output_string(const char* str) {
+    fputs(str, stdout);
+}
+
+void output_char(char c) {
+    putchar(c);
+}
+
+void put_u32(uint32_t num) {
+    printf("%u", num);
+}
+
+void put_u64(uint64_t num) {
+    printf("%llu", (unsigned long long)num);
+}
+
+void put_hex(uint32_t num) {
+    printf("0x%x", num);
+}
+
+uint64_t read_tsc(void) {
+    return __builtin_ia32_rdtsc();
+}
+
+// Paging is never on in the hosted build, so the heap takes its regions
+// straight from the page allocator.
+bool paging_enabled(void) {
+    return false;
+}
+
+int paging_add_demand_range(uint32_t start, uint32_t size) {
+    (void)start;
+    (void)size;
+    return -1;
+}
+
+void paging_decommit(uint32_t virt, uint32_t size) {
+    (void)virt;
+    (void)size;
+}
+
+uint32_t paging_demand_committed_bytes(void) {
+    return 0;
+}
+
+void host_heap_init(size_t arena_bytes) {
+    // The allocators keep addresses in 32-bit fields, so the arena has to
+    // live in the low 4 GiB of the address space.
+    void* arena = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (arena == MAP_FAILED) {
+        perror("mmap arena");
+        exit(1);
+    }
+
+    host_memory_map[0].size = sizeof(struct memory_map_entry) - sizeof(uint32_t);
+    host_memory_map[0].base_addr_low = (uint32_t)(uintptr_t)arena;
+    host_memory_map[0].base_addr_high = 0;
+    host_memory_map[0].length_low = (uint32_t)arena_bytes;
+    host_memory_map[0].length_high = 0;
+    host_memory_map[0].type = 1;
+
+    host_multiboot_info.flags = 1 << 6;
+    host_multiboot_info.mmap_addr = (uint32_t)(uintptr_t)host_memory_map;
+    host_multiboot_info.mmap_length = sizeof(host_memory_map);
+
+    init_page_allocator((uint32_t)(uintptr_t)&host_multiboot_info);
+    init_allocator();
+}
+
+void* host_scratch_alloc(size_t bytes) {
+    void* memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("mmap scratch");
+        exit(1);
+    }
+    return memory;
+}
+
+uint64_t host_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
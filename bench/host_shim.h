@@ -0,0 +1,18 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Maps an arena below 4 GiB, describes it to the page allocator through a
+// fake multiboot memory map and brings up the heap on top of it, the same
+// way kernel_main does at boot.
+void host_heap_init(size_t arena_bytes);
+
+// Scratch memory for the driver itself, taken straight from mmap so it never
+// touches either libc's heap or the kernel heap under test.
+void* host_scratch_alloc(size_t bytes);
+
+uint64_t host_now_ns(void);
+
+#endif
@@ -0,0 +1,374 @@
+// Replays malloc/free traces against the kernel heap running as a normal
+// Linux process. A trace is a text file with one operation per line:
+//
+//   a <id> <size>    allocate size bytes and remember the block as id
+//   r <id> <size>    resize the block remembered as id
+//   f <id>           free the block remembered as id
+//
+// Lines starting with '#' are ignored. Built-in synthetic workloads are
+// available through --synthetic so the benchmark runs without a trace.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "host_shim.h"
+#include "memory.h"
+
+#define DEFAULT_ARENA_MIB 64
+#define STATS_SAMPLE_INTERVAL 4096
+
+typedef struct {
+    char kind;
+    uint32_t id;
+    uint32_t size;
+} TraceOp;
+
+typedef struct {
+    TraceOp* ops;
+    uint32_t op_count;
+    uint32_t op_capacity;
+    uint32_t id_count;
+} Trace;
+
+typedef void (*TraceGenerator)(Trace* trace, uint32_t seed);
+
+static uint32_t rng_state;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t rng_range(uint32_t low, uint32_t high) {
+    return low + rng_next() % (high - low + 1);
+}
+
+static void trace_reserve(Trace* trace, uint32_t op_capacity, uint32_t id_count) {
+    trace->ops = host_scratch_alloc(op_capacity * sizeof(TraceOp));
+    trace->op_count = 0;
+    trace->op_capacity = op_capacity;
+    trace->id_count = id_count;
+}
+
+static void trace_push(Trace* trace, char kind, uint32_t id, uint32_t size) {
+    if (trace->op_count < trace->op_capacity) {
+        trace->ops[trace->op_count++] = (TraceOp){kind, id, size};
+    }
+}
+
+// Random alloc/free over a fixed set of slots with small sizes: the pattern
+// of wakers, tasks and log entries.
+static void generate_churn(Trace* trace, uint32_t seed) {
+    enum { SLOTS = 256, OPS = 200000 };
+    uint8_t live[SLOTS] = {0};
+
+    rng_state = seed;
+    trace_reserve(trace, OPS, SLOTS);
+    for (uint32_t i = 0; i < OPS; i++) {
+        uint32_t slot = rng_next() % SLOTS;
+        if (live[slot]) {
+            trace_push(trace, 'f', slot, 0);
+        } else {
+            trace_push(trace, 'a', slot, rng_range(16, 512));
+        }
+        live[slot] ^= 1;
+    }
+}
+
+// Builds up a large live set, then tears it down in random order, which
+// exercises coalescing of long runs of neighbours.
+static void generate_ramp(Trace* trace, uint32_t seed) {
+    enum { OBJECTS = 2000, ROUNDS = 20 };
+    uint32_t order[OBJECTS];
+
+    rng_state = seed;
+    trace_reserve(trace, OBJECTS * ROUNDS * 2, OBJECTS);
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (uint32_t i = 0; i < OBJECTS; i++) {
+            trace_push(trace, 'a', i, rng_range(16, 512));
+            order[i] = i;
+        }
+        for (uint32_t i = OBJECTS - 1; i > 0; i--) {
+            uint32_t j = rng_next() % (i + 1);
+            uint32_t swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+        for (uint32_t i = 0; i < OBJECTS; i++) {
+            trace_push(trace, 'f', order[i], 0);
+        }
+    }
+}
+
+// Mostly small blocks with an occasional large buffer mixed in, the case
+// where a poor fit policy fragments the heap.
+static void generate_mixed(Trace* trace, uint32_t seed) {
+    enum { SLOTS = 1024, OPS = 200000 };
+    uint8_t live[SLOTS] = {0};
+
+    rng_state = seed;
+    trace_reserve(trace, OPS, SLOTS);
+    for (uint32_t i = 0; i < OPS; i++) {
+        uint32_t slot = rng_next() % SLOTS;
+        if (live[slot]) {
+            trace_push(trace, 'f', slot, 0);
+        } else if (rng_next() % 32 == 0) {
+            trace_push(trace, 'a', slot, rng_range(4096, 32768));
+        } else {
+            trace_push(trace, 'a', slot, rng_range(8, 256));
+        }
+        live[slot] ^= 1;
+    }
+}
+
+// Interleaved buffers that keep growing in small steps, like log buffers
+// and task lists, then are dropped and started again.
+static void generate_grow(Trace* trace, uint32_t seed) {
+    enum { BUFFERS = 8, ROUNDS = 50, STEP = 64, LIMIT = 8192 };
+
+    rng_state = seed;
+    trace_reserve(trace, ROUNDS * BUFFERS * (LIMIT / STEP + 1), BUFFERS);
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (uint32_t size = STEP; size <= LIMIT; size += STEP) {
+            for (uint32_t id = 0; id < BUFFERS; id++) {
+                trace_push(trace, size == STEP ? 'a' : 'r', id, size + rng_next() % STEP);
+            }
+        }
+        for (uint32_t id = 0; id < BUFFERS; id++) {
+            trace_push(trace, 'f', id, 0);
+        }
+    }
+}
+
+static const struct {
+    const char* name;
+    TraceGenerator generate;
+} synthetic_workloads[] = {
+    {"churn", generate_churn},
+    {"ramp", generate_ramp},
+    {"mixed", generate_mixed},
+    {"grow", generate_grow},
+};
+
+#define SYNTHETIC_WORKLOAD_COUNT (sizeof(synthetic_workloads) / sizeof(synthetic_workloads[0]))
+
+static int load_trace(const char* path, Trace* trace) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    // First pass sizes the op and id tables, second pass fills them.
+    char line[128];
+    uint32_t op_count = 0;
+    uint32_t max_id = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char kind;
+        uint32_t id;
+        if (sscanf(line, " %c %u", &kind, &id) == 2 && (kind == 'a' || kind == 'r' || kind == 'f')) {
+            op_count++;
+            if (id > max_id) {
+                max_id = id;
+            }
+        }
+    }
+
+    trace_reserve(trace, op_count, max_id + 1);
+    rewind(file);
+
+    uint32_t line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char kind;
+        uint32_t id;
+        uint32_t size = 0;
+        line_number++;
+
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        int fields = sscanf(line, " %c %u %u", &kind, &id, &size);
+        if (((kind == 'a' || kind == 'r') && fields == 3) || (kind == 'f' && fields >= 2)) {
+            trace_push(trace, kind, id, size);
+        } else {
+            fprintf(stderr, "%s:%u: malformed trace line\n", path, line_number);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static uint32_t percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0 : (uint32_t)(part * 100 / whole);
+}
+
+// Replays the trace once and prints a single result line. Returns non-zero
+// if the heap does not account for every byte once all blocks are freed.
+static int replay_trace(const char* name, const Trace* trace) {
+    void** blocks = host_scratch_alloc(trace->id_count * sizeof(void*));
+    MemoryStats stats;
+    uint32_t worst_fragmentation = 0;
+    uint32_t skipped = 0;
+
+    MemoryStats initial;
+    memory_get_stats(&initial);
+
+    uint64_t start = host_now_ns();
+    for (uint32_t i = 0; i < trace->op_count; i++) {
+        const TraceOp* op = &trace->ops[i];
+
+        if (op->kind == 'a') {
+            if (blocks[op->id] != NULL) {
+                skipped++;
+                continue;
+            }
+            blocks[op->id] = malloc(op->size);
+            if (blocks[op->id] != NULL && op->size > 0) {
+                // Touch the block like a real caller would.
+                *(volatile uint8_t*)blocks[op->id] = (uint8_t)i;
+            }
+        } else if (op->kind == 'r') {
+            void* resized = realloc(blocks[op->id], op->size);
+            if (resized != NULL || op->size == 0) {
+                blocks[op->id] = resized;
+            }
+        } else {
+            free(blocks[op->id]);
+            blocks[op->id] = NULL;
+        }
+
+        if (i % STATS_SAMPLE_INTERVAL == 0) {
+            memory_get_stats(&stats);
+            if (stats.fragmentation > worst_fragmentation) {
+                worst_fragmentation = stats.fragmentation;
+            }
+        }
+    }
+    uint64_t elapsed = host_now_ns() - start;
+
+    memory_get_stats(&stats);
+    uint32_t end_fragmentation = stats.fragmentation;
+
+    for (uint32_t id = 0; id < trace->id_count; id++) {
+        free(blocks[id]);
+    }
+
+    printf("%-8s %8u ops %9.2f ms %7.1f ns/op  peak %8zu B (%3u%% of heap)  frag end %3u%% worst %3u%%  failed %u",
+           name, trace->op_count, elapsed / 1e6,
+           trace->op_count == 0 ? 0.0 : (double)elapsed / trace->op_count,
+           stats.peak_live_bytes, percent(stats.peak_live_bytes, stats.heap_bytes),
+           end_fragmentation, worst_fragmentation,
+           stats.failed_allocations - initial.failed_allocations);
+    if (skipped > 0) {
+        printf("  skipped %u", skipped);
+    }
+    printf("\n");
+
+    memory_get_stats(&stats);
+    if (stats.live_bytes != initial.live_bytes || stats.free_bytes != initial.free_bytes) {
+        printf("%-8s heap accounting mismatch after teardown: live %zu free %zu (expected %zu/%zu)\n",
+               name, stats.live_bytes, stats.free_bytes, initial.live_bytes, initial.free_bytes);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Each workload runs in its own process so it starts from a freshly
+// initialised heap and the peak figures do not leak between workloads.
+static int run_isolated(const char* name, TraceGenerator generate, const char* path,
+                        size_t arena_bytes, uint32_t seed) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+
+    if (child == 0) {
+        Trace trace;
+        host_heap_init(arena_bytes);
+        if (generate != NULL) {
+            generate(&trace, seed);
+        } else if (load_trace(path, &trace) != 0) {
+            _exit(1);
+        }
+        int result = replay_trace(name, &trace);
+        fflush(stdout);
+        _exit(result);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--arena MIB] [--seed N] --synthetic churn|ramp|mixed|grow|all\n"
+            "       %s [--arena MIB] TRACE_FILE...\n",
+            program, program);
+}
+
+int main(int argc, char** argv) {
+    size_t arena_bytes = (size_t)DEFAULT_ARENA_MIB << 20;
+    uint32_t seed = 0x2545F491;
+    const char* synthetic = NULL;
+    int first_trace = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+            arena_bytes = strtoul(argv[++i], NULL, 0) << 20;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+            synthetic = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            first_trace = i;
+            break;
+        }
+    }
+
+    if (seed == 0) {
+        seed = 1;
+    }
+
+    int failures = 0;
+
+    if (synthetic != NULL) {
+        bool found = false;
+        for (size_t i = 0; i < SYNTHETIC_WORKLOAD_COUNT; i++) {
+            if (strcmp(synthetic, "all") == 0 || strcmp(synthetic, synthetic_workloads[i].name) == 0) {
+                failures += run_isolated(synthetic_workloads[i].name, synthetic_workloads[i].generate,
+                                         NULL, arena_bytes, seed);
+                found = true;
+            }
+        }
+        if (!found) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    for (int i = first_trace; i < argc; i++) {
+        failures += run_isolated(argv[i], NULL, argv[i], arena_bytes, seed);
+    }
+
+    if (synthetic == NULL && first_trace == argc) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
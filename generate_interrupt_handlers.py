@@ -99,13 +99,18 @@ interrupt_handler_{num}:
     movl %eax, %fs
     movl %eax, %gs
     
+    # The CPU pushed an error code before the return frame; it sits above
+    # the 8 saved registers and 4 segment registers
+    pushl 48(%esp)
     call handle_page_fault
+    addl $4, %esp
     
     popl %gs
     popl %fs
     popl %es
     popl %ds
     popal
+    addl $4, %esp       # Drop the error code before returning
     iret
 """
     elif num in [8, 10, 11, 12, 14, 17]:  
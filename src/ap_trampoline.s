@@ -0,0 +1,109 @@
+.section .text
+
+.globl ap_trampoline_start
+.globl ap_trampoline_params
+.globl ap_trampoline_end
+
+# Application processor startup code. smp_init copies everything between
+# ap_trampoline_start and ap_trampoline_end to AP_TRAMPOLINE_ADDR and sends
+# each AP a STARTUP IPI for that page, so the AP begins here in real mode
+# with CS:IP = 0x0800:0000. Addresses are worked out for the copy, not for
+# where this is linked.
+#
+# The AP switches to protected mode on a temporary flat GDT, turns paging on
+# with the bootstrap processor's CR3/CR4/CR0 from the parameter block, moves
+# to its own stack and calls entry(cpu_index). The entry loads the kernel's
+# own GDT and IDT.
+#
+# Only the AP whose local APIC ID the block names may use it, and only once:
+# it claims the block before loading anything else. An AP that turns up
+# after the BSP gave up on it finds the block claimed or meant for another
+# AP, and halts here without touching any stack.
+
+.set AP_TRAMPOLINE_ADDR, 0x8000
+.set AP_PARAM_CR3,   0
+.set AP_PARAM_CR4,   4
+.set AP_PARAM_CR0,   8
+.set AP_PARAM_STACK, 12
+.set AP_PARAM_ENTRY, 16
+.set AP_PARAM_CPU,   20
+.set AP_PARAM_APIC_ID, 24
+.set AP_PARAM_APIC_ID_REGISTER, 28
+.set AP_PARAM_CLAIMED, 32
+
+.code16
+ap_trampoline_start:
+    cli
+    cld
+    xorw    %ax, %ax
+    movw    %ax, %ds
+
+    lgdtl   AP_GDT_POINTER
+    movl    %cr0, %eax
+    orl     $1, %eax            # PE
+    movl    %eax, %cr0
+    ljmpl   $0x08, $AP_PROTECTED_MODE
+
+.code32
+ap_protected_mode:
+    movw    $0x10, %ax
+    movw    %ax, %ds
+    movw    %ax, %es
+    movw    %ax, %fs
+    movw    %ax, %gs
+    movw    %ax, %ss
+
+    # Paging is still off, so the local APIC is at its physical address
+    movl    AP_PARAMS + AP_PARAM_APIC_ID_REGISTER, %ebx
+    movl    (%ebx), %eax
+    shrl    $24, %eax
+    cmpl    AP_PARAMS + AP_PARAM_APIC_ID, %eax
+    jne     ap_park
+    movl    $1, %eax
+    xchgl   %eax, AP_PARAMS + AP_PARAM_CLAIMED
+    testl   %eax, %eax
+    jnz     ap_park
+
+    # CR4 first: PSE must be on before paging meets a 4 MiB entry
+    movl    AP_PARAMS + AP_PARAM_CR4, %eax
+    movl    %eax, %cr4
+    movl    AP_PARAMS + AP_PARAM_CR3, %eax
+    movl    %eax, %cr3
+    movl    AP_PARAMS + AP_PARAM_CR0, %eax
+    movl    %eax, %cr0
+
+    movl    AP_PARAMS + AP_PARAM_STACK, %esp
+    xorl    %ebp, %ebp
+    pushl   AP_PARAMS + AP_PARAM_CPU
+    movl    AP_PARAMS + AP_PARAM_ENTRY, %eax
+    call    *%eax
+
+ap_park:
+    cli
+    hlt
+    jmp     ap_park
+
+# Flat code and data segments with the kernel GDT's selectors
+.align 8
+ap_gdt:
+    .quad   0
+    .quad   0x00CF9A000000FFFF  # 0x08: code, base 0, 4 GiB, 32-bit
+    .quad   0x00CF92000000FFFF  # 0x10: data, base 0, 4 GiB
+ap_gdt_pointer:
+    .word   ap_gdt_pointer - ap_gdt - 1
+    .long   AP_GDT
+
+# Filled in by smp_init before each STARTUP IPI, see ApTrampolineParams
+.align 4
+ap_trampoline_params:
+    .skip   36
+
+ap_trampoline_end:
+
+# Where the labels above land in the copy
+.set AP_GDT,            AP_TRAMPOLINE_ADDR + (ap_gdt - ap_trampoline_start)
+.set AP_GDT_POINTER,    AP_TRAMPOLINE_ADDR + (ap_gdt_pointer - ap_trampoline_start)
+.set AP_PROTECTED_MODE, AP_TRAMPOLINE_ADDR + (ap_protected_mode - ap_trampoline_start)
+.set AP_PARAMS,         AP_TRAMPOLINE_ADDR + (ap_trampoline_params - ap_trampoline_start)
+
+.section .note.GNU-stack,"",@progbits
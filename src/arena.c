@@ -0,0 +1,100 @@
+#include "arena.h"
+#include "page_allocator.h"
+
+static inline uintptr_t arena_align_up(uintptr_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+void arena_init(Arena* arena, size_t chunk_size) {
+    arena->current = NULL;
+    arena->cursor = NULL;
+    arena->chunk_order = page_order_for_size(chunk_size);
+}
+
+static ArenaChunk* arena_add_chunk(Arena* arena, size_t min_size) {
+    uint32_t order = arena->chunk_order;
+    size_t needed = sizeof(ArenaChunk) + min_size;
+    if (((size_t)PAGE_SIZE << order) < needed) {
+        order = page_order_for_size(needed);
+        if (((size_t)PAGE_SIZE << order) < needed) {
+            return NULL;
+        }
+    }
+
+    ArenaChunk* chunk = (ArenaChunk*)alloc_pages(order);
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    chunk->previous = arena->current;
+    chunk->order = order;
+    chunk->limit = (uint8_t*)chunk + ((size_t)PAGE_SIZE << order);
+
+    arena->current = chunk;
+    arena->cursor = (uint8_t*)(chunk + 1);
+    return chunk;
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (alignment < sizeof(void*)) {
+        alignment = sizeof(void*);
+    }
+
+    if (arena->current != NULL) {
+        uintptr_t ptr = arena_align_up((uintptr_t)arena->cursor, alignment);
+        if (ptr + size <= (uintptr_t)arena->current->limit && ptr + size > ptr) {
+            arena->cursor = (uint8_t*)(ptr + size);
+            return (void*)ptr;
+        }
+    }
+
+    // The current chunk is full; the rest of it is abandoned until reset.
+    if (arena_add_chunk(arena, size + alignment) == NULL) {
+        return NULL;
+    }
+
+    uintptr_t ptr = arena_align_up((uintptr_t)arena->cursor, alignment);
+    arena->cursor = (uint8_t*)(ptr + size);
+    return (void*)ptr;
+}
+
+ArenaScope arena_scope_begin(Arena* arena) {
+    ArenaScope scope;
+    scope.chunk = arena->current;
+    scope.cursor = arena->cursor;
+    return scope;
+}
+
+void arena_scope_end(Arena* arena, ArenaScope scope) {
+    while (arena->current != scope.chunk && arena->current != NULL) {
+        ArenaChunk* chunk = arena->current;
+        arena->current = chunk->previous;
+        free_pages(chunk, chunk->order);
+    }
+
+    arena->cursor = scope.cursor;
+}
+
+void arena_reset(Arena* arena) {
+    if (arena->current == NULL) {
+        return;
+    }
+
+    // Keep the oldest chunk so a reused arena does not go back to the page
+    // allocator on every cycle.
+    while (arena->current->previous != NULL) {
+        ArenaChunk* chunk = arena->current;
+        arena->current = chunk->previous;
+        free_pages(chunk, chunk->order);
+    }
+
+    arena->cursor = (uint8_t*)(arena->current + 1);
+}
+
+void arena_destroy(Arena* arena) {
+    ArenaScope empty = { NULL, NULL };
+    arena_scope_end(arena, empty);
+}
@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Chunks come straight from the page allocator and start with this header.
+// They are chained newest first.
+typedef struct ArenaChunk {
+    struct ArenaChunk* previous;
+    uint32_t order;
+    uint8_t* limit;
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk* current;
+    uint8_t* cursor;
+    uint32_t chunk_order;
+} Arena;
+
+// A saved arena position; ending the scope frees everything allocated after it.
+typedef struct {
+    ArenaChunk* chunk;
+    uint8_t* cursor;
+} ArenaScope;
+
+void arena_init(Arena* arena, size_t chunk_size);
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment);
+
+ArenaScope arena_scope_begin(Arena* arena);
+void arena_scope_end(Arena* arena, ArenaScope scope);
+
+void arena_reset(Arena* arena);
+
+void arena_destroy(Arena* arena);
+
+#endif
@@ -2,60 +2,201 @@
 #include "terminal.h"
 #include "io.h"
 #include "memory.h"
+#include "slab.h"
 #include "rtc.h"  // Include rtc.h to get access to monotonic_time functions
+#include "clock.h"
+#include "thread.h"
+#include "smp.h"
 #include <stdatomic.h>
 
-// Global executor instance and flags
+// Global executor instance, run by the bootstrap processor
 static Executor g_executor;
-static atomic_bool g_should_poll = true;
 static atomic_uint_fast32_t g_monotonic_ticks = 0;
 
+#ifdef EXECUTOR_TELEMETRY
+#define TELEMETRY_INIT(executor) executor_telemetry_init(executor)
+#define TELEMETRY_SPAWNED(executor, task) executor_telemetry_task_spawned((executor), (task))
+#define TELEMETRY_COMPLETED(executor, task) executor_telemetry_task_completed((executor), (task))
+#define TELEMETRY_WOKEN(executor, coalesced) executor_telemetry_woken((executor), (coalesced))
+#define TELEMETRY_KICKED(executor) executor_telemetry_kicked(executor)
+#define TELEMETRY_CLOCK() read_tsc()
+#define TELEMETRY_POLLED(task, start, completed) executor_telemetry_polled((task), (start), (completed))
+#define TELEMETRY_LOOP(executor) executor_telemetry_loop(executor)
+#define TELEMETRY_IDLED(executor, start) executor_telemetry_idled((executor), (start))
+#else
+#define TELEMETRY_INIT(executor) ((void)0)
+#define TELEMETRY_SPAWNED(executor, task) ((void)0)
+#define TELEMETRY_COMPLETED(executor, task) ((void)0)
+#define TELEMETRY_WOKEN(executor, coalesced) ((void)0)
+#define TELEMETRY_KICKED(executor) ((void)0)
+#define TELEMETRY_CLOCK() 0
+#define TELEMETRY_POLLED(task, start, completed) ((void)(start))
+#define TELEMETRY_LOOP(executor) ((void)0)
+#define TELEMETRY_IDLED(executor, start) ((void)(start))
+#endif
+
+// An executor running as a thread parks here when idle, so other threads
+// get the CPU; any task wake-up or executor_notify resumes it. Threads only
+// run on the bootstrap processor.
+static WaitQueue g_executor_idle;
+
+// Object caches for the executor's fixed-size, frequently allocated objects
+static KmemCache* task_cache = NULL;
+static KmemCache* sleep_future_cache = NULL;
+
 // Initialize the async executor
 void executor_init(Executor* executor) {
-    executor->task_queue = NULL;
+    static const uint32_t default_budget[TASK_PRIORITY_COUNT] = {
+        EXECUTOR_BUDGET_HIGH, EXECUTOR_BUDGET_NORMAL, EXECUTOR_BUDGET_LOW
+    };
+
+    for (int i = 0; i < TASK_PRIORITY_COUNT; i++) {
+        atomic_store(&executor->ready[i], NULL);
+        executor->runnable[i] = NULL;
+        executor->runnable_tail[i] = NULL;
+        executor->budget[i] = default_budget[i];
+    }
+    atomic_store(&executor->released, NULL);
+    spin_lock_init(&executor->lock);
+    executor->cpu = 0;
+    atomic_store(&executor->parked, false);
     executor->task_count = 0;
     atomic_store(&executor->should_poll, true);
+    TELEMETRY_INIT(executor);
     output_string("Async executor initialized\n");
 }
 
-// Create a new waker
-static Waker* waker_create(void (*wake_func)(Waker*), void* data) {
-    Waker* waker = (Waker*)malloc(sizeof(Waker));
-    if (waker) {
-        waker->wake = wake_func;
-        waker->data = data;
-        atomic_store(&waker->ref_count, 1);
-    }
+Waker* waker_clone(Waker* waker) {
+    atomic_fetch_add(&waker->ref_count, 1);
     return waker;
 }
 
-// Wake function for the executor
-static void executor_waker_wake(Waker* waker) {
-    atomic_store(&g_should_poll, true);
+void waker_drop(Waker* waker) {
+    if (atomic_fetch_sub(&waker->ref_count, 1) == 1) {
+        waker->release(waker);
+    }
+}
+
+void waker_wake(Waker* waker) {
+    waker->wake(waker);
+}
+
+static void task_stack_push(_Atomic(Task*)* stack, Task* task) {
+    Task* head = atomic_load(stack);
+    do {
+        task->next_ready = head;
+    } while (!atomic_compare_exchange_weak(stack, &head, task));
+}
+
+// Takes a whole stack and reverses it, so tasks come out in push order.
+static Task* task_stack_take(_Atomic(Task*)* stack) {
+    Task* head = atomic_exchange(stack, NULL);
+    Task* ordered = NULL;
+    while (head) {
+        Task* next = head->next_ready;
+        head->next_ready = ordered;
+        ordered = head;
+        head = next;
+    }
+    return ordered;
+}
+
+// Queues the task unless it is already waiting to be polled. The queue keeps
+// its own reference so the task outlives every other holder while queued.
+static void task_waker_wake(Waker* waker) {
+    Task* task = (Task*)waker->data;
+
+    if (atomic_exchange(&task->queued, true)) {
+        TELEMETRY_WOKEN(task->executor, true);
+        return;
+    }
+
+    TELEMETRY_WOKEN(task->executor, false);
+    waker_clone(waker);
+    task_stack_push(&task->executor->ready[task->priority], task);
+    executor_notify(task->executor);
+}
+
+void executor_notify(Executor* executor) {
+    atomic_store(&executor->should_poll, true);
+
+    if (executor->cpu != smp_cpu_index()) {
+        // Pairs with the parked store in executor_run: either it sees
+        // should_poll, or we see it parked and the IPI ends its halt.
+        if (atomic_exchange(&executor->parked, false)) {
+            smp_send_wake(executor->cpu);
+        }
+    } else if (executor->cpu == 0) {
+        wait_queue_wake_all(&g_executor_idle);
+    }
+}
+
+// The last reference can go away inside an interrupt handler, so the task is
+// handed back to the executor loop instead of being freed here.
+static void task_waker_release(Waker* waker) {
+    Task* task = (Task*)waker->data;
+    task_stack_push(&task->executor->released, task);
 }
 
 // Add a task to the executor queue
 void executor_spawn(Executor* executor, Future* future) {
-    Task* task = (Task*)malloc(sizeof(Task));
+    executor_spawn_with(executor, future, TASK_PRIORITY_NORMAL, TASK_NO_DEADLINE);
+}
+
+void executor_spawn_with(Executor* executor, Future* future, TaskPriority priority, uint32_t deadline) {
+    Task* task = (Task*)kmem_cache_alloc(task_cache);
     if (task) {
         task->future = future;
-        
-        // Create a waker for this task
-        task->future->waker = waker_create(executor_waker_wake, NULL);
-        
-        // Add to the front of the queue
-        task->next = executor->task_queue;
-        executor->task_queue = task;
-        
+        task->executor = executor;
+        task->priority = priority < TASK_PRIORITY_COUNT ? priority : TASK_PRIORITY_LOW;
+        task->deadline = deadline;
+        task->next_ready = NULL;
+        atomic_store(&task->queued, false);
+
+        task->waker.wake = task_waker_wake;
+        task->waker.release = task_waker_release;
+        task->waker.data = task;
+        atomic_store(&task->waker.ref_count, 1);
+        future->waker = &task->waker;
+
         atomic_fetch_add(&executor->task_count, 1);
-        
-        // Wake up the executor to process the new task
-        atomic_store(&g_should_poll, true);
-        
+        TELEMETRY_SPAWNED(executor, task);
+
+        // Every task is polled once to let it register for its first wake-up
+        task_waker_wake(&task->waker);
+
         output_string("Task spawned\n");
     }
 }
 
+void future_set_deadline(Future* future, uint32_t deadline) {
+    if (future->waker != NULL) {
+        ((Task*)future->waker->data)->deadline = deadline;
+    }
+}
+
+void executor_set_budget(Executor* executor, TaskPriority priority, uint32_t budget) {
+    if (priority < TASK_PRIORITY_COUNT) {
+        executor->budget[priority] = budget > 0 ? budget : 1;
+    }
+}
+
+// Release a future's storage through its vtable, defaulting to the heap
+static void future_release(Future* future) {
+    if (future->vtable->drop) {
+        future->vtable->drop(future);
+    } else {
+        free(future);
+    }
+}
+
+void future_finish(Future* future) {
+    if (future->vtable->cleanup) {
+        future->vtable->cleanup(future);
+    }
+    future_release(future);
+}
+
 // Poll a single task
 static bool poll_task(Task* task) {
     if (task->future->is_completed) {
@@ -63,8 +204,10 @@ static bool poll_task(Task* task) {
     }
     
     // Call the poll function from the vtable
-    FutureState state = task->future->vtable->poll(task->future, NULL);
-    
+    uint64_t start = TELEMETRY_CLOCK();
+    FutureState state = task->future->vtable->poll(task->future, &task->waker);
+    TELEMETRY_POLLED(task, start, state == FUTURE_READY);
+
     if (state == FUTURE_READY) {
         task->future->is_completed = true;
         return true; // Completed, can be removed
@@ -73,68 +216,245 @@ static bool poll_task(Task* task) {
     return false; // Still pending
 }
 
+static void task_complete(Executor* executor, Task* task) {
+    Future* future = task->future;
+    task->future = NULL;
+    TELEMETRY_COMPLETED(executor, task);
+
+    future_finish(future);
+
+    atomic_fetch_sub(&executor->task_count, 1);
+
+    // Drop the executor's reference; wakers still held elsewhere keep the
+    // task itself alive until they are dropped too.
+    waker_drop(&task->waker);
+}
+
+// Deadline tasks go before the first task due later or without a deadline;
+// the rest join the tail in wake-up order.
+static void runnable_insert(Executor* executor, Task* task) {
+    TaskPriority priority = task->priority;
+    Task** link;
+
+    if (task->deadline != TASK_NO_DEADLINE) {
+        link = &executor->runnable[priority];
+        while (*link != NULL && (*link)->deadline != TASK_NO_DEADLINE &&
+               (int32_t)((*link)->deadline - task->deadline) <= 0) {
+            link = &(*link)->next_ready;
+        }
+    } else if (executor->runnable_tail[priority] != NULL) {
+        link = &executor->runnable_tail[priority]->next_ready;
+    } else {
+        link = &executor->runnable[priority];
+    }
+
+    task->next_ready = *link;
+    *link = task;
+    if (task->next_ready == NULL) {
+        executor->runnable_tail[priority] = task;
+    }
+}
+
+static Task* runnable_pop(Executor* executor, TaskPriority priority) {
+    Task* task = executor->runnable[priority];
+
+    executor->runnable[priority] = task->next_ready;
+    if (executor->runnable[priority] == NULL) {
+        executor->runnable_tail[priority] = NULL;
+    }
+    return task;
+}
+
+uint32_t executor_poll_ready(Executor* executor) {
+    uint32_t polled = 0;
+
+    uint32_t flags = spin_lock_irqsave(&executor->lock);
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+        Task* task = task_stack_take(&executor->ready[priority]);
+        while (task) {
+            Task* next = task->next_ready;
+            runnable_insert(executor, task);
+            task = next;
+        }
+    }
+    spin_unlock_irqrestore(&executor->lock, flags);
+
+    // Tasks past a class's budget stay queued for the next pass, still
+    // marked queued, so waking them again changes nothing.
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+        uint32_t budget = executor->budget[priority];
+
+        while (budget > 0) {
+            flags = spin_lock_irqsave(&executor->lock);
+            Task* task = executor->runnable[priority] != NULL
+                ? runnable_pop(executor, (TaskPriority)priority) : NULL;
+            spin_unlock_irqrestore(&executor->lock, flags);
+            if (task == NULL) {
+                break;
+            }
+
+            // Clear the flag first: a wake-up during the poll queues it again.
+            atomic_store(&task->queued, false);
+
+            // Woken after completion by a waker that was still out
+            if (task->future != NULL) {
+                polled++;
+                budget--;
+                if (poll_task(task)) {
+                    task_complete(executor, task);
+                }
+            }
+
+            waker_drop(&task->waker);
+        }
+    }
+
+    Task* released = task_stack_take(&executor->released);
+    while (released) {
+        Task* next = released->next_ready;
+        kmem_cache_free(task_cache, released);
+        released = next;
+    }
+
+    return polled;
+}
+
+#ifndef EXECUTOR_TELEMETRY
+// Detaches the back half of a runnable list, rounded down, and returns it
+// in order with its length in `*count`.
+static Task* runnable_split(Executor* executor, TaskPriority priority, uint32_t* count) {
+    uint32_t length = 0;
+    for (Task* task = executor->runnable[priority]; task != NULL; task = task->next_ready) {
+        length++;
+    }
+
+    uint32_t keep = length - length / 2;
+    *count = length / 2;
+    if (*count == 0) {
+        return NULL;
+    }
+
+    Task* last_kept = executor->runnable[priority];
+    for (uint32_t i = 1; i < keep; i++) {
+        last_kept = last_kept->next_ready;
+    }
+
+    Task* stolen = last_kept->next_ready;
+    last_kept->next_ready = NULL;
+    executor->runnable_tail[priority] = last_kept;
+    return stolen;
+}
+#endif
+
+uint32_t executor_steal(Executor* thief, Executor* victim) {
+#ifdef EXECUTOR_TELEMETRY
+    (void)thief;
+    (void)victim;
+    return 0;
+#else
+    Task* stolen[TASK_PRIORITY_COUNT];
+    uint32_t count[TASK_PRIORITY_COUNT];
+    uint32_t total = 0;
+
+    // The two locks are never held together, so thieves stealing from each
+    // other cannot deadlock.
+    uint32_t flags = spin_lock_irqsave(&victim->lock);
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+        stolen[priority] = runnable_split(victim, (TaskPriority)priority, &count[priority]);
+        total += count[priority];
+    }
+    spin_unlock_irqrestore(&victim->lock, flags);
+
+    if (total == 0) {
+        return 0;
+    }
+
+    // Still marked queued while they move, so wake-ups leave them alone and
+    // the next one finds them on the thief.
+    atomic_fetch_sub(&victim->task_count, total);
+    atomic_fetch_add(&thief->task_count, total);
+
+    flags = spin_lock_irqsave(&thief->lock);
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+        Task* task = stolen[priority];
+        while (task) {
+            Task* next = task->next_ready;
+            task->executor = thief;
+            runnable_insert(thief, task);
+            task = next;
+        }
+    }
+    spin_unlock_irqrestore(&thief->lock, flags);
+
+    return total;
+#endif
+}
+
+bool executor_has_ready(Executor* executor) {
+    for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+        if (executor->runnable[priority] != NULL || atomic_load(&executor->ready[priority]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Run the main execution loop
 void executor_run(Executor* executor) {
     output_string("Starting async executor loop\n");
+    executor->cpu = smp_cpu_index();
 
     while (1) {
-        bool has_ready_tasks = false;
-
-        // Check if there are any tasks to process
-        if (executor->task_queue != NULL) {
-            // Poll all tasks
-            Task* current = executor->task_queue;
-            Task** prev_ptr = &executor->task_queue;
-
-            while (current) {
-                bool should_remove = poll_task(current);
-
-                if (should_remove) {
-                    // Remove completed task
-                    *prev_ptr = current->next;
-                    Task* to_remove = current;
-                    current = current->next;
-
-                    // Cleanup the future
-                    if (to_remove->future->vtable->cleanup) {
-                        to_remove->future->vtable->cleanup(to_remove->future);
-                    }
-
-                    // Free the waker if it exists
-                    if (to_remove->future->waker) {
-                        uint32_t ref_count = atomic_fetch_sub(&to_remove->future->waker->ref_count, 1);
-                        if (ref_count == 1) {
-                            free(to_remove->future->waker);
-                        }
-                    }
-
-                    free(to_remove->future);
-                    free(to_remove);
-
-                    atomic_fetch_sub(&executor->task_count, 1);
-                } else {
-                    has_ready_tasks = true;
-                    prev_ptr = &current->next;
-                    current = current->next;
-                }
-            }
+        TELEMETRY_LOOP(executor);
+
+        // A busy executor never idles to arm the one-shot timer, so expire
+        // due timers on every pass as well. The BSP owns the clock.
+        if (executor->cpu == 0) {
+            clock_run_timers();
+        }
+        executor_poll_ready(executor);
+
+        // Share a backlog with a parked CPU, or look for one to share in
+        if (executor_has_ready(executor)) {
+            smp_wake_idle(executor->cpu);
+        } else if (smp_steal_work(executor) != 0) {
+            continue;
         }
 
-        // If no tasks are ready and should_poll is false, we can halt the CPU efficiently
-        bool should_poll_current = atomic_load(&g_should_poll);
-        if (!has_ready_tasks && !should_poll_current) {
-            // CPU-efficient halt - wait for interrupt
-            __asm__ volatile ("sti; hlt; cli");
+        // Check for work with interrupts off, so an interrupt that wakes a
+        // task after the check still ends the halt instead of being lost.
+        // Other CPUs see the parked flag first and send a wake-up IPI.
+        __asm__ volatile ("cli");
+        atomic_store(&executor->parked, true);
+        bool should_poll_current = atomic_exchange(&executor->should_poll, false);
+        if (!executor_has_ready(executor) && !should_poll_current) {
+            // Sleep until the next timer deadline or device interrupt
+            uint64_t idle_start = TELEMETRY_CLOCK();
+            if (executor->cpu != 0) {
+                // Only the wake-up IPI reaches an AP
+                __asm__ volatile ("sti; hlt");
+            } else if (thread_scheduler_running()) {
+                wait_queue_sleep(&g_executor_idle);
+                __asm__ volatile ("sti");
+            } else {
+                clock_idle();
+            }
+            TELEMETRY_IDLED(executor, idle_start);
         } else {
-            // Reset the flag after polling, but keep polling if there are tasks ready
-            atomic_store(&g_should_poll, false);
+            __asm__ volatile ("sti");
         }
+        atomic_store(&executor->parked, false);
     }
 }
 
 // Wake up the executor (called from interrupt handlers)
 void executor_wake_up(void) {
-    atomic_store(&g_should_poll, true);
+    TELEMETRY_KICKED(&g_executor);
+    executor_notify(&g_executor);
+}
+
+void executor_thread_main(void* executor) {
+    executor_run((Executor*)executor);
 }
 
 // Time management functions
@@ -152,6 +472,17 @@ void monotonic_time_increment(void) {
 }
 
 // Sleep future implementation
+
+// Runs in the RTC interrupt handler once the deadline has passed.
+static void sleep_future_expired(TimerNode* timer) {
+    SleepFuture* sleep_future = TIMER_CONTAINER(timer, SleepFuture, timer);
+    Waker* waker = sleep_future->waker;
+
+    sleep_future->waker = NULL;
+    waker_wake(waker);
+    waker_drop(waker);
+}
+
 static FutureState sleep_future_poll(Future* future, void* context) {
     SleepFuture* sleep_future = (SleepFuture*)future;
     uint32_t current_tick = monotonic_time_get_ticks_global();
@@ -160,115 +491,246 @@ static FutureState sleep_future_poll(Future* future, void* context) {
         return FUTURE_READY;
     }
 
-    // If this is the first time polling and we're pending, register with wake-up list
-    // if not already registered
-    if (sleep_future->target_tick > 0) {
-        // The wake-up list will call executor_wake_up() when the time is reached
-        // which will set the g_should_poll flag and wake the executor loop
+    // On the first pending poll, arm the timer with a reference to this
+    // task's waker; it wakes only this task when the deadline passes.
+    if (!timer_pending(&sleep_future->timer)) {
+        sleep_future->waker = waker_clone((Waker*)context);
+        timer_add(&system_timer_wheel, &sleep_future->timer, sleep_future->target_tick);
     }
 
     return FUTURE_PENDING;
 }
 
 static void sleep_future_cleanup(Future* future) {
-    // No special cleanup needed for sleep future
-    (void)future;
+    SleepFuture* sleep_future = (SleepFuture*)future;
+
+    // A pending timer still owns its waker reference
+    if (timer_cancel(&system_timer_wheel, &sleep_future->timer)) {
+        waker_drop(sleep_future->waker);
+        sleep_future->waker = NULL;
+    }
+}
+
+static void sleep_future_drop(Future* future) {
+    kmem_cache_free(sleep_future_cache, future);
 }
 
 static const FutureVTable sleep_future_vtable = {
     .poll = sleep_future_poll,
-    .cleanup = sleep_future_cleanup
+    .cleanup = sleep_future_cleanup,
+    .drop = sleep_future_drop
 };
 
-// Callback function to wake up the executor when sleep is complete
-static void sleep_future_callback(void* data) {
-    (void)data; // Unused parameter
-    executor_wake_up();
+// Caller-owned sleeps are released by their owner
+static void sleep_future_embedded_drop(Future* future) {
+    (void)future;
 }
 
-Future* sleep_future_create(uint32_t ticks) {
-    SleepFuture* sleep_future = (SleepFuture*)malloc(sizeof(SleepFuture));
-    if (!sleep_future) {
-        return NULL;
-    }
+static const FutureVTable sleep_future_embedded_vtable = {
+    .poll = sleep_future_poll,
+    .cleanup = sleep_future_cleanup,
+    .drop = sleep_future_embedded_drop
+};
 
-    sleep_future->base.vtable = &sleep_future_vtable;
+static void sleep_future_setup(SleepFuture* sleep_future, const FutureVTable* vtable, uint32_t ticks) {
+    sleep_future->base.vtable = vtable;
     sleep_future->base.is_completed = false;
     sleep_future->base.waker = NULL;
     sleep_future->target_tick = monotonic_time_get_ticks_global() + ticks;
+    sleep_future->waker = NULL;
+    timer_init(&sleep_future->timer, sleep_future_expired);
+}
 
-    // Register with wake-up list to wake up the executor when sleep is complete
-    wake_up_list_add(sleep_future->target_tick, sleep_future_callback, NULL);
+Future* sleep_future_create(uint32_t ticks) {
+    SleepFuture* sleep_future = (SleepFuture*)kmem_cache_alloc(sleep_future_cache);
+    if (!sleep_future) {
+        return NULL;
+    }
 
+    sleep_future_setup(sleep_future, &sleep_future_vtable, ticks);
     return (Future*)sleep_future;
 }
 
-// Initialize the async executor system
-void async_init(void) {
-    executor_init(&g_executor);
-    monotonic_time_init();
+Future* sleep_future_init(SleepFuture* sleep_future, uint32_t ticks) {
+    sleep_future_setup(sleep_future, &sleep_future_embedded_vtable, ticks);
+    return (Future*)sleep_future;
+}
 
-    output_string("Async system initialized\n");
+// Combinators. Their storage belongs to the caller, so releasing one does
+// nothing; the children they own are finished like spawned futures.
+static void combinator_drop(Future* future) {
+    (void)future;
 }
 
-// Get the global executor instance
-Executor* get_global_executor(void) {
-    return &g_executor;
+static void combinator_init(Future* base, const FutureVTable* vtable) {
+    base->vtable = vtable;
+    base->is_completed = false;
+    base->waker = NULL;
 }
 
-// Async serial functionality
-static FutureState async_serial_write_poll(Future* future, void* context) {
-    AsyncSerialWriteFuture* serial_future = (AsyncSerialWriteFuture*)future;
+// Finishes every child still held and clears its slot.
+static void combinator_finish_all(Future** futures, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (futures[i] != NULL) {
+            future_finish(futures[i]);
+            futures[i] = NULL;
+        }
+    }
+}
 
-    // Check if data transmission is ready by checking the serial port status
-    if (serial_future->written < serial_future->len) {
-        // Check if the transmit register is empty
-        if (serial_is_transmit_empty()) {
-            // Write the next character
-            write_serial(serial_future->data[serial_future->written]);
-            serial_future->written++;
+static FutureState join_all_poll(Future* future, void* context) {
+    JoinAllFuture* join = (JoinAllFuture*)future;
 
-            // If there's still more to write, return pending
-            if (serial_future->written < serial_future->len) {
-                return FUTURE_PENDING;
-            }
-        } else {
-            // The serial port is not ready, return pending and wait for interrupt
-            return FUTURE_PENDING;
+    for (uint32_t i = 0; i < join->count; i++) {
+        Future* child = join->futures[i];
+        if (child != NULL && child->vtable->poll(child, context) == FUTURE_READY) {
+            future_finish(child);
+            join->futures[i] = NULL;
+            join->remaining--;
         }
     }
 
-    // All data has been written
-    return FUTURE_READY;
+    return join->remaining == 0 ? FUTURE_READY : FUTURE_PENDING;
 }
 
-static void async_serial_write_cleanup(Future* future) {
-    // No special cleanup needed for async serial write future
-    (void)future;
+static void join_all_cleanup(Future* future) {
+    JoinAllFuture* join = (JoinAllFuture*)future;
+    combinator_finish_all(join->futures, join->count);
 }
 
-static const FutureVTable async_serial_write_vtable = {
-    .poll = async_serial_write_poll,
-    .cleanup = async_serial_write_cleanup
+static const FutureVTable join_all_vtable = {
+    .poll = join_all_poll,
+    .cleanup = join_all_cleanup,
+    .drop = combinator_drop
 };
 
-Future* async_serial_write_create(const char* data, size_t len) {
-    AsyncSerialWriteFuture* serial_future = (AsyncSerialWriteFuture*)malloc(sizeof(AsyncSerialWriteFuture));
-    if (!serial_future) {
-        return NULL;
+Future* join_all_init(JoinAllFuture* join, Future** futures, uint32_t count) {
+    combinator_init(&join->base, &join_all_vtable);
+    join->futures = futures;
+    join->count = count;
+    join->remaining = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (futures[i] != NULL) {
+            join->remaining++;
+        }
+    }
+
+    return (Future*)join;
+}
+
+static FutureState select_first_poll(Future* future, void* context) {
+    SelectFirstFuture* select = (SelectFirstFuture*)future;
+
+    for (uint32_t i = 0; i < select->count; i++) {
+        Future* child = select->futures[i];
+        if (child != NULL && child->vtable->poll(child, context) == FUTURE_READY) {
+            select->winner = (int32_t)i;
+            // The losers are cancelled along with the winner's cleanup
+            combinator_finish_all(select->futures, select->count);
+            return FUTURE_READY;
+        }
+    }
+
+    return FUTURE_PENDING;
+}
+
+static void select_first_cleanup(Future* future) {
+    SelectFirstFuture* select = (SelectFirstFuture*)future;
+    combinator_finish_all(select->futures, select->count);
+}
+
+static const FutureVTable select_first_vtable = {
+    .poll = select_first_poll,
+    .cleanup = select_first_cleanup,
+    .drop = combinator_drop
+};
+
+Future* select_first_init(SelectFirstFuture* select, Future** futures, uint32_t count) {
+    combinator_init(&select->base, &select_first_vtable);
+    select->futures = futures;
+    select->count = count;
+    select->winner = -1;
+
+    return (Future*)select;
+}
+
+static void timeout_future_expired(TimerNode* timer) {
+    TimeoutFuture* timeout = TIMER_CONTAINER(timer, TimeoutFuture, timer);
+    Waker* waker = timeout->waker;
+
+    timeout->waker = NULL;
+    waker_wake(waker);
+    waker_drop(waker);
+}
+
+static void timeout_future_disarm(TimeoutFuture* timeout) {
+    if (timer_cancel(&system_timer_wheel, &timeout->timer)) {
+        waker_drop(timeout->waker);
+        timeout->waker = NULL;
+    }
+}
+
+static FutureState timeout_future_poll(Future* future, void* context) {
+    TimeoutFuture* timeout = (TimeoutFuture*)future;
+
+    // The inner future wins a tie with the deadline
+    if (timeout->inner->vtable->poll(timeout->inner, context) == FUTURE_READY) {
+        timeout->timed_out = false;
+    } else if ((int32_t)(monotonic_time_get_ticks_global() - timeout->deadline) >= 0) {
+        timeout->timed_out = true;
+    } else {
+        if (!timer_pending(&timeout->timer)) {
+            timeout->waker = waker_clone((Waker*)context);
+            timer_add(&system_timer_wheel, &timeout->timer, timeout->deadline);
+        }
+        return FUTURE_PENDING;
+    }
+
+    timeout_future_disarm(timeout);
+    future_finish(timeout->inner);
+    timeout->inner = NULL;
+    return FUTURE_READY;
+}
+
+static void timeout_future_cleanup(Future* future) {
+    TimeoutFuture* timeout = (TimeoutFuture*)future;
+
+    timeout_future_disarm(timeout);
+    if (timeout->inner != NULL) {
+        future_finish(timeout->inner);
+        timeout->inner = NULL;
     }
+}
+
+static const FutureVTable timeout_future_vtable = {
+    .poll = timeout_future_poll,
+    .cleanup = timeout_future_cleanup,
+    .drop = combinator_drop
+};
+
+Future* with_timeout_init(TimeoutFuture* timeout, Future* inner, uint32_t ticks) {
+    combinator_init(&timeout->base, &timeout_future_vtable);
+    timeout->inner = inner;
+    timeout->deadline = monotonic_time_get_ticks_global() + ticks;
+    timeout->waker = NULL;
+    timeout->timed_out = false;
+    timer_init(&timeout->timer, timeout_future_expired);
 
-    serial_future->base.vtable = &async_serial_write_vtable;
-    serial_future->base.is_completed = false;
-    serial_future->base.waker = NULL;
-    serial_future->data = data;
-    serial_future->len = len;
-    serial_future->written = 0;
+    return (Future*)timeout;
+}
+
+// Initialize the async executor system
+void async_init(void) {
+    task_cache = kmem_cache_create("task", sizeof(Task), sizeof(void*));
+    sleep_future_cache = kmem_cache_create("sleep_future", sizeof(SleepFuture), sizeof(void*));
+
+    executor_init(&g_executor);
+    monotonic_time_init();
 
-    return (Future*)serial_future;
+    output_string("Async system initialized\n");
 }
 
-void async_serial_interrupt_handler(void) {
-    // Wake up the executor since the serial port may be ready for more data
-    executor_wake_up();
-}
\ No newline at end of file
+// Get the global executor instance
+Executor* get_global_executor(void) {
+    return &g_executor;
+}
@@ -6,6 +6,9 @@
 #include <stdatomic.h>
 #include <stddef.h>
 #include "idt.h"
+#include "timer.h"
+#include "spinlock.h"
+#include "executor_telemetry.h"
 
 typedef struct Future Future;
 typedef struct Waker Waker;
@@ -17,8 +20,14 @@ typedef enum {
 } FutureState;
 
 typedef struct {
+    // `context` is the Waker of the task being polled. A future that returns
+    // FUTURE_PENDING must arrange for that waker to be woken, or it is never
+    // polled again; waking it before returning yields.
     FutureState (*poll)(Future* future, void* context);
     void (*cleanup)(Future* future);
+    // Releases the future's storage once the executor is done with it.
+    // NULL means the future was allocated with malloc.
+    void (*drop)(Future* future);
 } FutureVTable;
 
 struct Future {
@@ -27,55 +36,191 @@ struct Future {
     Waker* waker;  
 };
 
+// Wakers are reference counted. Whoever keeps one past the poll that handed
+// it out (a timer, an interrupt handler) takes a reference with waker_clone
+// and gives it back with waker_drop. Waking and dropping are safe from
+// interrupt handlers.
 struct Waker {
     void (*wake)(Waker* waker);
+    void (*release)(Waker* waker);
     atomic_uint_fast32_t ref_count;
     void* data;
 };
 
+// Tasks are polled class by class, most urgent first. Each pass polls at
+// most a class's budget of its ready tasks before moving on, so a flood of
+// work in one class delays the others by a bounded amount instead of
+// starving them. executor_spawn uses TASK_PRIORITY_NORMAL.
+typedef enum {
+    TASK_PRIORITY_HIGH,         // Device and timer latency: serial RX, expiry
+    TASK_PRIORITY_NORMAL,
+    TASK_PRIORITY_LOW,          // Background: log draining, reporting
+    TASK_PRIORITY_COUNT
+} TaskPriority;
+
+#define EXECUTOR_BUDGET_HIGH    32
+#define EXECUTOR_BUDGET_NORMAL  16
+#define EXECUTOR_BUDGET_LOW     4
+
+// Within a class, tasks with a deadline are polled first, earliest first,
+// then the rest in wake-up order. Deadlines are monotonic ticks; they only
+// order the queue and nothing happens when one passes.
+#define TASK_NO_DEADLINE 0xFFFFFFFFu
+
+// Each task embeds its own waker, which pushes the task onto its executor's
+// ready queue. The executor holds one reference while the future is live and
+// the ready queue one while the task is queued; the task is freed by the
+// executor loop once the last reference is gone.
 typedef struct Task {
     Future* future;
-    struct Task* next;
+    Waker waker;
+    Executor* executor;
+    atomic_bool queued;
+    TaskPriority priority;
+    uint32_t deadline;          // TASK_NO_DEADLINE for none
+    struct Task* next_ready;
+#ifdef EXECUTOR_TELEMETRY
+    TaskStats stats;
+    struct Task* next_live;     // Every live task, for the telemetry dump
+    struct Task** pprev_live;
+#endif
 } Task;
 
+// `ready` and `released` are lock-free stacks pushed from any context, newest
+// first. The executor takes each one whole and only ever polls tasks that
+// were woken, so the cost of a wake-up does not depend on the task count.
+// Taken tasks wait in `runnable`, in polling order, until their class has
+// budget left. `lock` guards `runnable` against other CPUs' executors
+// stealing from it; nothing else takes it.
 struct Executor {
-    Task* task_queue;
+    _Atomic(Task*) ready[TASK_PRIORITY_COUNT];
+    _Atomic(Task*) released;
+    Task* runnable[TASK_PRIORITY_COUNT];
+    Task* runnable_tail[TASK_PRIORITY_COUNT];
+    uint32_t budget[TASK_PRIORITY_COUNT];
+    Spinlock lock;
+    uint32_t cpu;               // Index of the CPU running it, see smp.h
+    atomic_bool parked;         // Halted or blocked until notified
     atomic_bool should_poll;
     atomic_uint_fast32_t task_count;
+#ifdef EXECUTOR_TELEMETRY
+    ExecutorStats stats;
+    Task* live_tasks;
+#endif
 };
 
+Waker* waker_clone(Waker* waker);
+void waker_drop(Waker* waker);
+void waker_wake(Waker* waker);
+
 void executor_init(Executor* executor);
 
 void executor_spawn(Executor* executor, Future* future);
 
+// Spawns with a priority class and a deadline, or TASK_NO_DEADLINE.
+void executor_spawn_with(Executor* executor, Future* future, TaskPriority priority, uint32_t deadline);
+
+// Moves a spawned future's deadline, for tasks whose urgency changes from
+// one request to the next. Takes effect the next time the task is woken.
+void future_set_deadline(Future* future, uint32_t deadline);
+
+// Polls per pass allowed to `priority`, at least 1.
+void executor_set_budget(Executor* executor, TaskPriority priority, uint32_t budget);
+
 void executor_run(Executor* executor);
 
+// Thread entry point running executor_run. While the executor has nothing
+// to poll its thread blocks, instead of halting the CPU.
+void executor_thread_main(void* executor);
+
+// Polls the tasks woken since the last call, and any left over from it, up
+// to each class's budget, and frees released tasks. Returns the number of
+// tasks polled.
+uint32_t executor_poll_ready(Executor* executor);
+
+// True if a woken task is waiting to be polled.
+bool executor_has_ready(Executor* executor);
+
+// Makes the executor poll again soon, waking its CPU if it is parked. Safe
+// from any CPU and from interrupt handlers.
+void executor_notify(Executor* executor);
+
+// Moves up to half of `victim`'s runnable tasks of each class to `thief`,
+// the latest to run first. Call from the thief's CPU. Returns the number of
+// tasks moved; always 0 with EXECUTOR_TELEMETRY, whose per-executor task
+// lists are not shared between CPUs.
+uint32_t executor_steal(Executor* thief, Executor* victim);
+
+// Notifies the global executor (called from interrupt handlers).
 void executor_wake_up(void);
 
+// Cleans up a future that will not be polled again and releases it through
+// its vtable. Finishing a future before it completes cancels it.
+void future_finish(Future* future);
+
 void monotonic_time_init(void);
 uint32_t monotonic_time_get_ticks(void);
 void monotonic_time_increment(void);
 
+// The timer is embedded, so sleeping allocates nothing beyond the future.
+// While it is pending it holds a reference to the sleeping task's waker;
+// dropping the future cancels it.
 typedef struct {
     Future base;
     uint32_t target_tick;
+    TimerNode timer;
+    Waker* waker;
 } SleepFuture;
 
 Future* sleep_future_create(uint32_t ticks);
 
-void async_init(void);
+// Same, in caller-provided storage, for embedding in a combinator or
+// coroutine. Releasing it is a no-op.
+Future* sleep_future_init(SleepFuture* sleep_future, uint32_t ticks);
 
-Executor* get_global_executor(void);
+// Combinators run several futures as one, inside a single task. The caller
+// provides each combinator's storage and it allocates nothing; releasing it
+// is a no-op, so it can be embedded or live on a stack that outlasts it.
+// Children are owned as if spawned: each is finished as soon as it is no
+// longer needed, and its slot in `futures` set to NULL. Children are polled
+// with the task's waker, so any wake-up re-polls every child still pending.
+
+// Completes once every child has.
+typedef struct {
+    Future base;
+    Future** futures;
+    uint32_t count;
+    uint32_t remaining;
+} JoinAllFuture;
+
+Future* join_all_init(JoinAllFuture* join, Future** futures, uint32_t count);
+
+// Completes with the first child to complete, in array order on a tie, and
+// cancels the rest.
+typedef struct {
+    Future base;
+    Future** futures;
+    uint32_t count;
+    int32_t winner;             // Index of the completed child; -1 until then
+} SelectFirstFuture;
+
+Future* select_first_init(SelectFirstFuture* select, Future** futures, uint32_t count);
 
+// Completes with the inner future, or `ticks` from now with `timed_out` set
+// and the inner future cancelled.
 typedef struct {
     Future base;
-    const char* data;
-    size_t len;
-    size_t written;
-} AsyncSerialWriteFuture;
+    Future* inner;
+    uint32_t deadline;
+    TimerNode timer;
+    Waker* waker;               // Held while the timer is pending
+    bool timed_out;
+} TimeoutFuture;
 
-Future* async_serial_write_create(const char* data, size_t len);
+Future* with_timeout_init(TimeoutFuture* timeout, Future* inner, uint32_t ticks);
 
-void async_serial_interrupt_handler(void);
+void async_init(void);
+
+Executor* get_global_executor(void);
 
 #endif
\ No newline at end of file
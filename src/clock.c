@@ -0,0 +1,193 @@
+#include "clock.h"
+#include "pit.h"
+#include "rtc.h"
+#include "timer.h"
+#include "io.h"
+#include "terminal.h"
+#include "async_executor.h"
+#include "thread.h"
+
+#define CPUID_EDX_TSC (1 << 4)
+
+#define NS_PER_SEC 1000000000u
+
+// ticks = ns * 1024 / 1e9 as a 32-bit multiplier over 2^51, rounded up so
+// that the tick count read at a deadline's nanosecond is never behind it.
+#define CLOCK_TICK_MULT  2305843010u
+#define CLOCK_TICK_SHIFT 51
+
+// PIT input cycles per nanosecond over 2^32, and the longest one-shot.
+#define CLOCK_PIT_MULT      ((uint32_t)(((uint64_t)PIT_HZ << 32) / NS_PER_SEC))
+#define CLOCK_ONESHOT_MAX_NS ((uint64_t)PIT_MAX_COUNT * NS_PER_SEC / PIT_HZ)
+
+_Static_assert(CLOCK_TICK_HZ % RTC_PERIODIC_HZ == 0,
+               "the RTC fallback must advance a whole number of ticks");
+
+static bool clock_tsc_mode = false;
+static uint64_t clock_tsc_base;
+static uint32_t clock_ns_mult;
+static uint32_t clock_ns_shift;
+
+static volatile uint64_t clock_periodic_count;
+
+// (value * mult) >> shift without losing the high bits of the 96-bit product.
+static inline uint64_t clock_scale(uint64_t value, uint32_t mult, uint32_t shift) {
+    uint64_t hi = (value >> 32) * mult;
+    uint64_t lo = (value & 0xFFFFFFFFu) * mult;
+
+    if (shift >= 32) {
+        return (hi + (lo >> 32)) >> (shift - 32);
+    }
+    return (hi << (32 - shift)) + (lo >> shift);
+}
+
+// The kernel is linked without libgcc, so 64-bit division is done by hand.
+// Only used while calibrating.
+static uint64_t clock_div64(uint64_t dividend, uint64_t divisor) {
+    uint64_t quotient = 0;
+    uint64_t remainder = 0;
+
+    for (int bit = 63; bit >= 0; bit--) {
+        remainder = (remainder << 1) | ((dividend >> bit) & 1);
+        if (remainder >= divisor) {
+            remainder -= divisor;
+            quotient |= (uint64_t)1 << bit;
+        }
+    }
+
+    return quotient;
+}
+
+static inline uint64_t clock_ns_to_ticks(uint64_t ns) {
+    return clock_scale(ns, CLOCK_TICK_MULT, CLOCK_TICK_SHIFT);
+}
+
+// 1e9 / 1024 = 1953125 / 2, rounded up.
+static inline uint64_t clock_ticks_to_ns(uint64_t ticks) {
+    return (ticks * 1953125 + 1) >> 1;
+}
+
+static bool clock_has_tsc(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax < 1) {
+        return false;
+    }
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_EDX_TSC) != 0;
+}
+
+void clock_init(void) {
+    if (!clock_has_tsc() || !pit_init()) {
+        output_string("Clock: no TSC or PIT, using the periodic RTC tick\n");
+        return;
+    }
+
+    uint64_t tsc_hz = pit_calibrate_tsc();
+    if (tsc_hz == 0) {
+        output_string("Clock: TSC calibration failed, using the periodic RTC tick\n");
+        return;
+    }
+
+    // Largest shift whose multiplier still fits 32 bits keeps the most
+    // precision.
+    uint32_t shift = 34;
+    uint64_t mult = clock_div64((uint64_t)NS_PER_SEC << shift, tsc_hz);
+    while (mult > 0xFFFFFFFFu && shift > 0) {
+        shift--;
+        mult = clock_div64((uint64_t)NS_PER_SEC << shift, tsc_hz);
+    }
+
+    clock_ns_mult = (uint32_t)mult;
+    clock_ns_shift = shift;
+    clock_tsc_base = read_tsc();
+    clock_tsc_mode = true;
+
+    // Replace the firmware's periodic mode; IRQ 0 stays masked until the
+    // kernel installs clock_event_interrupt.
+    pit_oneshot(PIT_MAX_COUNT);
+
+    output_string("Clock: tickless, TSC at ");
+    put_u32((uint32_t)clock_div64(tsc_hz, 1000));
+    output_string(" kHz\n");
+}
+
+bool clock_tickless(void) {
+    return clock_tsc_mode;
+}
+
+uint64_t clock_ns(void) {
+    if (clock_tsc_mode) {
+        return clock_scale(read_tsc() - clock_tsc_base, clock_ns_mult, clock_ns_shift);
+    }
+
+    uint32_t flags = irq_save();
+    uint64_t ticks = clock_periodic_count;
+    irq_restore(flags);
+    return clock_ticks_to_ns(ticks);
+}
+
+uint32_t clock_ticks(void) {
+    if (clock_tsc_mode) {
+        return (uint32_t)clock_ns_to_ticks(clock_ns());
+    }
+    return (uint32_t)clock_periodic_count;
+}
+
+void clock_periodic_tick(void) {
+    if (!clock_tsc_mode) {
+        clock_periodic_count += CLOCK_TICK_HZ / RTC_PERIODIC_HZ;
+        thread_timer_tick();
+    }
+}
+
+void clock_run_timers(void) {
+    timer_wheel_advance(&system_timer_wheel, clock_ticks());
+}
+
+// Arms the PIT to fire at the start of tick `target`, or at once if it has
+// passed. Deadlines beyond the PIT's range wake early and re-arm.
+static void clock_arm(uint32_t target) {
+    uint64_t now_ns = clock_ns();
+    uint64_t now_ticks = clock_ns_to_ticks(now_ns);
+    int32_t ahead = (int32_t)(target - (uint32_t)now_ticks);
+    uint32_t count = 1;
+
+    if (ahead > 0) {
+        uint64_t deadline_ns = clock_ticks_to_ns(now_ticks + (uint32_t)ahead);
+        uint64_t delta_ns = deadline_ns > now_ns ? deadline_ns - now_ns : 0;
+
+        if (delta_ns >= CLOCK_ONESHOT_MAX_NS) {
+            count = PIT_MAX_COUNT;
+        } else {
+            count = (uint32_t)((delta_ns * CLOCK_PIT_MULT) >> 32) + 1;
+            if (count > PIT_MAX_COUNT) {
+                count = PIT_MAX_COUNT;
+            }
+        }
+    }
+
+    pit_oneshot((uint16_t)count);
+}
+
+void clock_arm_event(uint32_t limit) {
+    if (clock_tsc_mode) {
+        clock_arm(timer_wheel_next_event(&system_timer_wheel, limit));
+    }
+}
+
+void clock_idle(void) {
+    if (clock_tsc_mode) {
+        clock_arm(timer_wheel_next_event(&system_timer_wheel, TIMER_WHEEL_SLOTS));
+    }
+
+    // sti only takes effect after the following instruction, so a wake-up
+    // raised since the caller's check still ends the hlt.
+    __asm__ volatile ("sti; hlt");
+}
+
+void clock_event_interrupt(void) {
+    clock_run_timers();
+    executor_wake_up();
+    thread_timer_tick();
+}
@@ -0,0 +1,43 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Resolution of monotonic ticks, the unit of the system timer wheel.
+#define CLOCK_TICK_HZ 1024
+
+// With an invariant-enough TSC, monotonic time is read from the TSC and the
+// PIT is only programmed, one-shot, for the next timer deadline when the
+// executor idles. Without one, ticks are counted from the periodic RTC
+// interrupt as before.
+void clock_init(void);
+
+bool clock_tickless(void);
+
+uint64_t clock_ns(void);
+
+// Low 32 bits of the tick count since clock_init. Wraps; compare with
+// signed differences as the timer wheel does.
+uint32_t clock_ticks(void);
+
+// Periodic fallback: called from the RTC interrupt. No-op when tickless.
+void clock_periodic_tick(void);
+
+// Expires every system timer due by now.
+void clock_run_timers(void);
+
+// Idles the CPU until the next interrupt. Call with interrupts off after
+// deciding there is nothing to do; returns with interrupts on. When
+// tickless, the PIT is armed for the next pending deadline first.
+void clock_idle(void);
+
+// Tickless only: arms the PIT for the next pending timer deadline, at most
+// `limit` ticks ahead, for callers that must regain the CPU without
+// idling. The scheduler uses it to end time slices.
+void clock_arm_event(uint32_t limit);
+
+// PIT IRQ 0 handler for tickless mode.
+void clock_event_interrupt(void);
+
+#endif
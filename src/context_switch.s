@@ -0,0 +1,30 @@
+.section .text
+.code32
+
+.globl context_switch
+
+# void context_switch(uint32_t* save_esp, uint32_t load_esp)
+#
+# The caller-saved registers are already saved by the C caller, so only
+# the callee-saved ones and EFLAGS go on the outgoing stack. A new thread's
+# stack is laid out the same way by thread_create, returning into
+# thread_trampoline.
+context_switch:
+    pushl   %ebp
+    pushl   %ebx
+    pushl   %esi
+    pushl   %edi
+    pushfl
+
+    movl    24(%esp), %eax      # save_esp
+    movl    %esp, (%eax)
+    movl    28(%esp), %esp      # load_esp
+
+    popfl
+    popl    %edi
+    popl    %esi
+    popl    %ebx
+    popl    %ebp
+    ret
+
+.section .note.GNU-stack,"",@progbits
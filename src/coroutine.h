@@ -0,0 +1,88 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "async_executor.h"
+
+// Stackless coroutines over Future, in the style of protothreads. A poll
+// function written as
+//
+//     static FutureState blink_poll(Future* future, void* context) {
+//         Blink* blink = (Blink*)future;
+//
+//         ASYNC_BEGIN(&blink->frame, context);
+//         while (blink->remaining-- > 0) {
+//             AWAIT(sleep_future_init(&blink->sleep, CLOCK_TICK_HZ));
+//             blink->write = async_serial_write_create("blink\n", 6);
+//             if (blink->write == NULL) {
+//                 break;
+//             }
+//             AWAIT(blink->write);
+//         }
+//         ASYNC_END();
+//     }
+//
+// compiles to one switch on the suspension point reached last, stored in
+// the frame. Nothing is allocated beyond what the awaited futures need.
+//
+// Locals do not survive a suspension, so keep state in the future's struct.
+// Use at most one AWAIT or ASYNC_YIELD per source line, and none inside a
+// switch statement of your own between ASYNC_BEGIN and ASYNC_END.
+#define ASYNC_FRAME_DONE 0xFFFFFFFFu
+
+typedef struct {
+    uint32_t line;              // Suspension point to resume at; 0 to start
+    Future* awaiting;           // Owned until it completes or is cancelled
+} AsyncFrame;
+
+static inline void async_frame_init(AsyncFrame* frame) {
+    frame->line = 0;
+    frame->awaiting = NULL;
+}
+
+// Call from the coroutine's cleanup: cancels the future it was awaiting.
+static inline void async_frame_cleanup(AsyncFrame* frame) {
+    if (frame->awaiting != NULL) {
+        future_finish(frame->awaiting);
+        frame->awaiting = NULL;
+    }
+}
+
+#define ASYNC_BEGIN(frame, context)                 \
+    AsyncFrame* async_frame_ = (frame);             \
+    void* async_context_ = (context);               \
+    switch (async_frame_->line) {                   \
+    case 0:
+
+// Polls `future` until it completes, then finishes it. The future is owned
+// from here on, as if spawned, and must not be NULL.
+#define AWAIT(future)                                                       \
+    do {                                                                    \
+        async_frame_->awaiting = (future);                                  \
+        async_frame_->line = __LINE__;                                      \
+        __attribute__((fallthrough));                                       \
+    case __LINE__:                                                          \
+        if (async_frame_->awaiting->vtable->poll(async_frame_->awaiting,   \
+                                                 async_context_) == FUTURE_PENDING) { \
+            return FUTURE_PENDING;                                          \
+        }                                                                   \
+        future_finish(async_frame_->awaiting);                              \
+        async_frame_->awaiting = NULL;                                      \
+    } while (0)
+
+// Gives the other tasks a turn and resumes on the next pass.
+#define ASYNC_YIELD()                                                       \
+    do {                                                                    \
+        async_frame_->line = __LINE__;                                      \
+        waker_wake((Waker*)async_context_);                                 \
+        return FUTURE_PENDING;                                              \
+    case __LINE__:;                                                         \
+    } while (0)
+
+#define ASYNC_END()                                 \
+    }                                               \
+    async_frame_->line = ASYNC_FRAME_DONE;          \
+    return FUTURE_READY
+
+#endif
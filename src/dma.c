@@ -0,0 +1,49 @@
+#include "dma.h"
+#include "page_allocator.h"
+
+int dma_alloc(DmaBuffer* buffer, size_t size, size_t alignment, uint32_t flags) {
+    buffer->virt = NULL;
+    buffer->phys = 0;
+    buffer->size = 0;
+    buffer->order = 0;
+
+    if (size == 0 || (alignment & (alignment - 1)) != 0) {
+        return -1;
+    }
+
+    // A block of 2^order pages is aligned to its own size, so the order has
+    // to cover both the size and the alignment.
+    size_t span = size > alignment ? size : alignment;
+    uint32_t order = page_order_for_size(span);
+    if (((size_t)PAGE_SIZE << order) < span) {
+        return -1;
+    }
+
+    void* block;
+    if (flags & DMA_BELOW_16M) {
+        block = alloc_pages_zone(order, PAGE_ZONE_DMA);
+    } else {
+        block = alloc_pages(order);
+    }
+
+    if (block == NULL) {
+        return -1;
+    }
+
+    buffer->virt = block;
+    buffer->phys = (uint32_t)(uintptr_t)block;
+    buffer->size = (size_t)PAGE_SIZE << order;
+    buffer->order = order;
+    return 0;
+}
+
+void dma_free(DmaBuffer* buffer) {
+    if (buffer == NULL || buffer->virt == NULL) {
+        return;
+    }
+
+    free_pages(buffer->virt, buffer->order);
+    buffer->virt = NULL;
+    buffer->phys = 0;
+    buffer->size = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Restrict the buffer to the DMA zone below 16 MiB, for ISA-style devices.
+#define DMA_BELOW_16M 0x1
+
+// A physically contiguous buffer taken straight from the page allocator.
+// Blocks are powers of two in pages and aligned to their own size, so any
+// alignment up to the block size comes for free. Kernel RAM is identity
+// mapped, so `virt` and `phys` hold the same address.
+typedef struct {
+    void* virt;
+    uint32_t phys;
+    size_t size;        // Usable size: the whole block, at least the request
+    uint32_t order;
+} DmaBuffer;
+
+// Fills `buffer` and returns 0, or returns -1 if the request cannot be met.
+// Alignment must be a power of two no larger than the largest buddy block.
+int dma_alloc(DmaBuffer* buffer, size_t size, size_t alignment, uint32_t flags);
+
+void dma_free(DmaBuffer* buffer);
+
+#endif
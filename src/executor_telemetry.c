@@ -0,0 +1,257 @@
+#include "executor_telemetry.h"
+
+#ifdef EXECUTOR_TELEMETRY
+
+#include "async_executor.h"
+#include "coroutine.h"
+#include "io.h"
+#include "terminal.h"
+
+static inline bool telemetry_irqs_off(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0" : "=r" (flags));
+    return (flags & EFLAGS_IF) == 0;
+}
+
+void executor_telemetry_init(Executor* executor) {
+    ExecutorStats* stats = &executor->stats;
+
+    stats->start_tsc = read_tsc();
+    stats->idle_cycles = 0;
+    stats->loop_iterations = 0;
+    stats->idle_entries = 0;
+    stats->tasks_completed = 0;
+    atomic_store(&stats->wakes_irqs_off, 0);
+    atomic_store(&stats->wakes_irqs_on, 0);
+    atomic_store(&stats->wakes_coalesced, 0);
+    atomic_store(&stats->kicks, 0);
+    executor->live_tasks = NULL;
+}
+
+// The live list is only touched from task context, by spawn and completion.
+void executor_telemetry_task_spawned(Executor* executor, Task* task) {
+    task->stats = (TaskStats){0};
+
+    task->next_live = executor->live_tasks;
+    if (task->next_live != NULL) {
+        task->next_live->pprev_live = &task->next_live;
+    }
+    task->pprev_live = &executor->live_tasks;
+    executor->live_tasks = task;
+}
+
+void executor_telemetry_task_completed(Executor* executor, Task* task) {
+    *task->pprev_live = task->next_live;
+    if (task->next_live != NULL) {
+        task->next_live->pprev_live = task->pprev_live;
+    }
+    task->next_live = NULL;
+    task->pprev_live = NULL;
+
+    executor->stats.tasks_completed++;
+}
+
+void executor_telemetry_polled(Task* task, uint64_t start, bool completed) {
+    TaskStats* stats = &task->stats;
+    uint64_t cycles = read_tsc() - start;
+
+    stats->polls++;
+    if (!completed) {
+        stats->pending_polls++;
+    }
+    stats->poll_cycles += cycles;
+    if (cycles > stats->max_poll_cycles) {
+        stats->max_poll_cycles = cycles;
+    }
+}
+
+void executor_telemetry_woken(Executor* executor, bool coalesced) {
+    ExecutorStats* stats = &executor->stats;
+
+    if (coalesced) {
+        atomic_fetch_add(&stats->wakes_coalesced, 1);
+    } else if (telemetry_irqs_off()) {
+        atomic_fetch_add(&stats->wakes_irqs_off, 1);
+    } else {
+        atomic_fetch_add(&stats->wakes_irqs_on, 1);
+    }
+}
+
+void executor_telemetry_kicked(Executor* executor) {
+    atomic_fetch_add(&executor->stats.kicks, 1);
+}
+
+void executor_telemetry_loop(Executor* executor) {
+    executor->stats.loop_iterations++;
+}
+
+void executor_telemetry_idled(Executor* executor, uint64_t start) {
+    executor->stats.idle_entries++;
+    executor->stats.idle_cycles += read_tsc() - start;
+}
+
+const TaskStats* executor_task_stats(const Future* future) {
+    if (future->waker == NULL) {
+        return NULL;
+    }
+    return &((Task*)future->waker->data)->stats;
+}
+
+// The kernel is linked without libgcc, so avoid 64-bit division: scale
+// both sides down until they fit the 32-bit divide.
+static uint32_t telemetry_ratio(uint64_t numerator, uint64_t denominator, uint32_t scale) {
+    while ((denominator >> 24) != 0) {
+        numerator >>= 1;
+        denominator >>= 1;
+    }
+    if (denominator == 0) {
+        return 0;
+    }
+    if (numerator > denominator) {
+        numerator = denominator;
+    }
+    return (uint32_t)numerator * scale / (uint32_t)denominator;
+}
+
+static uint32_t telemetry_average(uint64_t total, uint32_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    while ((total >> 32) != 0 && count > 1) {
+        total >>= 1;
+        count >>= 1;
+    }
+    if ((total >> 32) != 0) {
+        return 0xFFFFFFFF;
+    }
+    return (uint32_t)total / count;
+}
+
+// Cycle totals that do not fit put_u32 print in units of 2^20.
+static void telemetry_put_cycles(uint64_t value) {
+    if ((value >> 32) == 0) {
+        put_u32((uint32_t)value);
+    } else {
+        put_u32((uint32_t)(value >> 20));
+        output_string("M");
+    }
+}
+
+static void telemetry_print_task(const Task* task) {
+    const TaskStats* stats = &task->stats;
+
+    output_string("  ");
+    put_hex((uint32_t)(uintptr_t)task->future->vtable->poll);
+    output_string(" polls=");
+    put_u32(stats->polls);
+    output_string(" pending=");
+    put_u32(stats->pending_polls);
+    output_string(" cycles=");
+    telemetry_put_cycles(stats->poll_cycles);
+    output_string(" avg=");
+    put_u32(telemetry_average(stats->poll_cycles, stats->polls));
+    output_string(" max=");
+    telemetry_put_cycles(stats->max_poll_cycles);
+    output_string("\n");
+}
+
+void executor_telemetry_dump(Executor* executor, uint32_t count) {
+    ExecutorStats* stats = &executor->stats;
+    uint64_t elapsed = read_tsc() - stats->start_tsc;
+
+    output_string("executor: loops=");
+    put_u32(stats->loop_iterations);
+    output_string(" idle=");
+    put_u32(telemetry_ratio(stats->idle_cycles, elapsed, 100));
+    output_string("% halts=");
+    put_u32(stats->idle_entries);
+    output_string(" wakes irq=");
+    put_u32(atomic_load(&stats->wakes_irqs_off));
+    output_string(" task=");
+    put_u32(atomic_load(&stats->wakes_irqs_on));
+    output_string(" coalesced=");
+    put_u32(atomic_load(&stats->wakes_coalesced));
+    output_string(" kicks=");
+    put_u32(atomic_load(&stats->kicks));
+    output_string(" tasks=");
+    put_u32(executor->task_count);
+    output_string(" completed=");
+    put_u32(stats->tasks_completed);
+    output_string("\n");
+
+    // Selection by poll cycles, one pass per row, as the heap profile does.
+    // The last printed task bounds the next pass.
+    const Task* previous = NULL;
+    for (uint32_t row = 0; row < count; row++) {
+        const Task* best = NULL;
+        for (const Task* task = executor->live_tasks; task != NULL; task = task->next_live) {
+            if (previous != NULL &&
+                (task->stats.poll_cycles > previous->stats.poll_cycles ||
+                 (task->stats.poll_cycles == previous->stats.poll_cycles && task >= previous))) {
+                continue;
+            }
+            if (best == NULL || task->stats.poll_cycles > best->stats.poll_cycles ||
+                (task->stats.poll_cycles == best->stats.poll_cycles && task > best)) {
+                best = task;
+            }
+        }
+        if (best == NULL) {
+            break;
+        }
+        telemetry_print_task(best);
+        previous = best;
+    }
+}
+
+typedef struct {
+    Future base;
+    AsyncFrame frame;
+    SleepFuture sleep;
+    Executor* executor;
+    uint32_t period_ticks;
+} TelemetryReporter;
+
+static TelemetryReporter telemetry_reporter;
+
+static FutureState telemetry_reporter_poll(Future* future, void* context) {
+    TelemetryReporter* reporter = (TelemetryReporter*)future;
+
+    ASYNC_BEGIN(&reporter->frame, context);
+    while (1) {
+        AWAIT(sleep_future_init(&reporter->sleep, reporter->period_ticks));
+        executor_telemetry_dump(reporter->executor, EXECUTOR_TELEMETRY_TOP_N);
+    }
+    ASYNC_END();
+}
+
+static void telemetry_reporter_cleanup(Future* future) {
+    async_frame_cleanup(&((TelemetryReporter*)future)->frame);
+}
+
+static void telemetry_reporter_drop(Future* future) {
+    (void)future;
+}
+
+static const FutureVTable telemetry_reporter_vtable = {
+    .poll = telemetry_reporter_poll,
+    .cleanup = telemetry_reporter_cleanup,
+    .drop = telemetry_reporter_drop
+};
+
+void executor_telemetry_start_reporter(Executor* executor, uint32_t period_ticks) {
+    TelemetryReporter* reporter = &telemetry_reporter;
+    if (reporter->base.vtable != NULL) {
+        return;
+    }
+
+    reporter->base.vtable = &telemetry_reporter_vtable;
+    reporter->base.is_completed = false;
+    reporter->base.waker = NULL;
+    async_frame_init(&reporter->frame);
+    reporter->executor = executor;
+    reporter->period_ticks = period_ticks;
+
+    executor_spawn_with(executor, &reporter->base, TASK_PRIORITY_LOW, TASK_NO_DEADLINE);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef EXECUTOR_TELEMETRY_H
+#define EXECUTOR_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Executor telemetry, built with `make TELEMETRY=1` (-DEXECUTOR_TELEMETRY).
+// Each task counts its polls, the polls that returned PENDING and the TSC
+// cycles spent inside poll. Each executor counts loop passes, cycles spent
+// halted and where its wake-ups came from. Without the flag the hooks
+// compile away and tasks keep their normal size.
+#define EXECUTOR_TELEMETRY_TOP_N 8
+
+struct Executor;
+struct Task;
+struct Future;
+
+#ifdef EXECUTOR_TELEMETRY
+
+typedef struct {
+    uint32_t polls;
+    uint32_t pending_polls;     // Polled without completing
+    uint64_t poll_cycles;
+    uint64_t max_poll_cycles;
+} TaskStats;
+
+typedef struct {
+    uint64_t start_tsc;
+    uint64_t idle_cycles;       // Halted in executor_run
+    uint32_t loop_iterations;
+    uint32_t idle_entries;
+    uint32_t tasks_completed;
+    // Wake-ups by where the waker ran. Interrupts off means an interrupt
+    // handler or timer expiry; on means another task or a yield.
+    atomic_uint_fast32_t wakes_irqs_off;
+    atomic_uint_fast32_t wakes_irqs_on;
+    atomic_uint_fast32_t wakes_coalesced;   // The task was already queued
+    atomic_uint_fast32_t kicks;             // executor_wake_up calls
+} ExecutorStats;
+
+void executor_telemetry_init(struct Executor* executor);
+
+void executor_telemetry_task_spawned(struct Executor* executor, struct Task* task);
+void executor_telemetry_task_completed(struct Executor* executor, struct Task* task);
+
+void executor_telemetry_polled(struct Task* task, uint64_t start, bool completed);
+void executor_telemetry_woken(struct Executor* executor, bool coalesced);
+void executor_telemetry_kicked(struct Executor* executor);
+void executor_telemetry_loop(struct Executor* executor);
+void executor_telemetry_idled(struct Executor* executor, uint64_t start);
+
+// Counters of a spawned future's task, valid until the future completes.
+const TaskStats* executor_task_stats(const struct Future* future);
+
+// Prints the executor counters and the `count` live tasks that have spent
+// the most cycles in poll. Tasks are named by their poll function; resolve
+// the addresses with addr2line -e bin/kernel.
+void executor_telemetry_dump(struct Executor* executor, uint32_t count);
+
+// Spawns a task on `executor` that dumps its telemetry every
+// `period_ticks`. There is one reporter.
+void executor_telemetry_start_reporter(struct Executor* executor, uint32_t period_ticks);
+
+#else
+
+static inline void executor_telemetry_dump(struct Executor* executor, uint32_t count) {
+    (void)executor;
+    (void)count;
+}
+
+static inline void executor_telemetry_start_reporter(struct Executor* executor, uint32_t period_ticks) {
+    (void)executor;
+    (void)period_ticks;
+}
+
+#endif
+
+#endif
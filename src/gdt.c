@@ -63,6 +63,10 @@ void gdt_init(void) {
     load_gdt_asm(&gdt_ptr);
 }
 
+void gdt_load(void) {
+    load_gdt_asm(&gdt_ptr);
+}
+
 void print_gdt_info(void) {
     GDTPointer current_gdt_ptr;
 
@@ -46,6 +46,10 @@ void create_descriptor(GDTEntry* entry, uint32_t base, uint32_t limit, uint8_t a
 
 void gdt_init(void);
 
+// Loads the table built by gdt_init on the calling CPU, for application
+// processors.
+void gdt_load(void);
+
 void print_gdt_info(void);
 
 #endif
\ No newline at end of file
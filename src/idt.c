@@ -3,6 +3,8 @@
 #include "terminal.h"
 #include "port_manager.h"
 #include "logger.h"
+#include "paging.h"
+#include "thread.h"
 #include <stdint.h>
 
 static IDTEntry idt[256];
@@ -29,7 +31,7 @@ extern void load_idt_asm(IDTPointer* idt_ptr);
 
 extern void handle_divide_by_zero(void);
 extern void handle_general_protection_fault(void);
-extern void handle_page_fault(void);
+extern void handle_page_fault(uint32_t error_code);
 
 void init_interrupt_registry(void) {
     if (!handlers_initialized) {
@@ -99,12 +101,19 @@ void idt_init(void) {
     output_string("IDT initialized and loaded successfully!\n");
 }
 
+void idt_load(void) {
+    load_idt_asm(&idt_ptr);
+}
+
 void generic_interrupt_handler_no_error_code(uint8_t vector) {
     if (handlers_initialized && vector < 256 && interrupt_handlers[vector] != NULL) {
         interrupt_handlers[vector]();
     }
 
     pic_send_eoi(vector);
+
+    // Only now may the interrupted thread be switched out: its EOI is sent
+    thread_interrupt_exit();
 }
 
 void generic_interrupt_handler_error_code(uint8_t vector) {
@@ -132,8 +141,31 @@ void handle_general_protection_fault(void) {
     __asm__ volatile ("cli; hlt");
 }
 
-void handle_page_fault(void) {
-    output_string("Page Fault occurred!\n");
+void handle_page_fault(uint32_t error_code) {
+    uint32_t address = read_cr2();
+
+    if (paging_handle_fault(address, error_code)) {
+        return;
+    }
+
+    output_string("Page Fault occurred at ");
+    put_hex(address);
+    output_string(": ");
+    output_string((error_code & PAGE_FAULT_PRESENT) ? "protection violation" : "page not present");
+    output_string((error_code & PAGE_FAULT_WRITE) ? " on write" : " on read");
+    if (error_code & PAGE_FAULT_FETCH) {
+        output_string(", instruction fetch");
+    }
+    if (error_code & PAGE_FAULT_USER) {
+        output_string(", user mode");
+    }
+    if (error_code & PAGE_FAULT_RESERVED) {
+        output_string(", reserved bit set");
+    }
+    output_string(" (error code ");
+    put_hex(error_code);
+    output_string(")\n");
+
     output_string("System halted due to page fault.\n");
     __asm__ volatile ("cli; hlt");
 }
@@ -26,6 +26,9 @@ typedef void (*interrupt_handler_t)(void);
 
 void create_idt_descriptor(IDTEntry* entry, uint32_t offset, uint16_t selector, uint8_t type_attr);
 void idt_init(void);
+// Loads the table built by idt_init on the calling CPU, for application
+// processors.
+void idt_load(void);
 void idt_set_handler(uint8_t vector, uint32_t handler_offset);
 void load_idt(IDTPointer* idt_ptr);
 
@@ -37,7 +40,7 @@ void pic_unmask_irq(uint8_t irq);
 
 void handle_divide_by_zero(void);
 void handle_general_protection_fault(void);
-void handle_page_fault(void);
+void handle_page_fault(uint32_t error_code);
 
 void print_idt_info(void);
 
@@ -78,9 +78,16 @@ int serial_is_transmit_empty() {
 }
 
 void write_serial(char c) {
-    while (serial_is_transmit_empty() == 0);
-    
+    // The serial interrupt handler refills the FIFO too, so check and write
+    // without letting it in between.
+    uint32_t flags = irq_save();
+    while (serial_is_transmit_empty() == 0) {
+        irq_restore(flags);
+        flags = irq_save();
+    }
+
     out_b(SERIAL_DATA_PORT(SERIAL_COM1), c);
+    irq_restore(flags);
 }
 
 void write_serial_string(const char* str) {
@@ -92,6 +99,30 @@ void write_serial_string(const char* str) {
     }
 }
 
+uint64_t read_tsc(void) {
+    uint32_t low, high;
+    __asm__ volatile ("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t)high << 32) | low;
+}
+
+void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    __asm__ volatile ("cpuid"
+                      : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                      : "a" (leaf), "c" (0));
+}
+
+uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        __asm__ volatile ("sti" : : : "memory");
+    }
+}
+
 void exit_qemu(uint8_t exit_code) {
     out_b(0x402, exit_code);
     out_b(0x80, exit_code);
@@ -15,6 +15,18 @@ int serial_is_transmit_empty();
 void write_serial(char c);
 void write_serial_string(const char* str);
 
+uint64_t read_tsc(void);
+
+void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx);
+
+// Disables interrupts and returns the previous EFLAGS, for short critical
+// sections shared with interrupt handlers. irq_restore re-enables interrupts
+// only if they were on before, so the pair nests.
+#define EFLAGS_IF 0x200
+
+uint32_t irq_save(void);
+void irq_restore(uint32_t flags);
+
 void exit_qemu(uint8_t exit_code);
 
 #endif
\ No newline at end of file
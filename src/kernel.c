@@ -4,6 +4,13 @@
 #include "libc.h"
 #include "multiboot.h"
 #include "memory.h"
+#include "page_allocator.h"
+#include "slab.h"
+#include "memory_profile.h"
+#include "arena.h"
+#include "paging.h"
+#include "dma.h"
+#include "pool.h"
 #include "io.h"
 #include "test.h"
 #include "port_manager.h"
@@ -12,6 +19,14 @@
 #include "idt.h"
 #include "logger.h"
 #include "async_executor.h"
+#include "timer.h"
+#include "coroutine.h"
+#include "clock.h"
+#include "pit.h"
+#include "serial.h"
+#include "executor_telemetry.h"
+#include "thread.h"
+#include "smp.h"
 
 static size_t my_strlen(const char* str) {
     size_t len = 0;
@@ -22,6 +37,7 @@ static size_t my_strlen(const char* str) {
 }
 
 void run_rtc_tests(void);  
+void run_async_tests(void);
 
 static volatile uint32_t rtc_interrupt_count = 0;
 
@@ -41,16 +57,32 @@ void rtc_interrupt_handler(void) {
 
     rtc_interrupt_count++;
 
-    wake_up_list_check_and_execute();
+    timer_wheel_advance(&system_timer_wheel, monotonic_time_get_ticks_global());
 
-    // Debug: Print every 256 ticks (1 second)
-    if (system_tick_count % 256 == 0) {
+    // Debug: Print every second
+    if (system_tick_count % RTC_PERIODIC_HZ == 0) {
         output_string(".");
     }
 
     pic_send_eoi(0x48);
 }
 
+// Spins for five seconds without yielding. The time slice still lets the
+// executor thread run its timers and serial output meanwhile.
+static void busy_thread_main(void* arg) {
+    (void)arg;
+    uint32_t start = get_system_ticks();
+    uint32_t spins = 0;
+
+    while (get_system_ticks() - start < 5 * CLOCK_TICK_HZ) {
+        spins++;
+    }
+
+    output_string("Busy thread finished after ");
+    put_u32(spins);
+    output_string(" spins\n");
+}
+
 static int custom_handler_called = 0;
 
 void custom_interrupt_handler(void) {
@@ -62,6 +94,7 @@ void custom_interrupt_handler(void) {
 
 void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
     init_output();
+    init_early_allocator();
 
     output_string("hi shogun from c - Test Mode\n");
 
@@ -109,8 +142,16 @@ void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
 
     output_string("Divide by zero test completed (skipped to prevent crash during normal execution)!\n");
 
+    output_string("Initializing page frame allocator...\n");
+    init_page_allocator(multiboot_info_ptr);
+    page_allocator_print_info();
+
+    output_string("Enabling paging...\n");
+    paging_init();
+    paging_print_info();
+
     output_string("Initializing memory allocator for tests...\n");
-    init_allocator(multiboot_info_ptr);
+    init_allocator();
 
     output_string("Initializing port manager...\n");
     init_port_manager();
@@ -118,32 +159,52 @@ void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
     // Initialize the async system components
     output_string("Initializing monotonic time...\n");
     monotonic_time_init_global();
-    output_string("Initializing wake-up list...\n");
-    wake_up_list_init();
+    output_string("Initializing timer wheel...\n");
+    timer_wheel_init(&system_timer_wheel, monotonic_time_get_ticks_global());
     output_string("Initializing async executor...\n");
     async_init();
+    output_string("Initializing kernel threads...\n");
+    thread_init();
 
     run_memory_tests();
+    run_memory_benchmarks();
+    memory_dump_stats();
 
     output_string("\nRunning RTC tests...\n");
     run_rtc_tests();
 
+    output_string("\nRunning async tests...\n");
+    run_async_tests();
+
 
     output_string("\nDynamic Interrupt Registration System Active!\n");
     output_string("RTC driver successfully registered for periodic interrupts using the new system.\n");
 
-    output_string("Setting up system-wide periodic RTC interrupts...\n");
-    system_rtc_instance = init_rtc();
-    if (system_rtc_instance != NULL) {
-        int rtc_result = enable_rtc_interrupts(system_rtc_instance, rtc_interrupt_handler);
-        if (rtc_result == 0) {
-            output_string("Periodic RTC interrupts enabled successfully for system clock!\n");
-            output_string("System tick counter will now increment with each RTC interrupt.\n");
+    if (clock_tickless()) {
+        output_string("Setting up tickless system clock on PIT channel 0...\n");
+        IrqId pit_irq;
+        pit_irq.type = IRQ_PIC1;
+        pit_irq.index = PIT_IRQ;
+        if (register_interrupt_handler_irq(pit_irq, clock_event_interrupt) == 0) {
+            pic_unmask_irq(PIT_IRQ);
+            output_string("Timer deadlines will be programmed one-shot when idle.\n");
         } else {
-            output_string("Failed to enable periodic RTC interrupts\n");
+            output_string("Failed to register PIT interrupt handler\n");
         }
     } else {
-        output_string("Failed to initialize RTC for system clock\n");
+        output_string("Setting up system-wide periodic RTC interrupts...\n");
+        system_rtc_instance = init_rtc();
+        if (system_rtc_instance != NULL) {
+            int rtc_result = enable_rtc_interrupts(system_rtc_instance, rtc_interrupt_handler);
+            if (rtc_result == 0) {
+                output_string("Periodic RTC interrupts enabled successfully for system clock!\n");
+                output_string("System tick counter will now increment with each RTC interrupt.\n");
+            } else {
+                output_string("Failed to enable periodic RTC interrupts\n");
+            }
+        } else {
+            output_string("Failed to initialize RTC for system clock\n");
+        }
     }
 
     output_string("Registering custom handler for interrupt 0x81...\n");
@@ -168,16 +229,11 @@ void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
         output_string("Failed to register custom handler\n");
     }
 
-    output_string("Registering async serial interrupt handler for IRQ 4...\n");
-    IrqId serial_irq;
-    serial_irq.type = IRQ_PIC1;  // Serial COM1 is typically IRQ 4
-    serial_irq.index = 4;
-    result = register_interrupt_handler_irq(serial_irq, async_serial_interrupt_handler);
-    if (result == 0) {
-        output_string("Successfully registered async serial interrupt handler!\n");
-        pic_unmask_irq(4);  
+    output_string("Registering serial interrupt handler for IRQ 4...\n");
+    if (serial_enable_interrupts() == 0) {
+        output_string("Successfully registered serial interrupt handler!\n");
     } else {
-        output_string("Failed to register async serial interrupt handler\n");
+        output_string("Failed to register serial interrupt handler\n");
     }
 
     logger_service();
@@ -189,7 +245,7 @@ void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
     put_u32(get_system_ticks());
     output_string("\n");
 
-    output_string("Sleeping for 2 seconds (512 ticks at 256Hz)...\n");
+    output_string("Sleeping for 2 seconds (2048 ticks at 1024Hz)...\n");
     uint32_t ticks_before_sleep = get_system_ticks();
     sleep_seconds(2);
     uint32_t ticks_after_sleep = get_system_ticks();
@@ -203,6 +259,10 @@ void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
     output_string("\n");
 
     output_string("Sleep functionality demonstrated successfully!\n");
+
+    output_string("\nStarting application processors...\n");
+    smp_init();
+    smp_scaling_benchmark(16, 256);
  
     output_string("\nDemonstrating async functionality...\n");
 
@@ -210,7 +270,7 @@ void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
 
     output_string("Creating a 3-second async sleep future...\n");
 
-    Future* sleep_future = sleep_future_create(768);
+    Future* sleep_future = sleep_future_create(3 * CLOCK_TICK_HZ);
     if (sleep_future != NULL) {
         output_string("Async sleep future created, spawning to executor...\n");
         executor_spawn(executor, sleep_future);
@@ -229,10 +289,21 @@ void kernel_main(uint32_t magic, uint32_t multiboot_info_ptr) {
 
     output_string("Both futures spawned to executor. They will execute concurrently.\n");
 
-    output_string("Starting async executor... (this will run indefinitely with concurrent tasks)\n");
-    executor_run(executor);
+    memory_profile_dump(MEMORY_PROFILE_TOP_N);
+    executor_telemetry_start_reporter(executor, 10 * CLOCK_TICK_HZ);
+
+    output_string("Starting a CPU-bound thread alongside the executor...\n");
+    if (thread_create("busy", busy_thread_main, NULL) == NULL) {
+        output_string("Failed to create the busy thread\n");
+    }
+
+    output_string("Starting async executor thread... (this will run indefinitely with concurrent tasks)\n");
+    if (thread_create("executor", executor_thread_main, executor) == NULL) {
+        executor_run(executor);
+    }
 
-    exit_after_all_tests(0);
+    // The executor thread takes over; the boot stack is never freed
+    thread_exit();
 }
 
 void test_divide_by_zero_safely(void) {
@@ -299,6 +370,449 @@ TEST(memory_multiple_alloc_free) {
     }
 }
 
+TEST(memory_size_class_reuse) {
+    char* first = (char*)malloc(40);
+    ASSERT(first != NULL, "Small allocation should succeed");
+    free(first);
+
+    char* second = (char*)malloc(44);
+    ASSERT(second == first, "Freed small segment should be reused by the same size class");
+    free(second);
+}
+
+TEST(memory_large_alloc) {
+    uint8_t* buffer = (uint8_t*)malloc(64 * 1024);
+    ASSERT(buffer != NULL, "Large allocation should succeed");
+
+    if (buffer != NULL) {
+        buffer[0] = 0x5A;
+        buffer[64 * 1024 - 1] = 0xA5;
+        ASSERT_EQUAL(0x5A, buffer[0], "Start of large buffer should hold value");
+        ASSERT_EQUAL(0xA5, buffer[64 * 1024 - 1], "End of large buffer should hold value");
+        free(buffer);
+    }
+}
+
+TEST(memory_aligned_alloc) {
+    void* ptr = allocate(100, 256);
+    ASSERT(ptr != NULL, "Aligned allocation should succeed");
+    ASSERT(((uint32_t)ptr & 255) == 0, "Aligned allocation should respect alignment");
+    free(ptr);
+}
+
+TEST(slab_alloc_free_reuse) {
+    KmemCache* cache = kmem_cache_create("test_object", 24, 8);
+    ASSERT(cache != NULL, "Cache creation should succeed");
+
+    if (cache != NULL) {
+        void* first = kmem_cache_alloc(cache);
+        ASSERT(first != NULL, "Cache allocation should succeed");
+        ASSERT(((uint32_t)first & 7) == 0, "Cache objects should respect alignment");
+
+        kmem_cache_free(cache, first);
+        void* second = kmem_cache_alloc(cache);
+        ASSERT(second == first, "Freed object should be reused first");
+
+        kmem_cache_free(cache, second);
+        kmem_cache_destroy(cache);
+    }
+}
+
+TEST(slab_grows_across_slabs) {
+    KmemCache* cache = kmem_cache_create("test_grow", 64, 8);
+    ASSERT(cache != NULL, "Cache creation should succeed");
+
+    if (cache != NULL) {
+        uint32_t count = cache->objects_per_slab * 3;
+        void* objects[200];
+        if (count > 200) {
+            count = 200;
+        }
+
+        bool all_allocated = true;
+        for (uint32_t i = 0; i < count; i++) {
+            objects[i] = kmem_cache_alloc(cache);
+            if (objects[i] == NULL) {
+                all_allocated = false;
+            }
+        }
+        ASSERT(all_allocated, "Cache should grow past a single slab");
+        ASSERT(cache->slab_count >= 3, "Cache should hold at least three slabs");
+
+        for (uint32_t i = 0; i < count; i++) {
+            kmem_cache_free(cache, objects[i]);
+        }
+        ASSERT_EQUAL(1, cache->slab_count, "Only one empty slab should be retained");
+
+        kmem_cache_destroy(cache);
+    }
+}
+
+TEST(page_alloc_alignment) {
+    void* block = alloc_pages(4);
+    ASSERT(block != NULL, "Order-4 page allocation should succeed");
+    ASSERT(((uint32_t)block & ((PAGE_SIZE << 4) - 1)) == 0, "Buddy blocks should be naturally aligned");
+    free_pages(block, 4);
+}
+
+TEST(page_alloc_buddy_merge) {
+    uint32_t free_before = page_allocator_free_count();
+
+    void* first = alloc_pages(0);
+    void* second = alloc_pages(0);
+    ASSERT(first != NULL && second != NULL, "Single page allocations should succeed");
+    ASSERT_EQUAL(free_before - 2, page_allocator_free_count(), "Two pages should be accounted as used");
+
+    free_pages(first, 0);
+    free_pages(second, 0);
+    ASSERT_EQUAL(free_before, page_allocator_free_count(), "Freed pages should be returned");
+
+    void* pair = alloc_pages(1);
+    ASSERT(pair != NULL, "Freed buddies should merge back into larger blocks");
+    free_pages(pair, 1);
+}
+
+TEST(arena_bump_alignment) {
+    Arena arena;
+    arena_init(&arena, PAGE_SIZE);
+
+    uint8_t* first = (uint8_t*)arena_alloc(&arena, 3, 8);
+    uint8_t* second = (uint8_t*)arena_alloc(&arena, 16, 16);
+    ASSERT(first != NULL && second != NULL, "Arena allocations should succeed");
+    ASSERT(((uint32_t)second & 15) == 0, "Arena allocation should respect alignment");
+    ASSERT(second > first && second - first <= 16, "Arena allocations should be bumped contiguously");
+
+    arena_destroy(&arena);
+}
+
+TEST(arena_scope_rewind) {
+    Arena arena;
+    arena_init(&arena, PAGE_SIZE);
+
+    void* before = arena_alloc(&arena, 32, 8);
+    ArenaScope scope = arena_scope_begin(&arena);
+
+    // Spill over several chunks inside the scope
+    for (int i = 0; i < 8; i++) {
+        arena_alloc(&arena, PAGE_SIZE / 2, 8);
+    }
+    void* large = arena_alloc(&arena, 3 * PAGE_SIZE, 8);
+    ASSERT(large != NULL, "Arena should serve requests larger than a chunk");
+
+    uint32_t free_inside = page_allocator_free_count();
+    arena_scope_end(&arena, scope);
+    ASSERT(page_allocator_free_count() > free_inside, "Ending a scope should release its chunks");
+
+    void* after = arena_alloc(&arena, 32, 8);
+    ASSERT(after == (uint8_t*)before + 32, "Ending a scope should rewind the cursor");
+
+    arena_destroy(&arena);
+}
+
+TEST(test_scratch_alloc) {
+    char* scratch = (char*)test_alloc(128);
+    ASSERT(scratch != NULL, "Test scratch allocation should succeed");
+    if (scratch != NULL) {
+        scratch[127] = 'Z';
+        ASSERT_EQUAL('Z', scratch[127], "Test scratch memory should be writable");
+    }
+}
+
+TEST(memory_stats_track_usage) {
+    MemoryStats before;
+    MemoryStats during;
+    MemoryStats after;
+
+    memory_get_stats(&before);
+    void* ptr = malloc(100);
+    memory_get_stats(&during);
+    free(ptr);
+    memory_get_stats(&after);
+
+    ASSERT_EQUAL(before.allocations + 1, during.allocations, "Allocation should be counted");
+    ASSERT(during.live_bytes >= before.live_bytes + 100, "Live bytes should grow by at least the request");
+    ASSERT(during.peak_live_bytes >= during.live_bytes, "Peak should never trail live bytes");
+    ASSERT_EQUAL(before.size_histogram[3] + 1, during.size_histogram[3], "100-byte request should land in the 64-127 bucket");
+    ASSERT_EQUAL(before.frees + 1, after.frees, "Free should be counted");
+    ASSERT_EQUAL(before.live_bytes, after.live_bytes, "Live bytes should return after free");
+    ASSERT(after.largest_free_block <= after.free_bytes, "Largest free block should not exceed free bytes");
+}
+
+TEST(memory_realloc_in_place) {
+    char* ptr = (char*)malloc(512);
+    ASSERT(ptr != NULL, "Allocation should succeed");
+    for (int i = 0; i < 32; i++) {
+        ptr[i] = (char)i;
+    }
+
+    char* shrunk = (char*)realloc(ptr, 32);
+    ASSERT(shrunk == ptr, "Shrinking should not move the block");
+
+    // The tail released by the shrink is now a free neighbour to grow into.
+    char* grown = (char*)realloc(shrunk, 256);
+    ASSERT(grown == ptr, "Growing into a free neighbour should not move the block");
+    for (int i = 0; i < 32; i++) {
+        ASSERT_EQUAL((char)i, grown[i], "Contents should survive resizing in place");
+    }
+
+    free(grown);
+}
+
+TEST(memory_realloc_moves_when_blocked) {
+    char* ptr = (char*)malloc(32);
+    void* blocker = malloc(32);
+    ASSERT(ptr != NULL && blocker != NULL, "Allocations should succeed");
+    for (int i = 0; i < 32; i++) {
+        ptr[i] = (char)(i + 1);
+    }
+
+    char* moved = (char*)realloc(ptr, 512);
+    ASSERT(moved != NULL, "Reallocation should succeed");
+    ASSERT(moved != ptr, "A used neighbour should force a move");
+    for (int i = 0; i < 32; i++) {
+        ASSERT_EQUAL((char)(i + 1), moved[i], "Contents should be copied on move");
+    }
+
+    free(moved);
+    free(blocker);
+}
+
+TEST(memory_calloc_zeroes_reused_memory) {
+    uint8_t* dirty = (uint8_t*)malloc(200);
+    ASSERT(dirty != NULL, "Allocation should succeed");
+    memset(dirty, 0xAB, 200);
+    free(dirty);
+
+    uint8_t* zeroed = (uint8_t*)calloc(50, 4);
+    ASSERT(zeroed != NULL, "calloc should succeed");
+    bool all_zero = true;
+    for (int i = 0; i < 200; i++) {
+        if (zeroed[i] != 0) {
+            all_zero = false;
+        }
+    }
+    ASSERT(all_zero, "calloc should return zeroed memory");
+    free(zeroed);
+
+    ASSERT(calloc((size_t)-1, 16) == NULL, "Overflowing calloc should fail");
+}
+
+#define GROWTH_TEST_BLOCKS 128
+#define GROWTH_TEST_BLOCK_SIZE (3 * 1024 * 1024)
+
+TEST(memory_grows_new_region) {
+    static void* blocks[GROWTH_TEST_BLOCKS];
+    MemoryStats before;
+    MemoryStats after;
+    uint32_t count = 0;
+
+    // Fill the existing regions (only the tags get touched, so a demand-paged
+    // heap commits almost nothing) until the heap has to add a region.
+    memory_get_stats(&before);
+    after = before;
+    while (count < GROWTH_TEST_BLOCKS && after.regions == before.regions) {
+        blocks[count] = malloc(GROWTH_TEST_BLOCK_SIZE);
+        if (blocks[count] == NULL) {
+            break;
+        }
+        count++;
+        memory_get_stats(&after);
+    }
+
+    ASSERT(after.regions > before.regions, "The heap should have taken another region");
+    ASSERT(after.heap_bytes > before.heap_bytes, "Heap size should grow with the new region");
+
+    if (count > 0) {
+        uint8_t* bytes = (uint8_t*)blocks[count - 1];
+        bytes[0] = 1;
+        bytes[GROWTH_TEST_BLOCK_SIZE - 1] = 2;
+        ASSERT_EQUAL(2, bytes[GROWTH_TEST_BLOCK_SIZE - 1], "New region memory should be usable end to end");
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        free(blocks[i]);
+    }
+}
+
+TEST(memory_demand_paged_heap) {
+    MemoryStats before;
+    MemoryStats touched;
+    MemoryStats after;
+    size_t size = 1024 * 1024;
+
+    ASSERT(paging_enabled(), "Paging should be enabled");
+
+    memory_get_stats(&before);
+    uint8_t* block = (uint8_t*)malloc(size);
+    ASSERT(block != NULL, "Allocation should succeed");
+    if (block == NULL) {
+        return;
+    }
+    ASSERT((uintptr_t)block >= HEAP_VIRTUAL_BASE, "Large blocks should come from the demand-paged range");
+
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        block[offset] = 0x5A;
+    }
+    memory_get_stats(&touched);
+    ASSERT(touched.committed_bytes >= before.committed_bytes + size / 2, "Touching pages should commit frames");
+
+    free(block);
+    memory_get_stats(&after);
+    ASSERT(after.committed_bytes + size / 2 <= touched.committed_bytes, "A large free should return its pages");
+}
+
+TEST(dma_alloc_alignment) {
+    DmaBuffer buffer;
+
+    ASSERT_EQUAL(0, dma_alloc(&buffer, 6000, 64 * 1024, 0), "DMA allocation should succeed");
+    ASSERT_EQUAL(0, buffer.phys & (64 * 1024 - 1), "Buffer should honour the requested alignment");
+    ASSERT(buffer.size >= 64 * 1024, "Buffer should cover the aligned block");
+    ASSERT_EQUAL((uint32_t)(uintptr_t)buffer.virt, buffer.phys, "DMA memory should be identity mapped");
+
+    uint32_t phys = 0;
+    uint32_t flags = 0;
+    ASSERT(paging_query(buffer.phys + buffer.size - PAGE_SIZE, &phys, &flags), "The whole buffer should be mapped");
+    ASSERT_EQUAL(buffer.phys + buffer.size - PAGE_SIZE, phys, "The buffer should be physically contiguous");
+
+    dma_free(&buffer);
+    ASSERT(buffer.virt == NULL, "Freeing should clear the buffer");
+}
+
+TEST(dma_alloc_below_16m) {
+    DmaBuffer buffer;
+    uint32_t free_before = page_allocator_zone_free_count(PAGE_ZONE_DMA);
+
+    ASSERT_EQUAL(0, dma_alloc(&buffer, 8192, 0, DMA_BELOW_16M), "Low DMA allocation should succeed");
+    ASSERT(buffer.phys + buffer.size <= PAGE_DMA_ZONE_END, "Buffer should sit below 16 MiB");
+    ASSERT_EQUAL(free_before - 2, page_allocator_zone_free_count(PAGE_ZONE_DMA), "Buffer should come from the DMA zone");
+
+    dma_free(&buffer);
+    ASSERT_EQUAL(free_before, page_allocator_zone_free_count(PAGE_ZONE_DMA), "Freeing should return the frames to the DMA zone");
+}
+
+#ifdef MEMORY_PROFILE
+static void* __attribute__((noinline)) profile_probe_alloc(void) {
+    return malloc(40);
+}
+
+static void profile_probe_end(void) {
+}
+
+TEST(memory_profile_tracks_call_site) {
+    void* blocks[3];
+    for (int i = 0; i < 3; i++) {
+        blocks[i] = profile_probe_alloc();
+    }
+    for (int i = 0; i < 3; i++) {
+        free(blocks[i]);
+    }
+
+    // The probe's malloc call lies between the two functions.
+    MemoryProfileSite site;
+    bool found = memory_profile_find_site((uintptr_t)profile_probe_alloc, (uintptr_t)profile_probe_end, &site);
+    ASSERT(found, "The probe's call site should be recorded");
+    ASSERT(site.allocations >= 3, "Every allocation should be counted against its site");
+    ASSERT(site.frees >= 3, "Frees should be attributed to the allocating site");
+    ASSERT(site.bytes >= 3 * 40, "Requested bytes should be summed per site");
+}
+#endif
+
+TEST(pool_alloc_free_reuse) {
+    static uint32_t storage[8][4];
+    Pool pool;
+    pool_init(&pool, storage, sizeof(storage[0]), 8);
+
+    void* first = pool_alloc(&pool);
+    ASSERT(first == storage[0], "A fresh pool should hand out blocks in order");
+    ASSERT(pool_owns(&pool, first), "Pool should recognise its own blocks");
+    ASSERT(!pool_owns(&pool, (uint8_t*)first + 4), "Interior pointers are not blocks");
+    ASSERT_EQUAL(7, pool_free_count(&pool), "Allocation should take one block");
+
+    pool_free(&pool, first);
+    ASSERT_EQUAL(8, pool_free_count(&pool), "Free should return the block");
+    ASSERT(pool_alloc(&pool) == first, "The last freed block should be reused first");
+}
+
+TEST(pool_exhaustion) {
+    static uint32_t storage[4][2];
+    Pool pool;
+    pool_init(&pool, storage, sizeof(storage[0]), 4);
+
+    void* blocks[4];
+    for (int i = 0; i < 4; i++) {
+        blocks[i] = pool_alloc(&pool);
+        ASSERT(blocks[i] != NULL, "Pool should hand out every block");
+    }
+    ASSERT(pool_alloc(&pool) == NULL, "An empty pool should fail instead of growing");
+
+    for (int i = 0; i < 4; i++) {
+        pool_free(&pool, blocks[i]);
+    }
+    ASSERT_EQUAL(4, pool_free_count(&pool), "Every block should be back on the free list");
+}
+
+TEST(paging_identity_map) {
+    uint32_t phys = 0;
+    uint32_t flags = 0;
+    uint32_t addr = (uint32_t)(uintptr_t)&phys;
+
+    ASSERT(paging_enabled(), "Paging should be enabled");
+    ASSERT(paging_query(addr, &phys, &flags), "Kernel stack should be mapped");
+    ASSERT_EQUAL(addr, phys, "Kernel memory should be identity mapped");
+    ASSERT(flags & PTE_WRITABLE, "Kernel memory should be writable");
+}
+
+TEST(paging_map_unmap) {
+    uint32_t virt = 0xE0000000;
+    uint32_t phys = 0;
+    uint32_t flags = 0;
+
+    ASSERT(!paging_query(virt, &phys, &flags), "Test address should start unmapped");
+
+    uint32_t* frame = (uint32_t*)alloc_pages(0);
+    ASSERT(frame != NULL, "Frame allocation should succeed");
+    if (frame == NULL) {
+        return;
+    }
+
+    ASSERT_EQUAL(0, paging_map(virt, (uint32_t)(uintptr_t)frame, PAGE_SIZE, PAGING_KERNEL_FLAGS), "Mapping should succeed");
+    ASSERT(paging_query(virt, &phys, &flags), "Mapped address should translate");
+    ASSERT_EQUAL((uint32_t)(uintptr_t)frame, phys, "Mapping should point at the frame");
+
+    *(volatile uint32_t*)(uintptr_t)virt = 0xC0FFEE;
+    ASSERT_EQUAL(0xC0FFEE, frame[0], "Writes through the mapping should reach the frame");
+
+    paging_unmap(virt, PAGE_SIZE);
+    ASSERT(!paging_query(virt, &phys, &flags), "Unmapped address should not translate");
+
+    free_pages(frame, 0);
+}
+
+TEST(paging_protect_splits_large_page) {
+    void* page = alloc_pages(0);
+    ASSERT(page != NULL, "Frame allocation should succeed");
+    if (page == NULL) {
+        return;
+    }
+
+    uint32_t addr = (uint32_t)(uintptr_t)page;
+    uint32_t phys = 0;
+    uint32_t flags = 0;
+
+    ASSERT_EQUAL(0, paging_protect(addr, PAGE_SIZE, PTE_PRESENT), "Protecting a page should succeed");
+    ASSERT(paging_query(addr, &phys, &flags), "Protected page should stay mapped");
+    ASSERT(!(flags & PTE_WRITABLE), "Protected page should be read-only");
+    ASSERT_EQUAL(addr, phys, "Protected page should keep its identity mapping");
+
+    ASSERT(paging_query(addr + PAGE_SIZE, &phys, &flags), "Neighbouring page should stay mapped");
+    ASSERT(flags & PTE_WRITABLE, "Neighbouring page should stay writable");
+
+    paging_protect(addr, PAGE_SIZE, PAGING_KERNEL_FLAGS);
+    ASSERT(paging_query(addr, &phys, &flags) && (flags & PTE_WRITABLE), "Page should be writable again");
+
+    free_pages(page, 0);
+}
+
 TEST(rtc_basic_init) {
     output_string("Attempting to initialize RTC...\n");
     RTCDriver* rtc = init_rtc();
@@ -340,9 +854,7 @@ TEST(rtc_basic_init) {
             output_string("Warning: Invalid time data returned, skipping write test\n");
         }
 
-        release_port(rtc->control_port);
-        release_port(rtc->data_port);
-        free(rtc);
+        release_rtc(rtc);
         output_string("RTC cleanup completed\n");
     } else {
         output_string("RTC initialization failed\n");
@@ -368,9 +880,7 @@ TEST(rtc_interrupt_registration) {
             ASSERT(false, "RTC interrupt registration should succeed");
         }
         
-        release_port(rtc->control_port);
-        release_port(rtc->data_port);
-        free(rtc);
+        release_rtc(rtc);
     } else {
         ASSERT(false, "RTC initialization failed for interrupt test");
     }
@@ -381,12 +891,185 @@ void run_memory_tests() {
         TEST_ENTRY(memory_alloc_basic),
         TEST_ENTRY(memory_alloc_zero),
         TEST_ENTRY(memory_alloc_and_free),
-        TEST_ENTRY(memory_multiple_alloc_free)
+        TEST_ENTRY(memory_multiple_alloc_free),
+        TEST_ENTRY(memory_size_class_reuse),
+        TEST_ENTRY(memory_large_alloc),
+        TEST_ENTRY(memory_aligned_alloc),
+        TEST_ENTRY(slab_alloc_free_reuse),
+        TEST_ENTRY(slab_grows_across_slabs),
+        TEST_ENTRY(page_alloc_alignment),
+        TEST_ENTRY(page_alloc_buddy_merge),
+        TEST_ENTRY(arena_bump_alignment),
+        TEST_ENTRY(arena_scope_rewind),
+        TEST_ENTRY(test_scratch_alloc),
+        TEST_ENTRY(memory_stats_track_usage),
+        TEST_ENTRY(memory_realloc_in_place),
+        TEST_ENTRY(memory_realloc_moves_when_blocked),
+        TEST_ENTRY(memory_calloc_zeroes_reused_memory),
+        TEST_ENTRY(memory_grows_new_region),
+        TEST_ENTRY(memory_demand_paged_heap),
+        TEST_ENTRY(dma_alloc_alignment),
+        TEST_ENTRY(dma_alloc_below_16m),
+#ifdef MEMORY_PROFILE
+        TEST_ENTRY(memory_profile_tracks_call_site),
+#endif
+        TEST_ENTRY(pool_alloc_free_reuse),
+        TEST_ENTRY(pool_exhaustion),
+        TEST_ENTRY(paging_identity_map),
+        TEST_ENTRY(paging_map_unmap),
+        TEST_ENTRY(paging_protect_splits_large_page)
     };
     
     run_tests(memory_tests, sizeof(memory_tests) / sizeof(memory_tests[0]));
 }
 
+#define BENCH_SLOTS 256
+#define BENCH_CHURN_OPS 20000
+
+static uint32_t bench_random(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+// The kernel is linked without libgcc, so avoid 64-bit division.
+static uint32_t cycles_per_op(uint64_t cycles, uint32_t ops) {
+    while ((cycles >> 32) != 0 && ops > 1) {
+        cycles >>= 1;
+        ops >>= 1;
+    }
+    return (uint32_t)cycles / ops;
+}
+
+// Allocation churn: random malloc/free over a fixed set of slots with mostly
+// small sizes and an occasional large buffer.
+static void benchmark_allocation_churn(void) {
+    static void* slots[BENCH_SLOTS];
+    uint32_t seed = 42;
+
+    for (int i = 0; i < BENCH_SLOTS; i++) {
+        slots[i] = NULL;
+    }
+
+    uint64_t start = read_tsc();
+
+    for (int op = 0; op < BENCH_CHURN_OPS; op++) {
+        uint32_t slot = bench_random(&seed) % BENCH_SLOTS;
+        if (slots[slot] != NULL) {
+            free(slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            uint32_t roll = bench_random(&seed);
+            size_t size = (roll % 16 == 0) ? 512 + roll % 4096 : 8 + roll % 248;
+            slots[slot] = malloc(size);
+        }
+    }
+
+    uint64_t cycles = read_tsc() - start;
+
+    for (int i = 0; i < BENCH_SLOTS; i++) {
+        free(slots[i]);
+    }
+
+    output_string("Allocation churn: ");
+    put_u32(BENCH_CHURN_OPS);
+    output_string(" ops, ");
+    put_u32(cycles_per_op(cycles, BENCH_CHURN_OPS));
+    output_string(" cycles/op\n");
+}
+
+#define BENCH_MAX_LIVE 2000
+#define BENCH_FREE_OPS 4000
+
+// Keeps `live` objects allocated and replaces a random one at a time, timing
+// only the free calls, so the cost can be compared across heap occupancy.
+static void benchmark_free_path(uint32_t live) {
+    static void* objects[BENCH_MAX_LIVE];
+    uint32_t seed = 7;
+    uint64_t free_cycles = 0;
+
+    for (uint32_t i = 0; i < live; i++) {
+        objects[i] = malloc(16 + bench_random(&seed) % 1008);
+    }
+
+    for (uint32_t op = 0; op < BENCH_FREE_OPS; op++) {
+        uint32_t victim = bench_random(&seed) % live;
+
+        uint64_t start = read_tsc();
+        free(objects[victim]);
+        free_cycles += read_tsc() - start;
+
+        objects[victim] = malloc(16 + bench_random(&seed) % 1008);
+    }
+
+    for (uint32_t i = 0; i < live; i++) {
+        free(objects[i]);
+    }
+
+    output_string("Free path with ");
+    put_u32(live);
+    output_string(" live objects: ");
+    put_u32(cycles_per_op(free_cycles, BENCH_FREE_OPS));
+    output_string(" cycles/free\n");
+}
+
+#define BENCH_GROW_BUFFERS 8
+#define BENCH_GROW_STEP 64
+#define BENCH_GROW_LIMIT 8192
+
+// Grows several interleaved buffers a step at a time, the way a log or task
+// list would, once with realloc and once with allocate-copy-free.
+static void benchmark_growth(bool use_realloc) {
+    static uint8_t* buffers[BENCH_GROW_BUFFERS];
+    uint32_t steps = 0;
+
+    for (int i = 0; i < BENCH_GROW_BUFFERS; i++) {
+        buffers[i] = NULL;
+    }
+
+    uint64_t start = read_tsc();
+    for (size_t size = BENCH_GROW_STEP; size <= BENCH_GROW_LIMIT; size += BENCH_GROW_STEP) {
+        for (int i = 0; i < BENCH_GROW_BUFFERS; i++) {
+            uint8_t* grown;
+            if (use_realloc) {
+                grown = (uint8_t*)realloc(buffers[i], size);
+            } else {
+                grown = (uint8_t*)malloc(size);
+                if (grown != NULL && buffers[i] != NULL) {
+                    memcpy(grown, buffers[i], size - BENCH_GROW_STEP);
+                    free(buffers[i]);
+                }
+            }
+            if (grown == NULL) {
+                continue;
+            }
+            grown[size - 1] = (uint8_t)size;
+            buffers[i] = grown;
+            steps++;
+        }
+    }
+    uint64_t cycles = read_tsc() - start;
+
+    for (int i = 0; i < BENCH_GROW_BUFFERS; i++) {
+        free(buffers[i]);
+    }
+
+    output_string(use_realloc ? "Buffer growth (realloc): " : "Buffer growth (malloc+copy): ");
+    put_u32(steps);
+    output_string(" steps, ");
+    put_u32(cycles_per_op(cycles, steps));
+    output_string(" cycles/step\n");
+}
+
+void run_memory_benchmarks() {
+    output_string("\nRunning memory benchmarks...\n");
+    benchmark_allocation_churn();
+    benchmark_free_path(500);
+    benchmark_free_path(1000);
+    benchmark_free_path(BENCH_MAX_LIVE);
+    benchmark_growth(false);
+    benchmark_growth(true);
+}
+
 void run_rtc_tests() {
     test_entry_t rtc_tests[] = {
         TEST_ENTRY(rtc_basic_init),
@@ -394,4 +1077,615 @@ void run_rtc_tests() {
     };
     
     run_tests(rtc_tests, sizeof(rtc_tests) / sizeof(rtc_tests[0]));
-}
\ No newline at end of file
+}
+
+typedef struct {
+    Future base;
+    uint32_t polls;
+    uint32_t cleanups;
+    bool finish;
+} CountingFuture;
+
+static FutureState counting_future_poll(Future* future, void* context) {
+    CountingFuture* counting = (CountingFuture*)future;
+    (void)context;
+    counting->polls++;
+    return counting->finish ? FUTURE_READY : FUTURE_PENDING;
+}
+
+static void counting_future_cleanup(Future* future) {
+    ((CountingFuture*)future)->cleanups++;
+}
+
+// Test futures live on the stack.
+static void counting_future_drop(Future* future) {
+    (void)future;
+}
+
+static const FutureVTable counting_future_vtable = {
+    .poll = counting_future_poll,
+    .cleanup = counting_future_cleanup,
+    .drop = counting_future_drop
+};
+
+TEST(executor_polls_only_woken_tasks) {
+    Executor executor;
+    CountingFuture futures[3];
+    executor_init(&executor);
+
+    for (int i = 0; i < 3; i++) {
+        futures[i] = (CountingFuture){ .base = { .vtable = &counting_future_vtable } };
+        executor_spawn(&executor, &futures[i].base);
+    }
+
+    ASSERT_EQUAL(3, executor_poll_ready(&executor), "Spawned tasks should be polled once");
+    ASSERT_EQUAL(0, executor_poll_ready(&executor), "Tasks nobody woke should not be polled");
+
+    waker_wake(futures[1].base.waker);
+    waker_wake(futures[1].base.waker);
+    ASSERT_EQUAL(1, executor_poll_ready(&executor), "Only the woken task should be polled");
+    ASSERT_EQUAL(2, futures[1].polls, "Repeated wake-ups should queue the task once");
+    ASSERT_EQUAL(1, futures[0].polls, "Other tasks should stay untouched");
+
+    for (int i = 0; i < 3; i++) {
+        futures[i].finish = true;
+        waker_wake(futures[i].base.waker);
+    }
+    ASSERT_EQUAL(3, executor_poll_ready(&executor), "Woken tasks should run to completion");
+    ASSERT_EQUAL(0, executor.task_count, "Completed tasks should leave the executor");
+    ASSERT(atomic_load(&executor.released) == NULL, "Released tasks should be freed");
+}
+
+typedef struct {
+    Future base;
+    uint32_t id;
+    uint32_t* order;
+    uint32_t* polled;
+} OrderedFuture;
+
+static FutureState ordered_future_poll(Future* future, void* context) {
+    OrderedFuture* ordered = (OrderedFuture*)future;
+    (void)context;
+    ordered->order[(*ordered->polled)++] = ordered->id;
+    return FUTURE_READY;
+}
+
+static const FutureVTable ordered_future_vtable = {
+    .poll = ordered_future_poll,
+    .drop = counting_future_drop
+};
+
+TEST(executor_orders_by_priority_and_deadline) {
+    Executor executor;
+    OrderedFuture futures[5];
+    uint32_t order[5];
+    uint32_t polled = 0;
+    TaskPriority priorities[5] = {
+        TASK_PRIORITY_LOW, TASK_PRIORITY_NORMAL, TASK_PRIORITY_HIGH, TASK_PRIORITY_HIGH, TASK_PRIORITY_HIGH
+    };
+    uint32_t deadlines[5] = { 10, TASK_NO_DEADLINE, TASK_NO_DEADLINE, 200, 100 };
+    executor_init(&executor);
+
+    for (uint32_t i = 0; i < 5; i++) {
+        futures[i] = (OrderedFuture){
+            .base = { .vtable = &ordered_future_vtable }, .id = i, .order = order, .polled = &polled
+        };
+        executor_spawn_with(&executor, &futures[i].base, priorities[i], deadlines[i]);
+    }
+
+    ASSERT_EQUAL(5, executor_poll_ready(&executor), "Every class should be polled within its budget");
+    ASSERT_EQUAL(4, order[0], "The earliest deadline in the highest class should come first");
+    ASSERT_EQUAL(3, order[1], "Later deadlines should follow in order");
+    ASSERT_EQUAL(2, order[2], "Tasks without a deadline should come after those with one");
+    ASSERT_EQUAL(1, order[3], "Normal tasks should follow high ones");
+    ASSERT_EQUAL(0, order[4], "A deadline should not lift a task out of its class");
+}
+
+TEST(executor_budget_prevents_starvation) {
+    Executor executor;
+    CountingFuture urgent[5];
+    CountingFuture background = { .base = { .vtable = &counting_future_vtable } };
+    executor_init(&executor);
+    executor_set_budget(&executor, TASK_PRIORITY_HIGH, 2);
+
+    for (int i = 0; i < 5; i++) {
+        urgent[i] = (CountingFuture){ .base = { .vtable = &counting_future_vtable } };
+        executor_spawn_with(&executor, &urgent[i].base, TASK_PRIORITY_HIGH, TASK_NO_DEADLINE);
+    }
+    executor_spawn_with(&executor, &background.base, TASK_PRIORITY_LOW, TASK_NO_DEADLINE);
+
+    ASSERT_EQUAL(3, executor_poll_ready(&executor), "A class should stop at its budget");
+    ASSERT_EQUAL(1, background.polls, "A low-priority task should still get its turn");
+    ASSERT_EQUAL(0, urgent[2].polls, "Tasks past the budget should wait");
+    ASSERT(executor_has_ready(&executor), "Tasks past the budget should stay ready");
+
+    waker_wake(urgent[2].base.waker);
+    ASSERT_EQUAL(2, executor_poll_ready(&executor), "Leftover tasks should run on the next pass");
+    ASSERT_EQUAL(1, urgent[2].polls, "Waking a leftover task should not queue it twice");
+    ASSERT_EQUAL(1, executor_poll_ready(&executor), "The last leftover should run after that");
+    ASSERT(!executor_has_ready(&executor), "Nothing should be left to poll");
+
+    for (int i = 0; i < 5; i++) {
+        urgent[i].finish = true;
+        waker_wake(urgent[i].base.waker);
+    }
+    background.finish = true;
+    waker_wake(background.base.waker);
+    while (executor_poll_ready(&executor) != 0) {
+    }
+    ASSERT_EQUAL(0, executor.task_count, "Completed tasks should leave the executor");
+}
+
+#ifndef EXECUTOR_TELEMETRY
+TEST(executor_steal_takes_back_half) {
+    Executor victim;
+    Executor thief;
+    CountingFuture futures[5];
+    executor_init(&victim);
+    executor_init(&thief);
+    executor_set_budget(&victim, TASK_PRIORITY_NORMAL, 1);
+
+    for (int i = 0; i < 5; i++) {
+        futures[i] = (CountingFuture){ .base = { .vtable = &counting_future_vtable } };
+        executor_spawn(&victim, &futures[i].base);
+    }
+    ASSERT_EQUAL(1, executor_poll_ready(&victim), "The victim should stop at its budget");
+
+    ASSERT_EQUAL(2, executor_steal(&thief, &victim), "Half of the waiting tasks should move");
+    ASSERT_EQUAL(3, victim.task_count, "The victim should keep the rest");
+    ASSERT_EQUAL(2, thief.task_count, "The thief should own what it took");
+    ASSERT_EQUAL(2, executor_poll_ready(&thief), "The thief should poll the stolen tasks");
+    ASSERT_EQUAL(1, futures[4].polls, "The tasks due last should be the ones taken");
+    ASSERT_EQUAL(0, futures[1].polls, "The tasks due first should stay");
+
+    waker_wake(futures[4].base.waker);
+    ASSERT(executor_has_ready(&thief), "A stolen task should be woken on its new executor");
+
+    for (int i = 0; i < 5; i++) {
+        futures[i].finish = true;
+        waker_wake(futures[i].base.waker);
+    }
+    while (executor_poll_ready(&victim) + executor_poll_ready(&thief) != 0) {
+    }
+    ASSERT_EQUAL(0, victim.task_count + thief.task_count, "Completed tasks should leave both executors");
+}
+#endif
+
+#ifdef EXECUTOR_TELEMETRY
+TEST(executor_telemetry_counts_polls) {
+    Executor executor;
+    CountingFuture future = { .base = { .vtable = &counting_future_vtable } };
+    executor_init(&executor);
+
+    executor_spawn(&executor, &future.base);
+    executor_poll_ready(&executor);
+    waker_wake(future.base.waker);
+    waker_wake(future.base.waker);
+    executor_poll_ready(&executor);
+
+    const TaskStats* stats = executor_task_stats(&future.base);
+    ASSERT(stats != NULL, "A spawned future should have task stats");
+    ASSERT_EQUAL(2, stats->polls, "Every poll should be counted");
+    ASSERT_EQUAL(2, stats->pending_polls, "Pending polls should be counted");
+    ASSERT(stats->poll_cycles >= stats->max_poll_cycles, "The slowest poll should be part of the total");
+    ASSERT_EQUAL(1, atomic_load(&executor.stats.wakes_coalesced), "A wake-up of a queued task should coalesce");
+    ASSERT_EQUAL(3, atomic_load(&executor.stats.wakes_irqs_off) + atomic_load(&executor.stats.wakes_irqs_on),
+                 "Spawning and waking should each queue the task");
+    ASSERT(executor.live_tasks != NULL, "The task should be listed while live");
+
+    future.finish = true;
+    waker_wake(future.base.waker);
+    executor_poll_ready(&executor);
+    ASSERT(executor.live_tasks == NULL, "A completed task should leave the live list");
+    ASSERT_EQUAL(1, executor.stats.tasks_completed, "The completion should be counted");
+}
+#endif
+
+typedef struct {
+    TimerNode timer;
+    uint32_t fired;
+} CountingTimer;
+
+static void counting_timer_expired(TimerNode* timer) {
+    TIMER_CONTAINER(timer, CountingTimer, timer)->fired++;
+}
+
+TEST(timer_wheel_expires_on_deadline) {
+    // A private wheel, so the RTC interrupt cannot advance it
+    static TimerWheel wheel;
+    CountingTimer timers[4];
+    uint32_t deadlines[4] = { 990, 1001, 1070, 6000 };
+
+    timer_wheel_init(&wheel, 1000);
+    for (int i = 0; i < 4; i++) {
+        timers[i].fired = 0;
+        timer_init(&timers[i].timer, counting_timer_expired);
+        timer_add(&wheel, &timers[i].timer, deadlines[i]);
+    }
+    ASSERT_EQUAL(4, wheel.pending, "All timers should be pending");
+
+    timer_wheel_advance(&wheel, 1000);
+    ASSERT_EQUAL(1, timers[0].fired, "A passed deadline should fire on the next tick");
+    ASSERT_EQUAL(0, timers[1].fired, "Future deadlines should wait");
+
+    timer_wheel_advance(&wheel, 1069);
+    ASSERT_EQUAL(1, timers[1].fired, "Level 0 timers should fire on their tick");
+    ASSERT_EQUAL(0, timers[2].fired, "Cascaded timers should not fire early");
+
+    timer_wheel_advance(&wheel, 1070);
+    ASSERT_EQUAL(1, timers[2].fired, "Level 1 timers should fire on their tick");
+
+    timer_wheel_advance(&wheel, 5999);
+    ASSERT_EQUAL(0, timers[3].fired, "Level 2 timers should not fire early");
+    timer_wheel_advance(&wheel, 6000);
+    ASSERT_EQUAL(1, timers[3].fired, "Level 2 timers should fire on their tick");
+    ASSERT_EQUAL(0, wheel.pending, "Expired timers should leave the wheel");
+}
+
+TEST(timer_cancel_prevents_expiry) {
+    static TimerWheel wheel;
+    CountingTimer timer = { .fired = 0 };
+
+    timer_wheel_init(&wheel, 0);
+    timer_init(&timer.timer, counting_timer_expired);
+    timer_add(&wheel, &timer.timer, 200);
+
+    ASSERT(timer_cancel(&wheel, &timer.timer), "Cancelling a pending timer should succeed");
+    ASSERT(!timer_cancel(&wheel, &timer.timer), "A cancelled timer is no longer pending");
+
+    timer_wheel_advance(&wheel, 300);
+    ASSERT_EQUAL(0, timer.fired, "A cancelled timer should never fire");
+
+    timer_add(&wheel, &timer.timer, 310);
+    timer_add(&wheel, &timer.timer, 305);
+    timer_wheel_advance(&wheel, 305);
+    ASSERT_EQUAL(1, timer.fired, "Re-adding should move the deadline, not duplicate it");
+    timer_wheel_advance(&wheel, 400);
+    ASSERT_EQUAL(1, timer.fired, "A moved timer should fire once");
+}
+
+TEST(timer_wheel_next_event_finds_earliest) {
+    static TimerWheel wheel;
+    CountingTimer timers[3];
+    uint32_t deadlines[3] = { 505, 540, 700 };
+
+    timer_wheel_init(&wheel, 500);
+    ASSERT_EQUAL(510, timer_wheel_next_event(&wheel, 10), "An empty wheel should report the limit");
+    ASSERT_EQUAL(500 + TIMER_WHEEL_SLOTS, timer_wheel_next_event(&wheel, 1000), "The limit should be capped at one lap");
+
+    for (int i = 0; i < 3; i++) {
+        timer_init(&timers[i].timer, counting_timer_expired);
+        timer_add(&wheel, &timers[i].timer, deadlines[i]);
+    }
+    ASSERT_EQUAL(505, timer_wheel_next_event(&wheel, TIMER_WHEEL_SLOTS), "The earliest deadline should be found");
+    ASSERT_EQUAL(503, timer_wheel_next_event(&wheel, 3), "Events past the limit should be ignored");
+
+    timer_cancel(&wheel, &timers[0].timer);
+    ASSERT_EQUAL(540, timer_wheel_next_event(&wheel, TIMER_WHEEL_SLOTS), "Cancelled timers should be skipped");
+
+    timer_cancel(&wheel, &timers[1].timer);
+    uint32_t next = timer_wheel_next_event(&wheel, TIMER_WHEEL_SLOTS);
+    ASSERT(next > 500 && next <= 700, "An upper-level timer should wake no later than its deadline");
+
+    timer_cancel(&wheel, &timers[2].timer);
+}
+
+TEST(clock_is_monotonic) {
+    uint64_t last_ns = clock_ns();
+    uint32_t last_ticks = clock_ticks();
+
+    for (int i = 0; i < 10000; i++) {
+        uint64_t ns = clock_ns();
+        uint32_t ticks = clock_ticks();
+        ASSERT(ns >= last_ns, "Nanoseconds should never go backwards");
+        ASSERT((int32_t)(ticks - last_ticks) >= 0, "Ticks should never go backwards");
+        last_ns = ns;
+        last_ticks = ticks;
+    }
+}
+
+TEST(join_all_waits_for_every_child) {
+    Executor executor;
+    CountingFuture children[2];
+    Future* futures[2];
+    JoinAllFuture join;
+
+    executor_init(&executor);
+    for (int i = 0; i < 2; i++) {
+        children[i] = (CountingFuture){ .base = { .vtable = &counting_future_vtable } };
+        futures[i] = &children[i].base;
+    }
+    children[0].finish = true;
+
+    executor_spawn(&executor, join_all_init(&join, futures, 2));
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(1, children[0].cleanups, "A finished child should be cleaned up at once");
+    ASSERT(futures[0] == NULL, "A finished child should leave its slot");
+    ASSERT_EQUAL(1, executor.task_count, "The join should wait for the other child");
+
+    children[1].finish = true;
+    waker_wake(join.base.waker);
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(1, children[0].polls, "A finished child should not be polled again");
+    ASSERT_EQUAL(1, children[1].cleanups, "The last child should be cleaned up");
+    ASSERT_EQUAL(0, executor.task_count, "The join should complete with its last child");
+}
+
+TEST(select_first_cancels_losers) {
+    Executor executor;
+    CountingFuture children[3];
+    Future* futures[3];
+    SelectFirstFuture select;
+
+    executor_init(&executor);
+    for (int i = 0; i < 3; i++) {
+        children[i] = (CountingFuture){ .base = { .vtable = &counting_future_vtable } };
+        futures[i] = &children[i].base;
+    }
+
+    executor_spawn(&executor, select_first_init(&select, futures, 3));
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(-1, select.winner, "Nothing should win while every child is pending");
+
+    children[1].finish = true;
+    waker_wake(select.base.waker);
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(1, select.winner, "The completed child should win");
+    ASSERT_EQUAL(0, executor.task_count, "The select should complete with its winner");
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQUAL(1, children[i].cleanups, "Every child should be finished exactly once");
+    }
+    ASSERT_EQUAL(1, children[2].polls, "Children after the winner should not be polled again");
+}
+
+TEST(with_timeout_cancels_inner) {
+    Executor executor;
+    CountingFuture inner = { .base = { .vtable = &counting_future_vtable } };
+    CountingFuture quick = { .base = { .vtable = &counting_future_vtable }, .finish = true };
+    TimeoutFuture timeout;
+    TimeoutFuture generous;
+    uint32_t pending_timers = system_timer_wheel.pending;
+
+    executor_init(&executor);
+
+    executor_spawn(&executor, with_timeout_init(&timeout, &inner.base, 0));
+    executor_poll_ready(&executor);
+    ASSERT(timeout.timed_out, "A passed deadline should time out");
+    ASSERT_EQUAL(1, inner.cleanups, "Timing out should cancel the inner future");
+
+    executor_spawn(&executor, with_timeout_init(&generous, &quick.base, 10 * CLOCK_TICK_HZ));
+    executor_poll_ready(&executor);
+    ASSERT(!generous.timed_out, "An inner future that completes should not time out");
+    ASSERT_EQUAL(1, quick.cleanups, "The completed inner future should be finished");
+    ASSERT_EQUAL(pending_timers, system_timer_wheel.pending, "No deadline timer should be left behind");
+    ASSERT_EQUAL(0, executor.task_count, "Both timeouts should complete");
+}
+
+typedef struct {
+    Future base;
+    AsyncFrame frame;
+    CountingFuture* first;
+    CountingFuture* second;
+    uint32_t steps;
+} TwoStepCoroutine;
+
+static FutureState two_step_poll(Future* future, void* context) {
+    TwoStepCoroutine* co = (TwoStepCoroutine*)future;
+
+    ASYNC_BEGIN(&co->frame, context);
+    co->steps++;
+    AWAIT(&co->first->base);
+    co->steps++;
+    ASYNC_YIELD();
+    co->steps++;
+    AWAIT(&co->second->base);
+    co->steps++;
+    ASYNC_END();
+}
+
+static void two_step_cleanup(Future* future) {
+    async_frame_cleanup(&((TwoStepCoroutine*)future)->frame);
+}
+
+static const FutureVTable two_step_vtable = {
+    .poll = two_step_poll,
+    .cleanup = two_step_cleanup,
+    .drop = counting_future_drop
+};
+
+TEST(coroutine_resumes_after_await) {
+    Executor executor;
+    CountingFuture first = { .base = { .vtable = &counting_future_vtable } };
+    CountingFuture second = { .base = { .vtable = &counting_future_vtable } };
+    TwoStepCoroutine co = { .base = { .vtable = &two_step_vtable }, .first = &first, .second = &second };
+
+    executor_init(&executor);
+    async_frame_init(&co.frame);
+    executor_spawn(&executor, &co.base);
+
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(1, co.steps, "The coroutine should stop at its first await");
+
+    first.finish = true;
+    waker_wake(co.base.waker);
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(2, co.steps, "The coroutine should resume after the await and stop at the yield");
+    ASSERT_EQUAL(1, first.cleanups, "An awaited future should be finished once it completes");
+
+    ASSERT_EQUAL(1, executor_poll_ready(&executor), "A yield should queue the task again");
+    ASSERT_EQUAL(3, co.steps, "The coroutine should resume after the yield");
+    ASSERT_EQUAL(2, first.polls, "A completed await should not be polled again");
+
+    second.finish = true;
+    waker_wake(co.base.waker);
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(4, co.steps, "The coroutine should run to its end");
+    ASSERT_EQUAL(0, executor.task_count, "A finished coroutine should complete its task");
+}
+
+TEST(coroutine_cleanup_cancels_await) {
+    CountingFuture first = { .base = { .vtable = &counting_future_vtable } };
+    TwoStepCoroutine co = { .base = { .vtable = &two_step_vtable }, .first = &first };
+
+    async_frame_init(&co.frame);
+    ASSERT(two_step_poll(&co.base, NULL) == FUTURE_PENDING, "The coroutine should wait on its await");
+
+    future_finish(&co.base);
+    ASSERT_EQUAL(1, first.cleanups, "Dropping a coroutine should cancel what it awaits");
+    ASSERT(co.frame.awaiting == NULL, "The frame should let go of the cancelled future");
+}
+
+static char thread_test_log[8];
+static uint32_t thread_test_log_length;
+static Semaphore thread_test_done;
+static Mutex thread_test_mutex;
+
+static void thread_test_log_char(char c) {
+    if (thread_test_log_length < sizeof(thread_test_log) - 1) {
+        thread_test_log[thread_test_log_length++] = c;
+        thread_test_log[thread_test_log_length] = '\0';
+    }
+}
+
+static bool thread_test_log_is(const char* expected) {
+    uint32_t i = 0;
+    while (expected[i] != '\0' && thread_test_log[i] == expected[i]) {
+        i++;
+    }
+    return expected[i] == '\0' && i == thread_test_log_length;
+}
+
+static void thread_test_yielder(void* arg) {
+    for (int i = 0; i < 3; i++) {
+        thread_test_log_char(*(const char*)arg);
+        thread_yield();
+    }
+    semaphore_up(&thread_test_done);
+}
+
+TEST(threads_round_robin_on_yield) {
+    thread_test_log_length = 0;
+    semaphore_init(&thread_test_done, 0);
+
+    ASSERT(thread_create("a", thread_test_yielder, "a") != NULL, "The first thread should be created");
+    ASSERT(thread_create("b", thread_test_yielder, "b") != NULL, "The second thread should be created");
+
+    semaphore_down(&thread_test_done);
+    semaphore_down(&thread_test_done);
+
+    ASSERT(thread_test_log_is("ababab"), "Yielding threads should take turns");
+    ASSERT(thread_current()->id == 0, "The boot thread should run again once woken");
+}
+
+static void thread_test_locker(void* arg) {
+    (void)arg;
+    mutex_lock(&thread_test_mutex);
+    thread_test_log_char('w');
+    mutex_unlock(&thread_test_mutex);
+    semaphore_up(&thread_test_done);
+}
+
+TEST(mutex_blocks_until_unlocked) {
+    thread_test_log_length = 0;
+    semaphore_init(&thread_test_done, 0);
+    mutex_init(&thread_test_mutex);
+
+    mutex_lock(&thread_test_mutex);
+    ASSERT(thread_create("locker", thread_test_locker, NULL) != NULL, "The thread should be created");
+
+    thread_yield();
+    ASSERT_EQUAL(0, thread_test_log_length, "The thread should block on the held mutex");
+    ASSERT(thread_test_mutex.waiters.head != NULL, "The thread should wait on the mutex");
+
+    thread_test_log_char('b');
+    mutex_unlock(&thread_test_mutex);
+    semaphore_down(&thread_test_done);
+
+    ASSERT(thread_test_log_is("bw"), "The thread should run once the mutex is released");
+    ASSERT(thread_test_mutex.owner == NULL, "The mutex should end up free");
+}
+
+#define SERIAL_MODEM_CONTROL (SERIAL_COM1_PORT + 4)
+#define SERIAL_MCR_LOOPBACK  0x1E
+#define SERIAL_MCR_NORMAL    0x0F
+
+// Feeds `text` to the receive path through the UART's loopback mode. Nothing
+// may print while loopback is on, or it would be received too.
+static void serial_loopback_receive(const char* text) {
+    uint32_t flags = irq_save();
+    out_b(SERIAL_MODEM_CONTROL, SERIAL_MCR_LOOPBACK);
+    for (size_t i = 0; text[i] != '\0'; i++) {
+        write_serial(text[i]);
+    }
+    while (serial_is_transmit_empty() == 0) {
+    }
+    serial_rx_receive();
+    out_b(SERIAL_MODEM_CONTROL, SERIAL_MCR_NORMAL);
+    irq_restore(flags);
+}
+
+TEST(serial_read_line_splits_lines) {
+    Executor executor;
+    char line[4];
+    size_t length = 0;
+    char scratch[16];
+
+    executor_init(&executor);
+    serial_rx_receive();
+    while (serial_rx_read(scratch, sizeof(scratch)) != 0) {
+    }
+
+    serial_loopback_receive("ab\r\ncdefg\n");
+
+    executor_spawn(&executor, async_serial_read_line_create(line, sizeof(line), &length));
+    ASSERT_EQUAL(1, executor_poll_ready(&executor), "The line reader should be polled");
+    ASSERT_EQUAL(2, length, "A line should end at its carriage return");
+    ASSERT(line[0] == 'a' && line[1] == 'b' && line[2] == '\0', "The line should hold its text");
+
+    executor_spawn(&executor, async_serial_read_line_create(line, sizeof(line), &length));
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(3, length, "A long line should be cut at the buffer size");
+    ASSERT(line[0] == 'c' && line[2] == 'e', "The line feed after a carriage return should be skipped");
+
+    executor_spawn(&executor, async_serial_read_line_create(line, sizeof(line), &length));
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(2, length, "The rest of a cut line should come next");
+
+    length = 0;
+    executor_spawn(&executor, async_serial_read_line_create(line, sizeof(line), &length));
+    executor_poll_ready(&executor);
+    ASSERT_EQUAL(1, executor.task_count, "A reader with no line yet should wait");
+
+    serial_loopback_receive("h\n");
+    ASSERT_EQUAL(1, executor_poll_ready(&executor), "Received bytes should wake the reader");
+    ASSERT_EQUAL(1, length, "The waiting reader should get the new line");
+    ASSERT_EQUAL(0, executor.task_count, "Completed readers should leave the executor");
+}
+
+void run_async_tests() {
+    test_entry_t async_tests[] = {
+        TEST_ENTRY(executor_polls_only_woken_tasks),
+        TEST_ENTRY(executor_orders_by_priority_and_deadline),
+        TEST_ENTRY(executor_budget_prevents_starvation),
+#ifndef EXECUTOR_TELEMETRY
+        TEST_ENTRY(executor_steal_takes_back_half),
+#endif
+#ifdef EXECUTOR_TELEMETRY
+        TEST_ENTRY(executor_telemetry_counts_polls),
+#endif
+        TEST_ENTRY(timer_wheel_expires_on_deadline),
+        TEST_ENTRY(timer_cancel_prevents_expiry),
+        TEST_ENTRY(timer_wheel_next_event_finds_earliest),
+        TEST_ENTRY(clock_is_monotonic),
+        TEST_ENTRY(serial_read_line_splits_lines),
+        TEST_ENTRY(join_all_waits_for_every_child),
+        TEST_ENTRY(select_first_cancels_losers),
+        TEST_ENTRY(with_timeout_cancels_inner),
+        TEST_ENTRY(coroutine_resumes_after_await),
+        TEST_ENTRY(coroutine_cleanup_cancels_await),
+        TEST_ENTRY(threads_round_robin_on_yield),
+        TEST_ENTRY(mutex_blocks_until_unlocked)
+    };
+
+    run_tests(async_tests, sizeof(async_tests) / sizeof(async_tests[0]));
+}
@@ -0,0 +1,84 @@
+#include "lapic.h"
+#include "paging.h"
+#include "page_allocator.h"
+#include "io.h"
+#include <stddef.h>
+
+#define CPUID_EDX_APIC (1 << 9)
+
+static volatile uint32_t* lapic_base = NULL;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / sizeof(uint32_t)];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / sizeof(uint32_t)] = value;
+}
+
+bool lapic_init(uint32_t base) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if ((edx & CPUID_EDX_APIC) == 0) {
+        return false;
+    }
+
+    base &= ~(uint32_t)(PAGE_SIZE - 1);
+    if (paging_enabled() && paging_map(base, base, PAGE_SIZE, PAGING_MMIO_FLAGS) != 0) {
+        return false;
+    }
+
+    lapic_base = (volatile uint32_t*)(uintptr_t)base;
+    lapic_enable();
+    return true;
+}
+
+bool lapic_present(void) {
+    return lapic_base != NULL;
+}
+
+void lapic_enable(void) {
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, lapic_read(LAPIC_REG_SVR) | LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+uint8_t lapic_id(void) {
+    return (uint8_t)(lapic_read(LAPIC_REG_ID) >> 24);
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+// The ICR is written high half first, so an interrupt on this CPU that
+// sends its own IPI in between would redirect ours: keep them off.
+static void lapic_send(uint8_t apic_id, uint32_t command) {
+    uint32_t flags = irq_save();
+
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ volatile ("pause");
+    }
+    lapic_write(LAPIC_REG_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, command);
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ volatile ("pause");
+    }
+
+    irq_restore(flags);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector) {
+    lapic_send(apic_id, LAPIC_ICR_ASSERT | vector);
+}
+
+void lapic_send_init(uint8_t apic_id) {
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+    // De-assert, for the processors before the Pentium 4 that need it
+    lapic_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+}
+
+void lapic_send_startup(uint8_t apic_id, uint32_t trampoline) {
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_send(apic_id, LAPIC_ICR_STARTUP | ((trampoline >> PAGE_SHIFT) & 0xFF));
+}
@@ -0,0 +1,54 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Local APIC, in xAPIC (memory-mapped) mode. The 8259 PICs keep delivering
+// device interrupts to the bootstrap processor through LINT0 as the BIOS
+// set it up; the local APIC is only used for inter-processor interrupts.
+#define LAPIC_DEFAULT_BASE  0xFEE00000
+
+#define LAPIC_REG_ID        0x020
+#define LAPIC_REG_VERSION   0x030
+#define LAPIC_REG_TPR       0x080
+#define LAPIC_REG_EOI       0x0B0
+#define LAPIC_REG_SVR       0x0F0
+#define LAPIC_REG_ESR       0x280
+#define LAPIC_REG_ICR_LOW   0x300
+#define LAPIC_REG_ICR_HIGH  0x310
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_ICR_INIT          0x00000500
+#define LAPIC_ICR_STARTUP       0x00000600
+#define LAPIC_ICR_PENDING       0x00001000
+#define LAPIC_ICR_ASSERT        0x00004000
+#define LAPIC_ICR_LEVEL         0x00008000
+
+// Delivered for interrupts withdrawn before they were taken; needs no EOI.
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+
+// Maps the registers at physical `base` as device memory. Returns false if
+// the CPU has no local APIC or the mapping failed.
+bool lapic_init(uint32_t base);
+
+bool lapic_present(void);
+
+// Software-enables the calling CPU's local APIC and lets every interrupt
+// priority through.
+void lapic_enable(void);
+
+uint8_t lapic_id(void);
+
+void lapic_eoi(void);
+
+// Fixed interrupt `vector` to the CPU with local APIC ID `apic_id`.
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+
+// The startup sequence for an application processor: INIT resets it into
+// wait-for-SIPI, and STARTUP sets it running in real mode at the page
+// `trampoline` points to, which must be below 1 MiB.
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint32_t trampoline);
+
+#endif
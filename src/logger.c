@@ -6,38 +6,71 @@
 
 atomic_uint_fast32_t interrupt_guard_counter = 0;
 static LogBuffer g_log_buffer;
+static LogNode g_log_nodes[LOG_BUFFER_SIZE];
 static Logger g_logger;
 
 int logger_buffer_is_full(void) {
-    return g_log_buffer.count >= LOG_BUFFER_SIZE;
+    return pool_free_count(&g_log_buffer.pool) == 0;
 }
 
 int logger_buffer_is_empty(void) {
-    return g_log_buffer.count == 0;
+    return atomic_load(&g_log_buffer.count) == 0;
 }
 
-void logger_buffer_push(const LogEntry* entry) {
-    if (logger_buffer_is_full()) {
-        g_log_buffer.head = (g_log_buffer.head + 1) % LOG_BUFFER_SIZE;
-        g_log_buffer.count--;
+uint32_t logger_dropped_count(void) {
+    return atomic_load(&g_log_buffer.dropped);
+}
+
+static LogNode* logger_node_alloc(void) {
+    LogNode* node = (LogNode*)pool_alloc(&g_log_buffer.pool);
+    if (node == NULL) {
+        atomic_fetch_add(&g_log_buffer.dropped, 1);
     }
+    return node;
+}
+
+static void logger_node_publish(LogNode* node) {
+    LogNode* head = atomic_load(&g_log_buffer.pending);
+    do {
+        node->next = head;
+    } while (!atomic_compare_exchange_weak(&g_log_buffer.pending, &head, node));
 
-    g_log_buffer.buffer[g_log_buffer.tail] = *entry;
+    atomic_fetch_add(&g_log_buffer.count, 1);
+}
+
+void logger_buffer_push(const LogEntry* entry) {
+    LogNode* node = logger_node_alloc();
+    if (node == NULL) {
+        return;
+    }
 
-    g_log_buffer.tail = (g_log_buffer.tail + 1) % LOG_BUFFER_SIZE;
-    g_log_buffer.count++;
+    node->entry = *entry;
+    logger_node_publish(node);
 }
 
+// Single consumer; only called from task context.
 int logger_buffer_pop(LogEntry* entry) {
-    if (logger_buffer_is_empty()) {
+    if (g_log_buffer.ready == NULL) {
+        // The pending stack is newest first, reversing it restores order.
+        LogNode* pending = atomic_exchange(&g_log_buffer.pending, NULL);
+        while (pending) {
+            LogNode* next = pending->next;
+            pending->next = g_log_buffer.ready;
+            g_log_buffer.ready = pending;
+            pending = next;
+        }
+    }
+
+    LogNode* node = g_log_buffer.ready;
+    if (node == NULL) {
         return 0;
     }
 
-    *entry = g_log_buffer.buffer[g_log_buffer.head];
+    g_log_buffer.ready = node->next;
+    *entry = node->entry;
+    pool_free(&g_log_buffer.pool, node);
+    atomic_fetch_sub(&g_log_buffer.count, 1);
 
-    g_log_buffer.head = (g_log_buffer.head + 1) % LOG_BUFFER_SIZE;
-    g_log_buffer.count--;
-    
     return 1; 
 }
 
@@ -56,9 +89,11 @@ void interrupt_guard_release(void) {
 }
 
 void logger_init(void) {
-    g_log_buffer.head = 0;
-    g_log_buffer.tail = 0;
-    g_log_buffer.count = 0;
+    pool_init(&g_log_buffer.pool, g_log_nodes, sizeof(LogNode), LOG_BUFFER_SIZE);
+    atomic_store(&g_log_buffer.pending, NULL);
+    g_log_buffer.ready = NULL;
+    atomic_store(&g_log_buffer.count, 0);
+    atomic_store(&g_log_buffer.dropped, 0);
 
     g_logger.buffer = &g_log_buffer;
     g_logger.default_level = LOG_LEVEL_INFO;
@@ -165,31 +200,38 @@ static int simple_format_string(char* buffer, size_t buffer_size, const char* fo
     return written;
 }
 
-void logger_log(LogLevel level, const char* module, const char* format, ...) {
-    LogLevel module_level = logger_get_module_level(module);
-    if (level < module_level) {
-        return; 
+// Formats straight into a pool node, so callers in interrupt context never
+// wait on or block out anyone else.
+static void logger_vlog(LogLevel level, const char* module, const char* format, va_list args) {
+    LogNode* node = logger_node_alloc();
+    if (node == NULL) {
+        return;
     }
 
-    interrupt_guard_acquire();
-
-    LogEntry entry;
-    entry.level = level;
+    LogEntry* entry = &node->entry;
+    entry->level = level;
 
     int i;
-    for (i = 0; i < sizeof(entry.module) - 1 && module[i] != '\0'; i++) {
-        entry.module[i] = module[i];
+    for (i = 0; i < sizeof(entry->module) - 1 && module[i] != '\0'; i++) {
+        entry->module[i] = module[i];
+    }
+    entry->module[i] = '\0';
+
+    simple_format_string(entry->message, sizeof(entry->message), format, args);
+
+    logger_node_publish(node);
+}
+
+void logger_log(LogLevel level, const char* module, const char* format, ...) {
+    LogLevel module_level = logger_get_module_level(module);
+    if (level < module_level) {
+        return; 
     }
-    entry.module[i] = '\0';
 
     va_list args;
     va_start(args, format);
-    simple_format_string(entry.message, sizeof(entry.message), format, args);
+    logger_vlog(level, module, format, args);
     va_end(args);
-
-    logger_buffer_push(&entry);
-
-    interrupt_guard_release();
 }
 
 void logger_debug(const char* module, const char* format, ...) {
@@ -197,23 +239,7 @@ void logger_debug(const char* module, const char* format, ...) {
     if (LOG_LEVEL_DEBUG >= module_level) {
         va_list args;
         va_start(args, format);
-        
-        interrupt_guard_acquire();
-        
-        LogEntry entry;
-        entry.level = LOG_LEVEL_DEBUG;
- 
-        int i;
-        for (i = 0; i < sizeof(entry.module) - 1 && module[i] != '\0'; i++) {
-            entry.module[i] = module[i];
-        }
-        entry.module[i] = '\0';
-        
-        simple_format_string(entry.message, sizeof(entry.message), format, args);
-        
-        logger_buffer_push(&entry);
-        interrupt_guard_release();
-        
+        logger_vlog(LOG_LEVEL_DEBUG, module, format, args);
         va_end(args);
     }
 }
@@ -223,23 +249,7 @@ void logger_info(const char* module, const char* format, ...) {
     if (LOG_LEVEL_INFO >= module_level) {
         va_list args;
         va_start(args, format);
-        
-        interrupt_guard_acquire();
-        
-        LogEntry entry;
-        entry.level = LOG_LEVEL_INFO;
-
-        int i;
-        for (i = 0; i < sizeof(entry.module) - 1 && module[i] != '\0'; i++) {
-            entry.module[i] = module[i];
-        }
-        entry.module[i] = '\0';
-        
-        simple_format_string(entry.message, sizeof(entry.message), format, args);
-        
-        logger_buffer_push(&entry);
-        interrupt_guard_release();
-        
+        logger_vlog(LOG_LEVEL_INFO, module, format, args);
         va_end(args);
     }
 }
@@ -249,23 +259,7 @@ void logger_warning(const char* module, const char* format, ...) {
     if (LOG_LEVEL_WARNING >= module_level) {
         va_list args;
         va_start(args, format);
-        
-        interrupt_guard_acquire();
-        
-        LogEntry entry;
-        entry.level = LOG_LEVEL_WARNING;
-        
-        int i;
-        for (i = 0; i < sizeof(entry.module) - 1 && module[i] != '\0'; i++) {
-            entry.module[i] = module[i];
-        }
-        entry.module[i] = '\0';
-        
-        simple_format_string(entry.message, sizeof(entry.message), format, args);
-        
-        logger_buffer_push(&entry);
-        interrupt_guard_release();
-        
+        logger_vlog(LOG_LEVEL_WARNING, module, format, args);
         va_end(args);
     }
 }
@@ -275,29 +269,14 @@ void logger_error(const char* module, const char* format, ...) {
     if (LOG_LEVEL_ERROR >= module_level) {
         va_list args;
         va_start(args, format);
-        
-        interrupt_guard_acquire();
-        
-        LogEntry entry;
-        entry.level = LOG_LEVEL_ERROR;
-
-        int i;
-        for (i = 0; i < sizeof(entry.module) - 1 && module[i] != '\0'; i++) {
-            entry.module[i] = module[i];
-        }
-        entry.module[i] = '\0';
-        
-        simple_format_string(entry.message, sizeof(entry.message), format, args);
-        
-        logger_buffer_push(&entry);
-        interrupt_guard_release();
-        
+        logger_vlog(LOG_LEVEL_ERROR, module, format, args);
         va_end(args);
     }
 }
 
 void logger_service(void) {
     LogEntry entry;
+    static uint32_t reported_dropped = 0;
 
     while (logger_buffer_pop(&entry)) {
         output_string("[");
@@ -308,4 +287,12 @@ void logger_service(void) {
         output_string(entry.message);
         output_string("\n");
     }
+
+    uint32_t dropped = logger_dropped_count();
+    if (dropped != reported_dropped) {
+        output_string("[WARNING] logger: ");
+        put_u32(dropped - reported_dropped);
+        output_string(" messages dropped\n");
+        reported_dropped = dropped;
+    }
 }
\ No newline at end of file
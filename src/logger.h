@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdatomic.h>
 #include "terminal.h"  
+#include "pool.h"
 
 typedef enum {
     LOG_LEVEL_DEBUG = 0,
@@ -21,11 +22,22 @@ typedef struct {
     char module[64];  
 } LogEntry;
 
+typedef struct LogNode {
+    LogEntry entry;
+    struct LogNode* next;
+} LogNode;
+
+// Entries live in a pool of LOG_BUFFER_SIZE nodes. Any context, interrupt
+// handlers included, claims a node, formats into it and pushes it onto
+// `pending` with a compare-exchange. logger_service is the only consumer:
+// it takes the whole pending stack at once and reverses it into `ready`,
+// oldest first. When the pool is empty new messages are dropped and counted.
 typedef struct {
-    LogEntry buffer[LOG_BUFFER_SIZE];
-    volatile uint32_t head; 
-    volatile uint32_t tail;  
-    volatile uint32_t count; 
+    Pool pool;
+    _Atomic(LogNode*) pending;
+    LogNode* ready;
+    atomic_uint_fast32_t count;
+    atomic_uint_fast32_t dropped;
 } LogBuffer;
 
 extern atomic_uint_fast32_t interrupt_guard_counter;
@@ -57,6 +69,8 @@ int logger_buffer_is_full(void);
 
 int logger_buffer_is_empty(void);
 
+uint32_t logger_dropped_count(void);
+
 void logger_debug(const char* module, const char* format, ...);
 void logger_info(const char* module, const char* format, ...);
 void logger_warning(const char* module, const char* format, ...);
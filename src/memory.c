@@ -1,261 +1,729 @@
 #include "memory.h"
+#include "page_allocator.h"
+#include "paging.h"
 #include "terminal.h"
 #include "io.h"
+#include "libc.h"
+#include "thread.h"
+#include "spinlock.h"
 #include <stddef.h>
 #include <stdbool.h>
 
-struct multiboot_info {
-    uint32_t flags;
-    uint32_t mem_lower;
-    uint32_t mem_upper;
-    uint32_t boot_device;
-    uint32_t cmdline;
-    uint32_t mods_count;
-    uint32_t mods_addr;
-    uint32_t num;
-    uint32_t size;
-    uint32_t addr;
-    uint32_t shndx;
-    uint32_t mmap_length;
-    uint32_t mmap_addr;
-    uint32_t drives_length;
-    uint32_t drives_addr;
-    uint32_t config_table;
-    uint32_t boot_loader_name;
-    uint32_t apm_table;
-    uint32_t vbe_ctrl_info;
-    uint32_t vbe_mode_info;
-    uint32_t vbe_mode;
-    uint32_t vbe_interface_seg;
-    uint32_t vbe_interface_off;
-    uint32_t vbe_interface_len;
-};
-
-struct memory_map_entry {
-    uint32_t size;  
-    uint32_t base_addr_low;
-    uint32_t base_addr_high;
-    uint32_t length_low;
-    uint32_t length_high;
-    uint32_t type;
-};
-
-static inline FreeSegment* atomic_load_FreeSegment_ptr(FreeSegment* volatile* ptr) {
-    FreeSegment* result;
-    __asm__ volatile ("movl %1, %0" : "=r" (result) : "m" (*ptr) : "memory");
-    return result;
-}
-
-static inline void atomic_store_FreeSegment_ptr(FreeSegment* volatile* ptr, FreeSegment* val) {
-    __asm__ volatile ("movl %1, %0" : "=m" (*ptr) : "r" (val) : "memory");
-}
-
-static volatile FreeSegment* first_free = NULL;
-
-static uint8_t heap_area[HEAP_SIZE];
+// Segment data pointers are always 8-byte aligned and segment sizes are
+// multiples of 8, so every split leaves the next header correctly placed.
+#define SEGMENT_ALIGN 8
+#define SEGMENT_TAG_SIZE sizeof(size_t)
+#define SEGMENT_OVERHEAD (sizeof(UsedSegment) + SEGMENT_TAG_SIZE)
+#define MIN_SEGMENT_SIZE ((sizeof(FreeSegment) + SEGMENT_TAG_SIZE + SEGMENT_ALIGN - 1) & ~(SEGMENT_ALIGN - 1))
+#define SMALL_SEGMENT_SHIFT 9
+
+#define BIN_BITMAP_WORDS (sizeof(((HeapRegion*)0)->bin_bitmap) / sizeof(uint32_t))
+
+// Regions are searched in the order they were added; the early region comes
+// first so boot-time allocations stay packed together.
+static HeapRegion heap_regions[HEAP_MAX_REGIONS];
+static uint32_t heap_region_count = 0;
+
+// Always-on counters. Free space is tracked as segments enter and leave the
+// bins; the largest free block is only computed when stats are queried.
+static MemoryStats heap_stats;
+
+// Kernel threads and every CPU share the heap, which is written for one
+// context: take the lock and keep the running thread on the CPU while it is
+// inside. Interrupt handlers must not allocate.
+#ifdef SHOGUN_HOSTED
+#define HEAP_LOCK() ((void)0)
+#define HEAP_UNLOCK() ((void)0)
+#else
+static Spinlock heap_lock = SPINLOCK_INIT;
+#define HEAP_LOCK() (preempt_disable(), spin_lock(&heap_lock))
+#define HEAP_UNLOCK() (spin_unlock(&heap_lock), preempt_enable())
+#endif
+
+// Backs the heap until the page allocator is up.
+static uint8_t early_heap_area[EARLY_HEAP_SIZE] __attribute__((aligned(SEGMENT_ALIGN)));
 
 uint32_t get_esp() {
+#ifdef SHOGUN_HOSTED
+    return (uint32_t)(uintptr_t)__builtin_frame_address(0);
+#else
     uint32_t esp;
     __asm__ volatile ("movl %%esp, %0" : "=r" (esp));
     return esp;
+#endif
 }
 
 static inline size_t align_up(size_t value, size_t alignment) {
     return (value + alignment - 1) & ~(alignment - 1);
 }
 
-void init_allocator(uint32_t multiboot_info_ptr) {
-    struct multiboot_info* mb_info = (struct multiboot_info*)multiboot_info_ptr;
-    
-    if (!(mb_info->flags & (1 << 6))) {
-        return;
+static inline size_t tag_size(size_t tag) {
+    return tag & ~(size_t)(SEGMENT_ALIGN - 1);
+}
+
+static inline bool tag_used(size_t tag) {
+    return (tag & SEGMENT_USED) != 0;
+}
+
+static inline size_t* segment_footer(void* segment, size_t size) {
+    return (size_t*)((uint8_t*)segment + size - SEGMENT_TAG_SIZE);
+}
+
+static inline void set_segment_tags(void* segment, size_t size, size_t flags) {
+    *(size_t*)segment = size | flags;
+    *segment_footer(segment, size) = size | flags;
+}
+
+static inline uint32_t floor_log2(size_t value) {
+    return (uint32_t)(sizeof(unsigned long) * 8 - 1 - __builtin_clzl((unsigned long)value));
+}
+
+static inline size_t bin_index(size_t size) {
+    if (size <= SMALL_SEGMENT_MAX) {
+        return (size - 1) / SIZE_CLASS_GRANULARITY;
+    }
+
+    size_t index = SIZE_CLASS_COUNT + floor_log2(size) - SMALL_SEGMENT_SHIFT;
+    return index < BIN_COUNT ? index : BIN_COUNT - 1;
+}
+
+static void bin_insert(HeapRegion* region, FreeSegment* segment) {
+    size_t index = bin_index(tag_size(segment->size));
+
+    segment->prev_segment = NULL;
+    segment->next_segment = region->bins[index];
+    if (region->bins[index] != NULL) {
+        region->bins[index]->prev_segment = segment;
+    }
+    region->bins[index] = segment;
+
+    region->bin_bitmap[index / 32] |= 1u << (index % 32);
+
+    heap_stats.free_bytes += tag_size(segment->size);
+    heap_stats.free_segments++;
+}
+
+static void bin_remove(HeapRegion* region, FreeSegment* segment) {
+    size_t index = bin_index(tag_size(segment->size));
+
+    if (segment->prev_segment != NULL) {
+        segment->prev_segment->next_segment = segment->next_segment;
+    } else {
+        region->bins[index] = segment->next_segment;
+    }
+    if (segment->next_segment != NULL) {
+        segment->next_segment->prev_segment = segment->prev_segment;
+    }
+
+    if (region->bins[index] == NULL) {
+        region->bin_bitmap[index / 32] &= ~(1u << (index % 32));
+    }
+
+    heap_stats.free_bytes -= tag_size(segment->size);
+    heap_stats.free_segments--;
+}
+
+// Returns the first non-empty bin at or above `index`, or BIN_COUNT.
+static size_t next_nonempty_bin(HeapRegion* region, size_t index) {
+    size_t word = index / 32;
+    if (word >= BIN_BITMAP_WORDS) {
+        return BIN_COUNT;
+    }
+
+    uint32_t bits = region->bin_bitmap[word] & (~0u << (index % 32));
+    while (bits == 0) {
+        word++;
+        if (word >= BIN_BITMAP_WORDS) {
+            return BIN_COUNT;
+        }
+        bits = region->bin_bitmap[word];
     }
 
-    uint32_t mmap_addr = mb_info->mmap_addr;
-    uint32_t mmap_length = mb_info->mmap_length;
-    
-    uint32_t current = mmap_addr;
-    uint32_t end = mmap_addr + mmap_length;
-    
-    uint32_t largest_region_addr = 0;
-    uint32_t largest_region_size = 0;
-    
-    while (current < end) {
-        struct memory_map_entry* entry = (struct memory_map_entry*)current;
-        
-        if (entry->type == 1 && entry->length_low > largest_region_size) {
-            if (entry->length_low >= HEAP_SIZE) {
-                largest_region_addr = entry->base_addr_low;
-                largest_region_size = entry->length_low;
+    return word * 32 + __builtin_ctz(bits);
+}
+
+static FreeSegment* find_free_segment(HeapRegion* region, size_t size) {
+    size_t index = bin_index(size);
+
+    // Large bins cover a range of sizes, so only part of this one may fit.
+    if (index >= SIZE_CLASS_COUNT) {
+        for (FreeSegment* segment = region->bins[index]; segment != NULL; segment = segment->next_segment) {
+            if (tag_size(segment->size) >= size) {
+                return segment;
             }
         }
-        
-        current += entry->size + 4;
+        index++;
     }
-    
-    if (largest_region_size == 0) {
-        return;
+
+    // Small bins are exact, and every segment in a higher bin is larger.
+    index = next_nonempty_bin(region, index);
+    return index < BIN_COUNT ? region->bins[index] : NULL;
+}
+
+static HeapRegion* region_of(void* ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+    for (uint32_t i = 0; i < heap_region_count; i++) {
+        if (addr >= heap_regions[i].start && addr < heap_regions[i].end) {
+            return &heap_regions[i];
+        }
     }
+    return NULL;
+}
 
-    uint32_t kernel_end_addr = (uint32_t)&kernel_end;
-    uint32_t esp = get_esp();
+// Turns [base, base + length) into a new region holding one free segment
+// framed by a used prologue tag and a used epilogue header, so coalescing
+// stops at the edges. Demand-paged memory already reads as zero and is only
+// touched where tags are written.
+static HeapRegion* heap_add_region(void* base, size_t length, bool demand_paged) {
+    if (heap_region_count >= HEAP_MAX_REGIONS) {
+        return NULL;
+    }
 
-    uint32_t reserved_end = kernel_end_addr > esp ? kernel_end_addr : esp;
+    uintptr_t region_start = (uintptr_t)base;
+    uintptr_t region_end = region_start + length;
 
-    if (largest_region_addr <= reserved_end && 
-        (largest_region_addr + largest_region_size) > reserved_end) {
-        uint32_t heap_start = reserved_end;
+    uintptr_t first = align_up(region_start + SEGMENT_TAG_SIZE + sizeof(UsedSegment), SEGMENT_ALIGN) - sizeof(UsedSegment);
+    size_t size = (region_end - SEGMENT_TAG_SIZE - first) & ~(size_t)(SEGMENT_ALIGN - 1);
 
-        heap_start = (heap_start + 7) & ~7;
+    HeapRegion* region = &heap_regions[heap_region_count++];
+    memset(region, 0, sizeof(HeapRegion));
+    region->start = region_start;
+    region->end = region_end;
+    region->demand_paged = demand_paged;
 
-        FreeSegment* initial_segment = (FreeSegment*)heap_start;
-        initial_segment->size = largest_region_size - (heap_start - largest_region_addr) - sizeof(FreeSegment);
-        initial_segment->next_segment = NULL;
+    if (!demand_paged) {
+        memset(base, 0, length);
+        heap_stats.committed_bytes += length;
+    }
+    region->fresh_watermark = first;
+
+    *(size_t*)(first - SEGMENT_TAG_SIZE) = SEGMENT_USED;
+    *(size_t*)(first + size) = SEGMENT_USED;
+
+    set_segment_tags((void*)first, size, 0);
+    bin_insert(region, (FreeSegment*)first);
+
+    heap_stats.heap_bytes += size;
+    return region;
+}
+
+// Takes another block from the page allocator, big enough for a segment of
+// `segment_size` bytes. Falls back to smaller blocks when memory is short.
+static HeapRegion* heap_grow(size_t segment_size) {
+    size_t overhead = 2 * SEGMENT_TAG_SIZE + SEGMENT_ALIGN;
+    uint32_t min_order = page_order_for_size(segment_size + overhead);
+    if (((size_t)PAGE_SIZE << min_order) < segment_size + overhead) {
+        return NULL;
+    }
+
+    uint32_t order = page_order_for_size(HEAP_SIZE);
+    if (order < min_order) {
+        order = min_order;
+    }
+
+    for (;;) {
+        void* memory = alloc_pages(order);
+        if (memory != NULL) {
+            HeapRegion* region = heap_add_region(memory, (size_t)PAGE_SIZE << order, false);
+            if (region == NULL) {
+                free_pages(memory, order);
+            }
+            return region;
+        }
+        if (order == min_order) {
+            return NULL;
+        }
+        order--;
+    }
+}
 
-        atomic_store_FreeSegment_ptr((FreeSegment* volatile*)&first_free, initial_segment);
+static inline size_t segment_size_for(size_t size) {
+    size_t needed = align_up(size + SEGMENT_OVERHEAD, SEGMENT_ALIGN);
+    return needed < MIN_SEGMENT_SIZE ? MIN_SEGMENT_SIZE : needed;
+}
+
+// Called whenever a used segment now ends at `segment_end`.
+static inline void advance_fresh_watermark(HeapRegion* region, uintptr_t segment_end) {
+    if (segment_end > region->fresh_watermark) {
+        region->fresh_watermark = segment_end;
     }
 }
 
-void* allocate(size_t size, size_t alignment) {
+#ifdef MEMORY_PROFILE
+// A macro so the return address is taken in the public entry point.
+#define PROFILE_ALLOC(ptr, size) heap_profile_alloc((ptr), (size), __builtin_return_address(0))
+#define PROFILE_FREE(segment) memory_profile_record_free(&((UsedSegment*)(segment))->profile)
+
+static void heap_profile_alloc(void* ptr, size_t size, const void* caller) {
+    if (ptr != NULL) {
+        UsedSegment* segment = (UsedSegment*)((uint8_t*)ptr - sizeof(UsedSegment));
+        memory_profile_record_alloc(&segment->profile, caller, size);
+    }
+}
+#else
+#define PROFILE_ALLOC(ptr, size) ((void)0)
+#define PROFILE_FREE(segment) ((void)0)
+#endif
+
+static void add_live_bytes(size_t bytes) {
+    heap_stats.live_bytes += bytes;
+    if (heap_stats.live_bytes > heap_stats.peak_live_bytes) {
+        heap_stats.peak_live_bytes = heap_stats.live_bytes;
+    }
+}
+
+static void record_allocation(size_t request_size, size_t segment_size) {
+    uint32_t bucket = request_size < 16 ? 0 : floor_log2(request_size) - 3;
+    if (bucket >= MEMORY_HISTOGRAM_BUCKETS) {
+        bucket = MEMORY_HISTOGRAM_BUCKETS - 1;
+    }
+
+    heap_stats.allocations++;
+    heap_stats.size_histogram[bucket]++;
+    add_live_bytes(segment_size);
+}
+
+void init_early_allocator(void) {
+    if (heap_region_count != 0) {
+        return;
+    }
+
+    heap_stats = (MemoryStats){0};
+    heap_add_region(early_heap_area, sizeof(early_heap_area), false);
+}
+
+void init_allocator(void) {
+    init_early_allocator();
+
+    if (paging_enabled() && paging_add_demand_range(HEAP_VIRTUAL_BASE, HEAP_VIRTUAL_SIZE) == 0) {
+        heap_add_region((void*)(uintptr_t)HEAP_VIRTUAL_BASE, HEAP_VIRTUAL_SIZE, true);
+        return;
+    }
+
+    if (heap_grow(0) == NULL) {
+        output_string("Heap: page allocator could not provide heap memory\n");
+    }
+}
+
+// Carves a used segment of `needed` bytes with the requested data alignment
+// out of the first region that has room. On success, *fresh_from is where
+// that region's never-used memory started before the allocation.
+static void* heap_allocate(size_t size, size_t alignment, uintptr_t* fresh_from) {
     if (size == 0) {
         return NULL;
     }
 
-    size_t total_size = sizeof(UsedSegment) + size;
+    if (alignment < SEGMENT_ALIGN) {
+        alignment = SEGMENT_ALIGN;
+    }
 
-    FreeSegment* prev = NULL;
-    FreeSegment* current = atomic_load_FreeSegment_ptr((FreeSegment* volatile*)&first_free);
-    
-    while (current != NULL) {
-        uint32_t segment_end = (uint32_t)current + sizeof(FreeSegment) + current->size;
+    size_t needed = segment_size_for(size);
 
-        uint32_t aligned_data_ptr = (segment_end - size) & ~(alignment - 1);
+    // Over-aligned requests may need to split off a leading free segment.
+    size_t search_size = needed;
+    if (alignment > SEGMENT_ALIGN) {
+        search_size = needed + alignment + MIN_SEGMENT_SIZE;
+    }
 
-        uint32_t header_ptr = aligned_data_ptr - sizeof(UsedSegment);
+    HeapRegion* region = NULL;
+    FreeSegment* segment = NULL;
+    for (uint32_t i = 0; i < heap_region_count && segment == NULL; i++) {
+        region = &heap_regions[i];
+        segment = find_free_segment(region, search_size);
+    }
 
-        uint32_t data_start = (uint32_t)current + sizeof(FreeSegment);
-        
-        if (header_ptr >= data_start) {
-            size_t full_alloc_size = (segment_end - header_ptr);
+    if (segment == NULL && heap_region_count > 0) {
+        region = heap_grow(search_size);
+        if (region != NULL) {
+            segment = find_free_segment(region, search_size);
+        }
+    }
 
-            if (full_alloc_size <= current->size) {
-                UsedSegment* used_header = (UsedSegment*)header_ptr;
-                used_header->size = full_alloc_size; 
+    if (segment == NULL) {
+        heap_stats.failed_allocations++;
+        return NULL;
+    }
 
-                size_t remaining_size = current->size - full_alloc_size;
-                
-                if (remaining_size == 0) {
-                    if (prev == NULL) {
-                        atomic_store_FreeSegment_ptr((FreeSegment* volatile*)&first_free, current->next_segment);
-                    } else {
-                        prev->next_segment = current->next_segment;
-                    }
-                } else if (remaining_size < sizeof(FreeSegment)) {
-                    current->size = current->size - full_alloc_size;
-                } else {
-                    current->size = current->size - full_alloc_size;
-                }
-                
-                return (void*)aligned_data_ptr;
-            }
+    *fresh_from = region->fresh_watermark + sizeof(FreeSegment);
+    bin_remove(region, segment);
+
+    uint8_t* start = (uint8_t*)segment;
+    size_t available = tag_size(segment->size);
+
+    if (alignment > SEGMENT_ALIGN) {
+        uintptr_t data_ptr = align_up((uintptr_t)start + sizeof(UsedSegment), alignment);
+        size_t gap = data_ptr - sizeof(UsedSegment) - (uintptr_t)start;
+        while (gap != 0 && gap < MIN_SEGMENT_SIZE) {
+            gap += alignment;
+        }
+
+        if (gap != 0) {
+            set_segment_tags(start, gap, 0);
+            bin_insert(region, (FreeSegment*)start);
+            start += gap;
+            available -= gap;
         }
-        
-        prev = current;
-        current = current->next_segment;
     }
-    
-    return NULL;
+
+    size_t remaining = available - needed;
+    if (remaining >= MIN_SEGMENT_SIZE) {
+        FreeSegment* rest = (FreeSegment*)(start + needed);
+        set_segment_tags(rest, remaining, 0);
+        bin_insert(region, rest);
+    } else {
+        needed = available;
+    }
+
+    set_segment_tags(start, needed, SEGMENT_USED);
+    record_allocation(size, needed);
+    advance_fresh_watermark(region, (uintptr_t)start + needed);
+    return start + sizeof(UsedSegment);
 }
 
-static bool segments_adjacent(FreeSegment* first, FreeSegment* second) {
-    uint32_t first_end = (uint32_t)first + sizeof(FreeSegment) + first->size;
-    return (uint32_t)second == first_end;
+void* allocate(size_t size, size_t alignment) {
+    uintptr_t fresh_from;
+    HEAP_LOCK();
+    void* ptr = heap_allocate(size, alignment, &fresh_from);
+    PROFILE_ALLOC(ptr, size);
+    HEAP_UNLOCK();
+    return ptr;
 }
 
-static FreeSegment* merge_adjacent(FreeSegment* first, FreeSegment* second) {
-    if (segments_adjacent(first, second)) {
-        first->size = (uint32_t)second + sizeof(FreeSegment) + second->size - ((uint32_t)first + sizeof(FreeSegment));
-        first->next_segment = second->next_segment;
-        return first;
+// Hands back the frames of whole pages inside a free segment, limited to the
+// block just freed plus the tags it absorbed. The segment's own header and
+// footer stay committed, so the bins never fault.
+static void release_free_pages(uintptr_t segment, size_t size, uintptr_t freed_start, uintptr_t freed_end) {
+    uintptr_t start = freed_start - SEGMENT_TAG_SIZE;
+    uintptr_t end = freed_end + sizeof(FreeSegment);
+
+    if (start < segment + sizeof(FreeSegment)) {
+        start = segment + sizeof(FreeSegment);
+    }
+    if (end > segment + size - SEGMENT_TAG_SIZE) {
+        end = segment + size - SEGMENT_TAG_SIZE;
+    }
+
+    start = align_up(start, PAGE_SIZE);
+    end &= ~(uintptr_t)(PAGE_SIZE - 1);
+    if (end > start) {
+        paging_decommit((uint32_t)start, (uint32_t)(end - start));
     }
-    return first;
 }
 
-void deallocate(void* ptr) {
+static void heap_free(void* ptr) {
     if (ptr == NULL) {
         return;
     }
-    
-    UsedSegment* used_header = (UsedSegment*)((uint8_t*)ptr - sizeof(UsedSegment));
 
-    size_t total_size = used_header->size;
+    uint8_t* segment = (uint8_t*)ptr - sizeof(UsedSegment);
+    size_t tag = *(size_t*)segment;
 
-    FreeSegment* freed_block = (FreeSegment*)used_header;
-    freed_block->size = total_size - sizeof(UsedSegment);
-    freed_block->next_segment = NULL;
+    if (!tag_used(tag)) {
+        output_string("deallocate: segment at ");
+        put_hex((uint32_t)(uintptr_t)segment);
+        output_string(" is already free\n");
+        return;
+    }
 
-    FreeSegment* prev = NULL;
-    FreeSegment* current = atomic_load_FreeSegment_ptr((FreeSegment* volatile*)&first_free);
-    
-    while (current != NULL && (uint32_t)current < (uint32_t)freed_block) {
-        prev = current;
-        current = current->next_segment;
+    HeapRegion* region = region_of(segment);
+    if (region == NULL) {
+        output_string("deallocate: ");
+        put_hex((uint32_t)(uintptr_t)ptr);
+        output_string(" is not a heap pointer\n");
+        return;
     }
-    
-    freed_block->next_segment = current;
-    if (prev == NULL) {
-        atomic_store_FreeSegment_ptr((FreeSegment* volatile*)&first_free, freed_block);
-    } else {
-        prev->next_segment = freed_block;
+
+    size_t size = tag_size(tag);
+    uintptr_t freed_start = (uintptr_t)segment;
+    uintptr_t freed_end = freed_start + size;
+
+    PROFILE_FREE(segment);
+    heap_stats.frees++;
+    heap_stats.live_bytes -= size;
+
+    // Merge with the following segment
+    size_t next_tag = *(size_t*)(segment + size);
+    if (!tag_used(next_tag)) {
+        bin_remove(region, (FreeSegment*)(segment + size));
+        size += tag_size(next_tag);
+    }
+
+    // Merge with the preceding segment, found through its footer
+    size_t prev_tag = *(size_t*)(segment - SEGMENT_TAG_SIZE);
+    if (!tag_used(prev_tag)) {
+        segment -= tag_size(prev_tag);
+        bin_remove(region, (FreeSegment*)segment);
+        size += tag_size(prev_tag);
     }
-    
-    if (current != NULL && segments_adjacent(freed_block, current)) {
-        freed_block->size = freed_block->size + sizeof(FreeSegment) + current->size;
-        freed_block->next_segment = current->next_segment;
+
+    set_segment_tags(segment, size, 0);
+    bin_insert(region, (FreeSegment*)segment);
+
+    if (region->demand_paged && freed_end - freed_start >= HEAP_RELEASE_THRESHOLD) {
+        release_free_pages((uintptr_t)segment, size, freed_start, freed_end);
     }
+}
+
+void deallocate(void* ptr) {
+    HEAP_LOCK();
+    heap_free(ptr);
+    HEAP_UNLOCK();
+}
 
-    if (prev != NULL && segments_adjacent(prev, freed_block)) {
-        prev->size = prev->size + sizeof(FreeSegment) + freed_block->size;
-        prev->next_segment = freed_block->next_segment;
+// Trims a used segment to `needed` bytes and frees the tail, merging it with
+// a free segment that follows.
+static void shrink_segment(HeapRegion* region, uint8_t* segment, size_t size, size_t needed) {
+    size_t tail_size = size - needed;
+    uint8_t* tail = segment + needed;
+
+    size_t next_tag = *(size_t*)(segment + size);
+    if (!tag_used(next_tag)) {
+        bin_remove(region, (FreeSegment*)(segment + size));
+        tail_size += tag_size(next_tag);
     }
+
+    set_segment_tags(segment, needed, SEGMENT_USED);
+    set_segment_tags(tail, tail_size, 0);
+    bin_insert(region, (FreeSegment*)tail);
+
+    heap_stats.live_bytes -= size - needed;
 }
 
+static void* heap_reallocate(void* ptr, size_t size) {
+    uintptr_t fresh_from;
+
+    if (ptr == NULL) {
+        return heap_allocate(size, SEGMENT_ALIGN, &fresh_from);
+    }
+
+    if (size == 0) {
+        heap_free(ptr);
+        return NULL;
+    }
+
+    uint8_t* segment = (uint8_t*)ptr - sizeof(UsedSegment);
+    HeapRegion* region = region_of(segment);
+    if (region == NULL || !tag_used(*(size_t*)segment)) {
+        output_string("reallocate: ");
+        put_hex((uint32_t)(uintptr_t)ptr);
+        output_string(" is not an allocated heap block\n");
+        return NULL;
+    }
+
+    size_t current = tag_size(*(size_t*)segment);
+    size_t needed = segment_size_for(size);
+
+    if (needed <= current) {
+        if (current - needed >= MIN_SEGMENT_SIZE) {
+            shrink_segment(region, segment, current, needed);
+        }
+        return ptr;
+    }
+
+    // Grow into the following segment when it is free and large enough.
+    size_t next_tag = *(size_t*)(segment + current);
+    if (!tag_used(next_tag) && current + tag_size(next_tag) >= needed) {
+        size_t combined = current + tag_size(next_tag);
+        bin_remove(region, (FreeSegment*)(segment + current));
+
+        if (combined - needed >= MIN_SEGMENT_SIZE) {
+            FreeSegment* rest = (FreeSegment*)(segment + needed);
+            set_segment_tags(rest, combined - needed, 0);
+            bin_insert(region, rest);
+        } else {
+            needed = combined;
+        }
+
+        set_segment_tags(segment, needed, SEGMENT_USED);
+        add_live_bytes(needed - current);
+        advance_fresh_watermark(region, (uintptr_t)segment + needed);
+        return ptr;
+    }
+
+    void* moved = heap_allocate(size, SEGMENT_ALIGN, &fresh_from);
+    if (moved == NULL) {
+        return NULL;
+    }
+
+    memcpy(moved, ptr, current - SEGMENT_OVERHEAD);
+    heap_free(ptr);
+    return moved;
+}
+
+void* reallocate(void* ptr, size_t size) {
+    HEAP_LOCK();
+    void* result = heap_reallocate(ptr, size);
+    if (result != ptr) {
+        PROFILE_ALLOC(result, size);
+    }
+    HEAP_UNLOCK();
+    return result;
+}
+
+static void* heap_allocate_zeroed(size_t count, size_t size) {
+    if (size != 0 && count > (size_t)-1 / size) {
+        heap_stats.failed_allocations++;
+        return NULL;
+    }
+
+    size_t total = count * size;
+    uintptr_t fresh_from;
+
+    uint8_t* ptr = (uint8_t*)heap_allocate(total, SEGMENT_ALIGN, &fresh_from);
+    if (ptr == NULL) {
+        return NULL;
+    }
+
+    // Only the part below the old watermark can hold stale data.
+    uintptr_t start = (uintptr_t)ptr;
+    uintptr_t end = start + total;
+    if (end > fresh_from) {
+        end = fresh_from > start ? fresh_from : start;
+    }
+    memset(ptr, 0, end - start);
+
+    return ptr;
+}
+
+void* allocate_zeroed(size_t count, size_t size) {
+    HEAP_LOCK();
+    void* ptr = heap_allocate_zeroed(count, size);
+    PROFILE_ALLOC(ptr, count * size);
+    HEAP_UNLOCK();
+    return ptr;
+}
+
+// The wrappers repeat the public entry points instead of calling them so the
+// profiler sees the wrapper's caller.
 void* malloc(size_t size) {
-    return allocate(size, 8);
+    uintptr_t fresh_from;
+    HEAP_LOCK();
+    void* ptr = heap_allocate(size, 8, &fresh_from);
+    PROFILE_ALLOC(ptr, size);
+    HEAP_UNLOCK();
+    return ptr;
 }
 
 void free(void* ptr) {
     deallocate(ptr);
 }
 
+void* realloc(void* ptr, size_t size) {
+    HEAP_LOCK();
+    void* result = heap_reallocate(ptr, size);
+    if (result != ptr) {
+        PROFILE_ALLOC(result, size);
+    }
+    HEAP_UNLOCK();
+    return result;
+}
+
+void* calloc(size_t count, size_t size) {
+    HEAP_LOCK();
+    void* ptr = heap_allocate_zeroed(count, size);
+    PROFILE_ALLOC(ptr, count * size);
+    HEAP_UNLOCK();
+    return ptr;
+}
+
 void debug_print_free_list() {
-    FreeSegment* current = atomic_load_FreeSegment_ptr((FreeSegment* volatile*)&first_free);
-    int index = 0;
-    
-    if (current == NULL) {
-        output_string("Free list is empty\\n");
-        return;
+    bool empty = true;
+
+    for (uint32_t r = 0; r < heap_region_count; r++) {
+        for (size_t i = 0; i < BIN_COUNT; i++) {
+            for (FreeSegment* current = heap_regions[r].bins[i]; current != NULL; current = current->next_segment) {
+                uint32_t start_addr = (uint32_t)(uintptr_t)current;
+                uint32_t end_addr = start_addr + tag_size(current->size);
+
+                output_string("region ");
+                put_u32(r);
+                output_string(" bin ");
+                put_u32(i);
+                output_string(" ");
+                put_hex(start_addr);
+                output_string(": ");
+                put_hex(end_addr);
+                output_string(", FreeSegment { size: ");
+                put_u32(tag_size(current->size));
+                output_string(" }\n");
+
+                empty = false;
+            }
+        }
     }
-    
-    while (current != NULL) {
-        uint32_t start_addr = (uint32_t)current;
-        uint32_t end_addr = start_addr + sizeof(FreeSegment) + current->size;
-        
-        put_hex(start_addr);
-        output_string(": ");
-        put_hex(end_addr);
-        output_string(", FreeSegment { size: ");
-        put_u32(current->size);
-        output_string(", next_segment: ");
-        
-        if (current->next_segment) {
-            put_hex((uint32_t)current->next_segment);
-        } else {
-            output_string("0x0");
+
+    if (empty) {
+        output_string("Free list is empty\n");
+    }
+}
+
+void memory_get_stats(MemoryStats* stats) {
+    HEAP_LOCK();
+    *stats = heap_stats;
+    stats->regions = heap_region_count;
+    stats->committed_bytes += paging_demand_committed_bytes();
+
+    // Every segment in a higher bin is larger, so only the highest non-empty
+    // bin of each region needs to be scanned.
+    stats->largest_free_block = 0;
+    for (uint32_t r = 0; r < heap_region_count; r++) {
+        HeapRegion* region = &heap_regions[r];
+        for (size_t i = BIN_COUNT; i > 0; i--) {
+            if (region->bins[i - 1] != NULL) {
+                for (FreeSegment* segment = region->bins[i - 1]; segment != NULL; segment = segment->next_segment) {
+                    if (tag_size(segment->size) > stats->largest_free_block) {
+                        stats->largest_free_block = tag_size(segment->size);
+                    }
+                }
+                break;
+            }
         }
-        output_string(" }\\n");
-        
-        current = current->next_segment;
-        index++;
     }
-}
\ No newline at end of file
+
+    stats->fragmentation = 0;
+    if (stats->free_bytes >= 100) {
+        stats->fragmentation = 100 - stats->largest_free_block / (stats->free_bytes / 100);
+        if (stats->fragmentation > 100) {
+            stats->fragmentation = 0;
+        }
+    }
+    HEAP_UNLOCK();
+}
+
+void memory_dump_stats(void) {
+    MemoryStats stats;
+    memory_get_stats(&stats);
+
+    output_string("heap: allocs=");
+    put_u32(stats.allocations);
+    output_string(" frees=");
+    put_u32(stats.frees);
+    output_string(" failed=");
+    put_u32(stats.failed_allocations);
+    output_string(" regions=");
+    put_u32(stats.regions);
+    output_string(" heap=");
+    put_u32(stats.heap_bytes);
+    output_string(" committed=");
+    put_u32(stats.committed_bytes);
+    output_string(" live=");
+    put_u32(stats.live_bytes);
+    output_string(" peak=");
+    put_u32(stats.peak_live_bytes);
+    output_string(" free=");
+    put_u32(stats.free_bytes);
+    output_string("/");
+    put_u32(stats.free_segments);
+    output_string(" largest=");
+    put_u32(stats.largest_free_block);
+    output_string(" frag=");
+    put_u32(stats.fragmentation);
+    output_string("% hist=");
+    for (uint32_t i = 0; i < MEMORY_HISTOGRAM_BUCKETS; i++) {
+        if (i > 0) {
+            output_string("/");
+        }
+        put_u32(stats.size_histogram[i]);
+    }
+    output_string("\n");
+}
@@ -3,37 +3,131 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include "memory_profile.h"
 
 #ifndef offsetof
 #define offsetof(TYPE, MEMBER) ((size_t) &((TYPE *)0)->MEMBER)
 #endif
 
-#define HEAP_SIZE 2 * 1024 * 1024
+// The heap is a list of disjoint regions, each with its own bins. A small
+// static region serves allocations before the page allocator is up; after
+// that the heap grows by taking HEAP_SIZE blocks from the page allocator.
+#define HEAP_SIZE (2 * 1024 * 1024)
+#define EARLY_HEAP_SIZE (64 * 1024)
+#define HEAP_MAX_REGIONS 16
+
+// With paging on, the main region is a demand-paged virtual range: frames
+// are committed on first touch, and whole free pages inside free segments
+// go back to the page allocator once a free of at least
+// HEAP_RELEASE_THRESHOLD bytes leaves them unused.
+#define HEAP_VIRTUAL_BASE 0xC0000000
+#define HEAP_VIRTUAL_SIZE (256 * 1024 * 1024)
+#define HEAP_RELEASE_THRESHOLD (16 * 1024)
+
+// Free segments are kept in bins. Segments up to SMALL_SEGMENT_MAX bytes go
+// to exact-size bins spaced SIZE_CLASS_GRANULARITY bytes apart; larger ones
+// go to one bin per power of two. Sizes are total segment sizes, boundary
+// tags included.
+#define SIZE_CLASS_GRANULARITY 8
+#define SIZE_CLASS_COUNT 64
+#define SMALL_SEGMENT_MAX (SIZE_CLASS_GRANULARITY * SIZE_CLASS_COUNT)
+#define LARGE_BIN_COUNT 23
+#define BIN_COUNT (SIZE_CLASS_COUNT + LARGE_BIN_COUNT)
 
 extern uint32_t kernel_start;
 extern uint32_t kernel_end;
 
+// Every segment starts with its size and ends with a copy of it (the
+// boundary tag), so both physical neighbours can be found in O(1). Sizes are
+// multiples of 8; bit 0 of the tag marks the segment as in use.
+#define SEGMENT_USED 0x1
+
 typedef struct FreeSegment {
     size_t size;
     struct FreeSegment* next_segment;
+    struct FreeSegment* prev_segment;
 } FreeSegment;
 
 typedef struct UsedSegment {
     size_t size;
+#ifdef MEMORY_PROFILE
+    MemoryProfileTag profile;
+#else
     char padding[offsetof(struct FreeSegment, next_segment) - sizeof(size_t)];
+#endif
 } UsedSegment;
 
-void init_allocator(uint32_t multiboot_info_ptr);
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    // Heap memory is zeroed when the region is added. Everything from the
+    // watermark upwards has never been handed out, so it is still zero apart
+    // from the free segment header sitting at the watermark itself.
+    uintptr_t fresh_watermark;
+    bool demand_paged;
+    // Unordered, doubly linked free lists, one per bin, plus a bitmap of the
+    // non-empty bins so the first usable bin is found without walking them.
+    FreeSegment* bins[BIN_COUNT];
+    uint32_t bin_bitmap[(BIN_COUNT + 31) / 32];
+} HeapRegion;
+
+// Request-size histogram: bucket i counts requests below 2^(i + 4) bytes,
+// the last bucket everything larger.
+#define MEMORY_HISTOGRAM_BUCKETS 16
+
+typedef struct {
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failed_allocations;
+    uint32_t regions;
+    size_t heap_bytes;
+    size_t committed_bytes;     // Heap memory backed by physical frames
+    size_t live_bytes;          // Bytes in used segments, tags included
+    size_t peak_live_bytes;
+    size_t free_bytes;
+    uint32_t free_segments;
+    size_t largest_free_block;
+    uint32_t fragmentation;     // 0-100: share of free memory outside the largest block
+    uint32_t size_histogram[MEMORY_HISTOGRAM_BUCKETS];
+} MemoryStats;
+
+// The hosted build (make hosted-bench) links the allocator into a Linux
+// process next to libc, so the kernel's entry points get their own names.
+#ifdef SHOGUN_HOSTED
+#define malloc kernel_malloc
+#define free kernel_free
+#define realloc kernel_realloc
+#define calloc kernel_calloc
+#endif
+
+// Brings up the static early region. Safe to call more than once.
+void init_early_allocator(void);
+
+// Adds the first page-allocator-backed region; needs init_page_allocator.
+void init_allocator(void);
 
 void* allocate(size_t size, size_t alignment);
 
 void deallocate(void* ptr);
 
+// Resizes in place when the block can shrink or the segment after it is
+// free, and moves it otherwise. Blocks come back with malloc's alignment.
+void* reallocate(void* ptr, size_t size);
+
+// Zeroes only the part of the block that was handed out before.
+void* allocate_zeroed(size_t count, size_t size);
+
 void* malloc(size_t size);
 void free(void* ptr);
+void* realloc(void* ptr, size_t size);
+void* calloc(size_t count, size_t size);
 
 void debug_print_free_list();
 
+void memory_get_stats(MemoryStats* stats);
+void memory_dump_stats(void);
+
 uint32_t get_esp();
 
-#endif
\ No newline at end of file
+#endif
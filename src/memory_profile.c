@@ -0,0 +1,184 @@
+#include "memory_profile.h"
+
+#ifdef MEMORY_PROFILE
+
+#include "io.h"
+#include "terminal.h"
+#include "spinlock.h"
+
+#define PROFILE_HASH_SHIFT (32 - 8)
+#define PROFILE_OVERFLOW_SITE MEMORY_PROFILE_SITES
+
+_Static_assert(MEMORY_PROFILE_SITES == 1 << (32 - PROFILE_HASH_SHIFT),
+               "the hash shift must match the site table size");
+
+// Open addressing with linear probing on the caller address. Sites are
+// never removed, so once the table fills up, new callers share the overflow
+// entry at the end.
+static MemoryProfileSite profile_sites[MEMORY_PROFILE_SITES + 1];
+static uint32_t profile_site_count;
+
+// Recording runs under the heap lock or a slab cache's lock, which CPUs can
+// hold at the same time.
+#ifdef SHOGUN_HOSTED
+#define PROFILE_LOCK() ((void)0)
+#define PROFILE_UNLOCK() ((void)0)
+#else
+static Spinlock profile_lock = SPINLOCK_INIT;
+#define PROFILE_LOCK() spin_lock(&profile_lock)
+#define PROFILE_UNLOCK() spin_unlock(&profile_lock)
+#endif
+
+static inline uint32_t profile_hash(uintptr_t caller) {
+    return ((uint32_t)(caller >> 2) * 2654435761u) >> PROFILE_HASH_SHIFT;
+}
+
+static uint32_t profile_site_index(uintptr_t caller) {
+    uint32_t index = profile_hash(caller);
+
+    for (uint32_t probe = 0; probe < MEMORY_PROFILE_SITES; probe++) {
+        MemoryProfileSite* site = &profile_sites[index];
+        if (site->caller == caller) {
+            return index;
+        }
+        if (site->caller == 0) {
+            site->caller = caller;
+            profile_site_count++;
+            return index;
+        }
+        index = (index + 1) & (MEMORY_PROFILE_SITES - 1);
+    }
+
+    return PROFILE_OVERFLOW_SITE;
+}
+
+void memory_profile_record_alloc(MemoryProfileTag* tag, const void* caller, size_t size) {
+    PROFILE_LOCK();
+    uint32_t index = profile_site_index((uintptr_t)caller);
+    MemoryProfileSite* site = &profile_sites[index];
+
+    site->allocations++;
+    site->bytes += size;
+    PROFILE_UNLOCK();
+
+    tag->site = index;
+    tag->birth = read_tsc();
+}
+
+void memory_profile_record_free(const MemoryProfileTag* tag) {
+    if (tag->site > PROFILE_OVERFLOW_SITE) {
+        return;
+    }
+
+    MemoryProfileSite* site = &profile_sites[tag->site];
+    uint64_t lifetime = read_tsc() - tag->birth;
+
+    PROFILE_LOCK();
+    site->frees++;
+    site->lifetime_cycles += lifetime;
+    if (lifetime > site->max_lifetime_cycles) {
+        site->max_lifetime_cycles = lifetime;
+    }
+    PROFILE_UNLOCK();
+}
+
+bool memory_profile_find_site(uintptr_t start, uintptr_t end, MemoryProfileSite* site) {
+    bool found = false;
+
+    for (uint32_t i = 0; i < MEMORY_PROFILE_SITES; i++) {
+        MemoryProfileSite* candidate = &profile_sites[i];
+        if (candidate->caller < start || candidate->caller >= end) {
+            continue;
+        }
+        if (!found || candidate->allocations > site->allocations) {
+            *site = *candidate;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+void memory_profile_reset(void) {
+    for (uint32_t i = 0; i <= MEMORY_PROFILE_SITES; i++) {
+        profile_sites[i] = (MemoryProfileSite){0};
+    }
+    profile_site_count = 0;
+}
+
+// The kernel is linked without libgcc, so avoid 64-bit division.
+static uint32_t profile_average(uint64_t total, uint32_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    while ((total >> 32) != 0 && count > 1) {
+        total >>= 1;
+        count >>= 1;
+    }
+    if ((total >> 32) != 0) {
+        return 0xFFFFFFFF;
+    }
+    return (uint32_t)total / count;
+}
+
+// Totals that do not fit put_u32 print in units of 2^20.
+static void profile_put_total(uint64_t value) {
+    if ((value >> 32) == 0) {
+        put_u32((uint32_t)value);
+    } else {
+        put_u32((uint32_t)(value >> 20));
+        output_string("M");
+    }
+}
+
+static void profile_print_site(const MemoryProfileSite* site) {
+    output_string("  ");
+    if (site->caller != 0) {
+        put_hex((uint32_t)site->caller);
+    } else {
+        output_string("(other)");
+    }
+    output_string(" allocs=");
+    put_u32(site->allocations);
+    output_string(" frees=");
+    put_u32(site->frees);
+    output_string(" bytes=");
+    profile_put_total(site->bytes);
+    output_string(" avg_life=");
+    put_u32(profile_average(site->lifetime_cycles, site->frees));
+    output_string(" max_life=");
+    profile_put_total(site->max_lifetime_cycles);
+    output_string("\n");
+}
+
+void memory_profile_dump(uint32_t count) {
+    output_string("heap profile: ");
+    put_u32(profile_site_count);
+    output_string(" sites, lifetimes in cycles\n");
+
+    // Selection by allocation count. The table is small and this runs once,
+    // so a scan per printed row is fine and avoids touching the heap.
+    bool printed[MEMORY_PROFILE_SITES] = {false};
+    for (uint32_t row = 0; row < count; row++) {
+        int32_t best = -1;
+        for (uint32_t i = 0; i < MEMORY_PROFILE_SITES; i++) {
+            if (printed[i] || profile_sites[i].allocations == 0) {
+                continue;
+            }
+            if (best < 0 || profile_sites[i].allocations > profile_sites[best].allocations) {
+                best = (int32_t)i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        printed[best] = true;
+        profile_print_site(&profile_sites[best]);
+    }
+
+    if (profile_sites[PROFILE_OVERFLOW_SITE].allocations != 0) {
+        profile_print_site(&profile_sites[PROFILE_OVERFLOW_SITE]);
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef MEMORY_PROFILE_H
+#define MEMORY_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Allocation-site profiling, built with `make PROFILE=1` (-DMEMORY_PROFILE).
+// Every heap and slab allocation is tagged with the return address of its
+// caller, and counts, requested bytes and lifetimes are aggregated per site
+// in a fixed table. Without the flag the tags and hooks compile away.
+#define MEMORY_PROFILE_SITES 256
+#define MEMORY_PROFILE_TOP_N 16
+
+#ifdef MEMORY_PROFILE
+
+// Stored with each live allocation: in the used segment header for the
+// heap, after the object for slab caches.
+typedef struct {
+    uint32_t site;      // Index into the site table
+    uint64_t birth;     // TSC at allocation
+} MemoryProfileTag;
+
+typedef struct {
+    uintptr_t caller;           // 0 for the overflow entry
+    uint32_t allocations;
+    uint32_t frees;
+    uint64_t bytes;             // Requested bytes over all allocations
+    uint64_t lifetime_cycles;   // Summed over freed allocations
+    uint64_t max_lifetime_cycles;
+} MemoryProfileSite;
+
+void memory_profile_record_alloc(MemoryProfileTag* tag, const void* caller, size_t size);
+
+void memory_profile_record_free(const MemoryProfileTag* tag);
+
+// Finds the busiest site whose call instruction lies in [start, end), such
+// as the body of one function.
+bool memory_profile_find_site(uintptr_t start, uintptr_t end, MemoryProfileSite* site);
+
+// Prints the `count` sites with the most allocations. Resolve the caller
+// addresses with addr2line -e bin/kernel.
+void memory_profile_dump(uint32_t count);
+
+void memory_profile_reset(void);
+
+#else
+
+static inline void memory_profile_dump(uint32_t count) {
+    (void)count;
+}
+
+static inline void memory_profile_reset(void) {
+}
+
+#endif
+
+#endif
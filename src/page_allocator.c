@@ -0,0 +1,386 @@
+#include "page_allocator.h"
+#include "multiboot.h"
+#include "memory.h"
+#include "terminal.h"
+#include "thread.h"
+#include "spinlock.h"
+#include <stdbool.h>
+
+#define MULTIBOOT_FLAG_CMDLINE   (1 << 2)
+#define MULTIBOOT_FLAG_MODS      (1 << 3)
+#define MULTIBOOT_FLAG_MMAP      (1 << 6)
+#define MULTIBOOT_FLAG_LOADER    (1 << 9)
+
+#define MMAP_TYPE_AVAILABLE 1
+
+// The free lists are shared by kernel threads and by every CPU; keep the
+// running thread on the CPU while it holds the lock.
+#ifdef SHOGUN_HOSTED
+#define PAGE_LOCK() ((void)0)
+#define PAGE_UNLOCK() ((void)0)
+#else
+static Spinlock page_lock = SPINLOCK_INIT;
+#define PAGE_LOCK() (preempt_disable(), spin_lock(&page_lock))
+#define PAGE_UNLOCK() (spin_unlock(&page_lock), preempt_enable())
+#endif
+
+#define LOW_MEMORY_END 0x100000
+
+typedef struct {
+    uint32_t mod_start;
+    uint32_t mod_end;
+    uint32_t string;
+    uint32_t reserved;
+} MultibootModule;
+
+static FreePageBlock* free_lists[PAGE_ZONE_COUNT][PAGE_MAX_ORDER + 1];
+static uint32_t zone_free_count[PAGE_ZONE_COUNT];
+
+// One state byte per frame between base_pfn and end_pfn.
+static uint8_t* frame_state = NULL;
+static uint32_t base_pfn = 0;
+static uint32_t end_pfn = 0;
+
+static PageRange usable_regions[PAGE_MAX_REGIONS];
+static uint32_t usable_region_count = 0;
+
+static PageRange reserved_ranges[PAGE_MAX_RESERVED];
+static uint32_t reserved_range_count = 0;
+
+static uint32_t free_page_count = 0;
+static uint32_t total_page_count = 0;
+
+static inline uint32_t page_align_down(uint32_t addr) {
+    return addr & ~(PAGE_SIZE - 1);
+}
+
+static inline uint32_t page_align_up(uint32_t addr) {
+    return (addr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+static inline bool pfn_managed(uint32_t pfn) {
+    return pfn >= base_pfn && pfn < end_pfn;
+}
+
+static inline uint32_t zone_of(uint32_t pfn) {
+    return pfn < (PAGE_DMA_ZONE_END >> PAGE_SHIFT) ? PAGE_ZONE_DMA : PAGE_ZONE_NORMAL;
+}
+
+static void reserve_range(uint32_t start, uint32_t end) {
+    if (end <= start || reserved_range_count >= PAGE_MAX_RESERVED) {
+        return;
+    }
+
+    reserved_ranges[reserved_range_count].start = page_align_down(start);
+    reserved_ranges[reserved_range_count].end = page_align_up(end);
+    reserved_range_count++;
+}
+
+// Returns the end of the first reserved range overlapping [start, end), or 0.
+static uint32_t reserved_overlap_end(uint32_t start, uint32_t end) {
+    for (uint32_t i = 0; i < reserved_range_count; i++) {
+        if (start < reserved_ranges[i].end && reserved_ranges[i].start < end) {
+            return reserved_ranges[i].end;
+        }
+    }
+    return 0;
+}
+
+static void free_list_push(uint32_t order, uint32_t pfn) {
+    FreePageBlock** head = &free_lists[zone_of(pfn)][order];
+    FreePageBlock* block = (FreePageBlock*)((uintptr_t)pfn << PAGE_SHIFT);
+    block->prev = NULL;
+    block->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = block;
+    }
+    *head = block;
+    frame_state[pfn - base_pfn] = PAGE_FRAME_FREE | order;
+}
+
+static void free_list_remove(uint32_t order, uint32_t pfn) {
+    FreePageBlock* block = (FreePageBlock*)((uintptr_t)pfn << PAGE_SHIFT);
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        free_lists[zone_of(pfn)][order] = block->next;
+    }
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+    frame_state[pfn - base_pfn] = PAGE_FRAME_NONE;
+}
+
+// Returns a block to the free lists, merging it with its buddy for as long
+// as the buddy is free and of the same order.
+static void free_block(uint32_t pfn, uint32_t order) {
+    while (order < PAGE_MAX_ORDER) {
+        uint32_t buddy_pfn = pfn ^ (1u << order);
+        if (!pfn_managed(buddy_pfn) ||
+            frame_state[buddy_pfn - base_pfn] != (PAGE_FRAME_FREE | order)) {
+            break;
+        }
+
+        free_list_remove(order, buddy_pfn);
+        if (buddy_pfn < pfn) {
+            pfn = buddy_pfn;
+        }
+        order++;
+    }
+
+    free_list_push(order, pfn);
+}
+
+// Reads the multiboot memory map into usable_regions. Only RAM below 4 GiB
+// is usable by this 32-bit kernel, so higher ranges are clipped.
+static void collect_usable_regions(struct multiboot_info* mb_info) {
+    uint32_t current = mb_info->mmap_addr;
+    uint32_t end = mb_info->mmap_addr + mb_info->mmap_length;
+
+    while (current < end && usable_region_count < PAGE_MAX_REGIONS) {
+        struct memory_map_entry* entry = (struct memory_map_entry*)(uintptr_t)current;
+
+        uint64_t base = ((uint64_t)entry->base_addr_high << 32) | entry->base_addr_low;
+        uint64_t length = ((uint64_t)entry->length_high << 32) | entry->length_low;
+        uint64_t limit = base + length;
+
+        if (entry->type == MMAP_TYPE_AVAILABLE && base < 0x100000000ULL) {
+            if (limit > 0x100000000ULL) {
+                limit = 0x100000000ULL;
+            }
+
+            // Keep region ends representable in 32 bits by dropping the
+            // very last page below 4 GiB.
+            uint64_t stop64 = limit & ~(uint64_t)(PAGE_SIZE - 1);
+            if (stop64 >= 0x100000000ULL) {
+                stop64 = 0x100000000ULL - PAGE_SIZE;
+            }
+
+            uint32_t start = page_align_up((uint32_t)base);
+            uint32_t stop = (uint32_t)stop64;
+
+            if (stop > start) {
+                usable_regions[usable_region_count].start = start;
+                usable_regions[usable_region_count].end = stop;
+                usable_region_count++;
+            }
+        }
+
+        current += entry->size + 4;
+    }
+}
+
+static void reserve_boot_structures(struct multiboot_info* mb_info) {
+    reserve_range(0, LOW_MEMORY_END);
+    reserve_range((uint32_t)(uintptr_t)&kernel_start, (uint32_t)(uintptr_t)&kernel_end);
+
+    uint32_t mb_addr = (uint32_t)(uintptr_t)mb_info;
+    reserve_range(mb_addr, mb_addr + sizeof(struct multiboot_info));
+    reserve_range(mb_info->mmap_addr, mb_info->mmap_addr + mb_info->mmap_length);
+
+    if (mb_info->flags & MULTIBOOT_FLAG_CMDLINE) {
+        reserve_range(mb_info->cmdline, mb_info->cmdline + PAGE_SIZE);
+    }
+
+    if (mb_info->flags & MULTIBOOT_FLAG_LOADER) {
+        reserve_range(mb_info->boot_loader_name, mb_info->boot_loader_name + PAGE_SIZE);
+    }
+
+    if (mb_info->flags & MULTIBOOT_FLAG_MODS) {
+        MultibootModule* mods = (MultibootModule*)(uintptr_t)mb_info->mods_addr;
+        reserve_range(mb_info->mods_addr, mb_info->mods_addr + mb_info->mods_count * sizeof(MultibootModule));
+        for (uint32_t i = 0; i < mb_info->mods_count; i++) {
+            reserve_range(mods[i].mod_start, mods[i].mod_end);
+        }
+    }
+}
+
+// Finds room for the frame state array inside usable RAM, away from every
+// reserved range, and reserves it.
+static bool place_frame_state(uint32_t size) {
+    for (uint32_t i = 0; i < usable_region_count; i++) {
+        uint32_t candidate = usable_regions[i].start;
+
+        while (candidate + size <= usable_regions[i].end && candidate + size > candidate) {
+            uint32_t overlap_end = reserved_overlap_end(candidate, candidate + size);
+            if (overlap_end == 0) {
+                frame_state = (uint8_t*)(uintptr_t)candidate;
+                reserve_range(candidate, candidate + size);
+                return true;
+            }
+            candidate = overlap_end;
+        }
+    }
+
+    return false;
+}
+
+void init_page_allocator(uint32_t multiboot_info_ptr) {
+    struct multiboot_info* mb_info = (struct multiboot_info*)(uintptr_t)multiboot_info_ptr;
+
+    if (!(mb_info->flags & MULTIBOOT_FLAG_MMAP)) {
+        output_string("Page allocator: no multiboot memory map\n");
+        return;
+    }
+
+    collect_usable_regions(mb_info);
+    if (usable_region_count == 0) {
+        output_string("Page allocator: no usable memory\n");
+        return;
+    }
+
+    reserve_boot_structures(mb_info);
+
+    base_pfn = 0xFFFFFFFF;
+    end_pfn = 0;
+    for (uint32_t i = 0; i < usable_region_count; i++) {
+        uint32_t start_pfn = usable_regions[i].start >> PAGE_SHIFT;
+        uint32_t stop_pfn = usable_regions[i].end >> PAGE_SHIFT;
+        if (start_pfn < base_pfn) {
+            base_pfn = start_pfn;
+        }
+        if (stop_pfn > end_pfn) {
+            end_pfn = stop_pfn;
+        }
+    }
+
+    if (!place_frame_state(page_align_up(end_pfn - base_pfn))) {
+        output_string("Page allocator: no room for frame metadata\n");
+        end_pfn = base_pfn;
+        return;
+    }
+
+    for (uint32_t pfn = base_pfn; pfn < end_pfn; pfn++) {
+        frame_state[pfn - base_pfn] = PAGE_FRAME_NONE;
+    }
+
+    for (uint32_t zone = 0; zone < PAGE_ZONE_COUNT; zone++) {
+        for (uint32_t order = 0; order <= PAGE_MAX_ORDER; order++) {
+            free_lists[zone][order] = NULL;
+        }
+        zone_free_count[zone] = 0;
+    }
+
+    for (uint32_t i = 0; i < usable_region_count; i++) {
+        for (uint32_t addr = usable_regions[i].start; addr < usable_regions[i].end; addr += PAGE_SIZE) {
+            if (reserved_overlap_end(addr, addr + PAGE_SIZE) != 0) {
+                continue;
+            }
+            free_block(addr >> PAGE_SHIFT, 0);
+            free_page_count++;
+            zone_free_count[zone_of(addr >> PAGE_SHIFT)]++;
+        }
+    }
+
+    total_page_count = free_page_count;
+}
+
+void* alloc_pages_zone(uint32_t order, uint32_t zone) {
+    if (order > PAGE_MAX_ORDER || zone >= PAGE_ZONE_COUNT) {
+        return NULL;
+    }
+
+    PAGE_LOCK();
+
+    uint32_t current_order = order;
+    while (current_order <= PAGE_MAX_ORDER && free_lists[zone][current_order] == NULL) {
+        current_order++;
+    }
+
+    if (current_order > PAGE_MAX_ORDER) {
+        PAGE_UNLOCK();
+        return NULL;
+    }
+
+    uint32_t pfn = (uint32_t)((uintptr_t)free_lists[zone][current_order] >> PAGE_SHIFT);
+    free_list_remove(current_order, pfn);
+
+    // Split the block down, handing the upper halves back as free buddies.
+    while (current_order > order) {
+        current_order--;
+        free_list_push(current_order, pfn + (1u << current_order));
+    }
+
+    frame_state[pfn - base_pfn] = PAGE_FRAME_USED | order;
+    free_page_count -= 1u << order;
+    zone_free_count[zone] -= 1u << order;
+
+    PAGE_UNLOCK();
+    return (void*)((uintptr_t)pfn << PAGE_SHIFT);
+}
+
+void* alloc_pages(uint32_t order) {
+    void* block = alloc_pages_zone(order, PAGE_ZONE_NORMAL);
+    if (block == NULL) {
+        block = alloc_pages_zone(order, PAGE_ZONE_DMA);
+    }
+    return block;
+}
+
+void free_pages(void* addr, uint32_t order) {
+    if (addr == NULL) {
+        return;
+    }
+
+    PAGE_LOCK();
+
+    uint32_t pfn = (uint32_t)((uintptr_t)addr >> PAGE_SHIFT);
+    if (!pfn_managed(pfn) || frame_state[pfn - base_pfn] != (PAGE_FRAME_USED | order)) {
+        output_string("free_pages: invalid block at ");
+        put_hex((uint32_t)(uintptr_t)addr);
+        output_string("\n");
+        PAGE_UNLOCK();
+        return;
+    }
+
+    free_page_count += 1u << order;
+    zone_free_count[zone_of(pfn)] += 1u << order;
+    free_block(pfn, order);
+    PAGE_UNLOCK();
+}
+
+uint32_t page_order_for_size(size_t size) {
+    uint32_t order = 0;
+    while (order < PAGE_MAX_ORDER && ((size_t)PAGE_SIZE << order) < size) {
+        order++;
+    }
+    return order;
+}
+
+uint32_t page_allocator_free_count(void) {
+    return free_page_count;
+}
+
+uint32_t page_allocator_zone_free_count(uint32_t zone) {
+    return zone < PAGE_ZONE_COUNT ? zone_free_count[zone] : 0;
+}
+
+uint32_t page_allocator_total_count(void) {
+    return total_page_count;
+}
+
+uint32_t page_allocator_end_address(void) {
+    return end_pfn << PAGE_SHIFT;
+}
+
+void page_allocator_print_info(void) {
+    output_string("Page allocator: ");
+    put_u32(usable_region_count);
+    output_string(" usable region(s), ");
+    put_u32(free_page_count);
+    output_string(" of ");
+    put_u32(total_page_count);
+    output_string(" pages free (");
+    put_u32((free_page_count * (PAGE_SIZE / 1024)) / 1024);
+    output_string(" MiB, ");
+    put_u32(zone_free_count[PAGE_ZONE_DMA]);
+    output_string(" in the DMA zone)\n");
+
+    for (uint32_t i = 0; i < usable_region_count; i++) {
+        output_string("  ");
+        put_hex(usable_regions[i].start);
+        output_string(" - ");
+        put_hex(usable_regions[i].end);
+        output_string("\n");
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef PAGE_ALLOCATOR_H
+#define PAGE_ALLOCATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_SHIFT 12
+
+// Largest buddy block is 2^PAGE_MAX_ORDER pages (4 MiB).
+#define PAGE_MAX_ORDER 10
+
+// Frames below 16 MiB form the DMA zone, kept apart so ISA-style devices
+// can still get buffers there. Ordinary allocations only fall back to it
+// when the normal zone is exhausted. No buddy block crosses the boundary.
+#define PAGE_ZONE_DMA 0
+#define PAGE_ZONE_NORMAL 1
+#define PAGE_ZONE_COUNT 2
+#define PAGE_DMA_ZONE_END 0x1000000
+
+#define PAGE_MAX_REGIONS 32
+#define PAGE_MAX_RESERVED 16
+
+// Per-frame state byte. Only the first frame of a block carries its order.
+#define PAGE_FRAME_NONE  0x00
+#define PAGE_FRAME_USED  0x40
+#define PAGE_FRAME_FREE  0x80
+#define PAGE_FRAME_ORDER_MASK 0x0F
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} PageRange;
+
+typedef struct FreePageBlock {
+    struct FreePageBlock* next;
+    struct FreePageBlock* prev;
+} FreePageBlock;
+
+void init_page_allocator(uint32_t multiboot_info_ptr);
+
+void* alloc_pages(uint32_t order);
+
+// Allocates only from the given zone.
+void* alloc_pages_zone(uint32_t order, uint32_t zone);
+
+void free_pages(void* addr, uint32_t order);
+
+uint32_t page_order_for_size(size_t size);
+
+uint32_t page_allocator_free_count(void);
+uint32_t page_allocator_zone_free_count(uint32_t zone);
+uint32_t page_allocator_total_count(void);
+
+// First address above every frame the allocator manages.
+uint32_t page_allocator_end_address(void);
+
+void page_allocator_print_info(void);
+
+#endif
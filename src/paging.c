@@ -0,0 +1,530 @@
+#include "paging.h"
+#include "page_allocator.h"
+#include "memory.h"
+#include "terminal.h"
+#include "io.h"
+#include "libc.h"
+#include "spinlock.h"
+#include "smp.h"
+
+#define CR0_WRITE_PROTECT 0x00010000
+#define CR0_PAGING        0x80000000
+#define CR4_PSE           0x00000010
+#define CR4_PGE           0x00000080
+
+#define CPUID_EDX_PSE (1 << 3)
+#define CPUID_EDX_PGE (1 << 13)
+
+#define PAGE_ENTRIES 1024
+
+static uint32_t kernel_page_directory[PAGE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+
+static bool pse_supported = false;
+static bool pge_supported = false;
+static bool paging_on = false;
+static uint32_t identity_map_end = 0;
+static uint32_t page_table_count = 0;
+
+static PageRange demand_ranges[PAGING_MAX_DEMAND_RANGES];
+static uint32_t demand_range_count = 0;
+static uint32_t demand_committed_pages = 0;
+
+// Held by every call that reads or changes the tables or the state above,
+// so CPUs can take demand faults at the same time. Paging code never
+// faults itself, so a fault handler cannot find its own CPU holding it.
+static Spinlock paging_lock = SPINLOCK_INIT;
+
+// Pages whose TLB entries must be dropped when the outermost batch ends.
+// Once more than TLB_FLUSH_THRESHOLD pages are queued the whole TLB is
+// flushed instead.
+static struct {
+    uint32_t depth;
+    uint32_t count;
+    bool flush_all;
+    uint32_t pages[TLB_FLUSH_THRESHOLD];
+} tlb_batch;
+
+static inline uint32_t read_cr0(void) {
+    uint32_t value;
+    __asm__ volatile ("movl %%cr0, %0" : "=r" (value));
+    return value;
+}
+
+static inline void write_cr0(uint32_t value) {
+    __asm__ volatile ("movl %0, %%cr0" : : "r" (value) : "memory");
+}
+
+uint32_t read_cr2(void) {
+    uint32_t value;
+    __asm__ volatile ("movl %%cr2, %0" : "=r" (value));
+    return value;
+}
+
+static inline uint32_t read_cr3(void) {
+    uint32_t value;
+    __asm__ volatile ("movl %%cr3, %0" : "=r" (value));
+    return value;
+}
+
+static inline void write_cr3(uint32_t value) {
+    __asm__ volatile ("movl %0, %%cr3" : : "r" (value) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t value;
+    __asm__ volatile ("movl %%cr4, %0" : "=r" (value));
+    return value;
+}
+
+static inline void write_cr4(uint32_t value) {
+    __asm__ volatile ("movl %0, %%cr4" : : "r" (value) : "memory");
+}
+
+static inline void invlpg(uint32_t addr) {
+    __asm__ volatile ("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+// Reloading CR3 keeps global entries, so toggle CR4.PGE when it is on.
+static void flush_tlb_all(void) {
+    uint32_t cr4 = read_cr4();
+    if (cr4 & CR4_PGE) {
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        write_cr3(read_cr3());
+    }
+}
+
+static void tlb_invalidate(uint32_t virt) {
+    if (!paging_on || tlb_batch.flush_all) {
+        return;
+    }
+
+    if (tlb_batch.count == TLB_FLUSH_THRESHOLD) {
+        tlb_batch.flush_all = true;
+        return;
+    }
+
+    tlb_batch.pages[tlb_batch.count++] = virt;
+}
+
+static void batch_begin(void) {
+    tlb_batch.depth++;
+}
+
+static void batch_end(void) {
+    if (tlb_batch.depth == 0 || --tlb_batch.depth != 0) {
+        return;
+    }
+
+    if (tlb_batch.flush_all) {
+        flush_tlb_all();
+    } else {
+        for (uint32_t i = 0; i < tlb_batch.count; i++) {
+            invlpg(tlb_batch.pages[i]);
+        }
+    }
+
+    tlb_batch.count = 0;
+    tlb_batch.flush_all = false;
+}
+
+static inline uint32_t* directory_entry(uint32_t virt) {
+    return &kernel_page_directory[virt >> LARGE_PAGE_SHIFT];
+}
+
+static inline uint32_t table_index(uint32_t virt) {
+    return (virt >> PAGE_SHIFT) & (PAGE_ENTRIES - 1);
+}
+
+static inline bool large_aligned(uint32_t value) {
+    return (value & (LARGE_PAGE_SIZE - 1)) == 0;
+}
+
+// Bytes from `virt` to the end of its 4 MiB directory slot, capped at `size`.
+static inline uint32_t rest_of_slot(uint32_t virt, uint32_t size) {
+    uint32_t rest = LARGE_PAGE_SIZE - (virt & (LARGE_PAGE_SIZE - 1));
+    return rest < size ? rest : size;
+}
+
+// Returns the page table behind `virt`. With `create` set, a missing table
+// is allocated and a 4 MiB mapping is split into an equivalent table.
+static uint32_t* page_table_for(uint32_t virt, bool create) {
+    uint32_t* pde = directory_entry(virt);
+
+    if ((*pde & PTE_PRESENT) && !(*pde & PTE_LARGE)) {
+        return (uint32_t*)(uintptr_t)(*pde & PTE_ADDRESS_MASK);
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    uint32_t* table = (uint32_t*)alloc_pages(0);
+    if (table == NULL) {
+        return NULL;
+    }
+    page_table_count++;
+
+    if (*pde & PTE_PRESENT) {
+        uint32_t base = *pde & ~(uint32_t)(LARGE_PAGE_SIZE - 1);
+        uint32_t flags = *pde & PTE_FLAGS_MASK & ~(PTE_LARGE | PTE_ACCESSED | PTE_DIRTY);
+        for (uint32_t i = 0; i < PAGE_ENTRIES; i++) {
+            table[i] = (base + (i << PAGE_SHIFT)) | flags;
+        }
+        tlb_invalidate(virt & ~(uint32_t)(LARGE_PAGE_SIZE - 1));
+    } else {
+        memset(table, 0, PAGE_SIZE);
+    }
+
+    *pde = (uint32_t)(uintptr_t)table | PTE_PRESENT | PTE_WRITABLE;
+    return table;
+}
+
+static int map_range(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags) {
+    int result = 0;
+    flags = (flags & PTE_FLAGS_MASK & ~PTE_LARGE) | PTE_PRESENT;
+
+    batch_begin();
+    while (size > 0) {
+        uint32_t* pde = directory_entry(virt);
+
+        if (pse_supported && large_aligned(virt) && large_aligned(phys) && size >= LARGE_PAGE_SIZE &&
+            (!(*pde & PTE_PRESENT) || (*pde & PTE_LARGE))) {
+            if (*pde & PTE_PRESENT) {
+                tlb_invalidate(virt);
+            }
+            *pde = phys | flags | PTE_LARGE;
+
+            virt += LARGE_PAGE_SIZE;
+            phys += LARGE_PAGE_SIZE;
+            size -= LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        uint32_t* table = page_table_for(virt, true);
+        if (table == NULL) {
+            result = -1;
+            break;
+        }
+
+        uint32_t* pte = &table[table_index(virt)];
+        if (*pte & PTE_PRESENT) {
+            tlb_invalidate(virt);
+        }
+        *pte = phys | flags;
+
+        virt += PAGE_SIZE;
+        phys += PAGE_SIZE;
+        size = size > PAGE_SIZE ? size - PAGE_SIZE : 0;
+    }
+    batch_end();
+
+    return result;
+}
+
+static int unmap_range(uint32_t virt, uint32_t size) {
+    int result = 0;
+
+    batch_begin();
+    while (size > 0) {
+        uint32_t* pde = directory_entry(virt);
+
+        if (!(*pde & PTE_PRESENT)) {
+            uint32_t skip = rest_of_slot(virt, size);
+            virt += skip;
+            size -= skip;
+            continue;
+        }
+
+        if ((*pde & PTE_LARGE) && large_aligned(virt) && size >= LARGE_PAGE_SIZE) {
+            *pde = 0;
+            tlb_invalidate(virt);
+            virt += LARGE_PAGE_SIZE;
+            size -= LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        uint32_t* table = page_table_for(virt, true);
+        if (table == NULL) {
+            result = -1;
+            break;
+        }
+
+        uint32_t* pte = &table[table_index(virt)];
+        if (*pte & PTE_PRESENT) {
+            *pte = 0;
+            tlb_invalidate(virt);
+        }
+
+        virt += PAGE_SIZE;
+        size = size > PAGE_SIZE ? size - PAGE_SIZE : 0;
+    }
+    batch_end();
+
+    return result;
+}
+
+static int protect_range(uint32_t virt, uint32_t size, uint32_t flags) {
+    int result = 0;
+    flags = (flags & PTE_FLAGS_MASK & ~PTE_LARGE) | PTE_PRESENT;
+
+    batch_begin();
+    while (size > 0) {
+        uint32_t* pde = directory_entry(virt);
+
+        if (!(*pde & PTE_PRESENT)) {
+            uint32_t skip = rest_of_slot(virt, size);
+            virt += skip;
+            size -= skip;
+            continue;
+        }
+
+        if ((*pde & PTE_LARGE) && large_aligned(virt) && size >= LARGE_PAGE_SIZE) {
+            *pde = (*pde & ~(uint32_t)(LARGE_PAGE_SIZE - 1)) | flags | PTE_LARGE;
+            tlb_invalidate(virt);
+            virt += LARGE_PAGE_SIZE;
+            size -= LARGE_PAGE_SIZE;
+            continue;
+        }
+
+        uint32_t* table = page_table_for(virt, true);
+        if (table == NULL) {
+            result = -1;
+            break;
+        }
+
+        uint32_t* pte = &table[table_index(virt)];
+        if (*pte & PTE_PRESENT) {
+            *pte = (*pte & PTE_ADDRESS_MASK) | flags;
+            tlb_invalidate(virt);
+        }
+
+        virt += PAGE_SIZE;
+        size = size > PAGE_SIZE ? size - PAGE_SIZE : 0;
+    }
+    batch_end();
+
+    return result;
+}
+
+void paging_begin_batch(void) {
+    uint32_t lock_flags = spin_lock_irqsave(&paging_lock);
+    batch_begin();
+    spin_unlock_irqrestore(&paging_lock, lock_flags);
+}
+
+void paging_end_batch(void) {
+    uint32_t lock_flags = spin_lock_irqsave(&paging_lock);
+    batch_end();
+    spin_unlock_irqrestore(&paging_lock, lock_flags);
+}
+
+int paging_map(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags) {
+    uint32_t lock_flags = spin_lock_irqsave(&paging_lock);
+    int result = map_range(virt, phys, size, flags);
+    spin_unlock_irqrestore(&paging_lock, lock_flags);
+    return result;
+}
+
+int paging_unmap(uint32_t virt, uint32_t size) {
+    // Other CPUs could keep stale entries, see paging_decommit
+    if (smp_cpu_count() > 1) {
+        return -1;
+    }
+
+    uint32_t lock_flags = spin_lock_irqsave(&paging_lock);
+    int result = unmap_range(virt, size);
+    spin_unlock_irqrestore(&paging_lock, lock_flags);
+    return result;
+}
+
+int paging_protect(uint32_t virt, uint32_t size, uint32_t flags) {
+    // Other CPUs could keep stale entries, see paging_decommit
+    if (smp_cpu_count() > 1) {
+        return -1;
+    }
+
+    uint32_t lock_flags = spin_lock_irqsave(&paging_lock);
+    int result = protect_range(virt, size, flags);
+    spin_unlock_irqrestore(&paging_lock, lock_flags);
+    return result;
+}
+
+bool paging_query(uint32_t virt, uint32_t* phys, uint32_t* flags) {
+    uint32_t pde = *directory_entry(virt);
+    if (!(pde & PTE_PRESENT)) {
+        return false;
+    }
+
+    if (pde & PTE_LARGE) {
+        *phys = (pde & ~(uint32_t)(LARGE_PAGE_SIZE - 1)) | (virt & (LARGE_PAGE_SIZE - 1));
+        *flags = pde & PTE_FLAGS_MASK;
+        return true;
+    }
+
+    uint32_t pte = ((uint32_t*)(uintptr_t)(pde & PTE_ADDRESS_MASK))[table_index(virt)];
+    if (!(pte & PTE_PRESENT)) {
+        return false;
+    }
+
+    *phys = (pte & PTE_ADDRESS_MASK) | (virt & (PAGE_SIZE - 1));
+    *flags = pte & PTE_FLAGS_MASK;
+    return true;
+}
+
+static bool in_demand_range(uint32_t address) {
+    for (uint32_t i = 0; i < demand_range_count; i++) {
+        if (address >= demand_ranges[i].start && address < demand_ranges[i].end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int paging_add_demand_range(uint32_t start, uint32_t size) {
+    if (!paging_on || demand_range_count >= PAGING_MAX_DEMAND_RANGES || size == 0 ||
+        (start & (PAGE_SIZE - 1)) != 0 || (size & (PAGE_SIZE - 1)) != 0 || start + size < start) {
+        return -1;
+    }
+
+    // Whole 4 MiB slots must be unused so faults never race a large mapping.
+    for (uint32_t addr = start; addr - start < size; addr += rest_of_slot(addr, LARGE_PAGE_SIZE)) {
+        if (*directory_entry(addr) & PTE_PRESENT) {
+            return -1;
+        }
+    }
+
+    demand_ranges[demand_range_count].start = start;
+    demand_ranges[demand_range_count].end = start + size;
+    demand_range_count++;
+    return 0;
+}
+
+bool paging_handle_fault(uint32_t address, uint32_t error_code) {
+    if ((error_code & PAGE_FAULT_PRESENT) || !in_demand_range(address)) {
+        return false;
+    }
+
+    uint32_t lock_flags = spin_lock_irqsave(&paging_lock);
+
+    // Another CPU may have faulted the same page in while this one waited
+    uint32_t phys;
+    uint32_t flags;
+    if (paging_query(address, &phys, &flags)) {
+        spin_unlock_irqrestore(&paging_lock, lock_flags);
+        return true;
+    }
+
+    void* frame = alloc_pages(0);
+    if (frame == NULL) {
+        spin_unlock_irqrestore(&paging_lock, lock_flags);
+        return false;
+    }
+    memset(frame, 0, PAGE_SIZE);
+
+    bool mapped = map_range(address & PTE_ADDRESS_MASK, (uint32_t)(uintptr_t)frame,
+                            PAGE_SIZE, PAGING_KERNEL_FLAGS) == 0;
+    if (mapped) {
+        demand_committed_pages++;
+    } else {
+        free_pages(frame, 0);
+    }
+
+    spin_unlock_irqrestore(&paging_lock, lock_flags);
+    return mapped;
+}
+
+void paging_decommit(uint32_t virt, uint32_t size) {
+    // Unmapping only flushes this CPU's TLB; with no shootdown yet, another
+    // CPU could keep using a frame after it is freed. Keep pages committed.
+    if (smp_cpu_count() > 1) {
+        return;
+    }
+
+    uint32_t lock_flags = spin_lock_irqsave(&paging_lock);
+    batch_begin();
+    for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint32_t page = virt + offset;
+        uint32_t phys;
+        uint32_t flags;
+
+        if (!in_demand_range(page) || !paging_query(page, &phys, &flags)) {
+            continue;
+        }
+
+        // The frame can go back before the batched flush: nothing touches
+        // this page again until the flush at the end of the batch.
+        unmap_range(page, PAGE_SIZE);
+        free_pages((void*)(uintptr_t)(phys & PTE_ADDRESS_MASK), 0);
+        demand_committed_pages--;
+    }
+    batch_end();
+    spin_unlock_irqrestore(&paging_lock, lock_flags);
+}
+
+uint32_t paging_demand_committed_bytes(void) {
+    return demand_committed_pages << PAGE_SHIFT;
+}
+
+bool paging_enabled(void) {
+    return paging_on;
+}
+
+void paging_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 1) {
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        pse_supported = (edx & CPUID_EDX_PSE) != 0;
+        pge_supported = (edx & CPUID_EDX_PGE) != 0;
+    }
+
+    for (uint32_t i = 0; i < PAGE_ENTRIES; i++) {
+        kernel_page_directory[i] = 0;
+    }
+
+    if (pse_supported) {
+        write_cr4(read_cr4() | CR4_PSE);
+    }
+
+    // Identity-map whole 4 MiB slots up to the end of RAM or of the kernel
+    // image, whichever is higher, so existing physical pointers stay valid.
+    uint32_t end = page_allocator_end_address();
+    if ((uint32_t)(uintptr_t)&kernel_end > end) {
+        end = (uint32_t)(uintptr_t)&kernel_end;
+    }
+    uint32_t slots = (end >> LARGE_PAGE_SHIFT) + ((end & (LARGE_PAGE_SIZE - 1)) != 0);
+
+    uint32_t flags = PAGING_KERNEL_FLAGS | (pge_supported ? PTE_GLOBAL : 0);
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        uint32_t base = slot << LARGE_PAGE_SHIFT;
+        if (paging_map(base, base, LARGE_PAGE_SIZE, flags) != 0) {
+            output_string("Paging: out of memory for page tables\n");
+            return;
+        }
+    }
+    identity_map_end = slots << LARGE_PAGE_SHIFT;
+
+    write_cr3((uint32_t)(uintptr_t)kernel_page_directory);
+    write_cr0(read_cr0() | CR0_PAGING | CR0_WRITE_PROTECT);
+
+    // Global pages can only be enabled once paging is on.
+    if (pge_supported) {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+
+    paging_on = true;
+}
+
+void paging_print_info(void) {
+    output_string("Paging: ");
+    output_string(paging_on ? "enabled" : "disabled");
+    output_string(", identity map up to ");
+    put_hex(identity_map_end);
+    output_string(pse_supported ? ", 4 MiB pages" : ", 4 KiB pages");
+    output_string(pge_supported ? ", global" : "");
+    output_string(", ");
+    put_u32(page_table_count);
+    output_string(" page table(s)\n");
+}
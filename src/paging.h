@@ -0,0 +1,86 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Page directory and page table entry bits.
+#define PTE_PRESENT        0x001
+#define PTE_WRITABLE       0x002
+#define PTE_USER           0x004
+#define PTE_WRITE_THROUGH  0x008
+#define PTE_CACHE_DISABLE  0x010
+#define PTE_ACCESSED       0x020
+#define PTE_DIRTY          0x040
+#define PTE_LARGE          0x080    // Directory entries only: maps 4 MiB
+#define PTE_GLOBAL         0x100
+#define PTE_FLAGS_MASK     0xFFF
+#define PTE_ADDRESS_MASK   0xFFFFF000
+
+#define LARGE_PAGE_SIZE    0x400000
+#define LARGE_PAGE_SHIFT   22
+
+// Above this many pages a batch is flushed by reloading CR3 (and cycling
+// CR4.PGE for global entries) instead of one invlpg per page.
+#define TLB_FLUSH_THRESHOLD 32
+
+#define PAGING_MAX_DEMAND_RANGES 4
+
+// Flags for kernel RAM and for device memory.
+#define PAGING_KERNEL_FLAGS (PTE_PRESENT | PTE_WRITABLE)
+#define PAGING_MMIO_FLAGS   (PTE_PRESENT | PTE_WRITABLE | PTE_CACHE_DISABLE | PTE_WRITE_THROUGH)
+
+// Page fault error code bits.
+#define PAGE_FAULT_PRESENT   0x01
+#define PAGE_FAULT_WRITE     0x02
+#define PAGE_FAULT_USER      0x04
+#define PAGE_FAULT_RESERVED  0x08
+#define PAGE_FAULT_FETCH     0x10
+
+// Builds the kernel page directory, identity-maps everything up to the end of
+// usable RAM and turns paging on. Uses 4 MiB pages and global entries when
+// the CPU supports them. Needs init_page_allocator.
+void paging_init(void);
+
+bool paging_enabled(void);
+
+// Mapping calls take page-aligned addresses and a size in bytes. They return
+// 0 on success and -1 if a page table could not be allocated. All CPUs share
+// the tables, but TLB entries are only flushed on the calling CPU. Adding a
+// mapping needs no flush elsewhere; removing one or narrowing its access
+// would, and there is no shootdown, so unmap and protect are only allowed
+// before smp_init starts other CPUs and return -1 after.
+int paging_map(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags);
+int paging_unmap(uint32_t virt, uint32_t size);
+int paging_protect(uint32_t virt, uint32_t size, uint32_t flags);
+
+// Looks up the physical address and entry flags behind `virt`.
+bool paging_query(uint32_t virt, uint32_t* phys, uint32_t* flags);
+
+// TLB invalidations from mapping calls between begin and end are collected
+// and flushed once. Batches nest.
+void paging_begin_batch(void);
+void paging_end_batch(void);
+
+// Demand-zero ranges: the first touch of an unmapped page inside one maps a
+// freshly zeroed frame from the page allocator. The range must not overlap
+// existing mappings.
+int paging_add_demand_range(uint32_t start, uint32_t size);
+
+// Unmaps the committed pages of a demand range inside [virt, virt + size)
+// and returns their frames; the next touch faults in a zero page again.
+// Does nothing once more than one CPU is online.
+void paging_decommit(uint32_t virt, uint32_t size);
+
+uint32_t paging_demand_committed_bytes(void);
+
+// Resolves faults on demand ranges. Returns false if the fault is not one
+// paging can fix.
+bool paging_handle_fault(uint32_t address, uint32_t error_code);
+
+uint32_t read_cr2(void);
+
+void paging_print_info(void);
+
+#endif
@@ -0,0 +1,83 @@
+#include "pit.h"
+#include "io.h"
+#include "port_manager.h"
+#include <stddef.h>
+
+#define PIT_CALIBRATE_COUNT 59659       // 50 ms
+#define PIT_CALIBRATE_SPINS 10000000
+
+// Command bytes: channel, lobyte/hibyte access, mode 0, binary.
+#define PIT_CMD_CHANNEL0_ONESHOT 0x30
+#define PIT_CMD_CHANNEL2_ONESHOT 0xB0
+
+#define PIT_GATE_CHANNEL2   0x01
+#define PIT_GATE_SPEAKER    0x02
+#define PIT_GATE_OUTPUT2    0x20
+
+static PortHandle* pit_channel0 = NULL;
+static PortHandle* pit_channel2 = NULL;
+static PortHandle* pit_command = NULL;
+static PortHandle* pit_gate = NULL;
+
+bool pit_init(void) {
+    if (pit_command != NULL) {
+        return true;
+    }
+
+    pit_channel0 = request_port(PIT_CHANNEL0_PORT);
+    pit_channel2 = request_port(PIT_CHANNEL2_PORT);
+    pit_command = request_port(PIT_COMMAND_PORT);
+    pit_gate = request_port(PIT_GATE_PORT);
+
+    if (pit_channel0 == NULL || pit_channel2 == NULL || pit_command == NULL || pit_gate == NULL) {
+        release_port(pit_channel0);
+        release_port(pit_channel2);
+        release_port(pit_command);
+        release_port(pit_gate);
+        pit_channel0 = pit_channel2 = pit_command = pit_gate = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t pit_calibrate_tsc(void) {
+    if (pit_command == NULL) {
+        return 0;
+    }
+
+    // Gate channel 2 on with the speaker disconnected, then load the count.
+    uint8_t gate = read_port_b(pit_gate);
+    write_port_b(pit_gate, (gate & ~PIT_GATE_SPEAKER) | PIT_GATE_CHANNEL2);
+
+    write_port_b(pit_command, PIT_CMD_CHANNEL2_ONESHOT);
+    write_port_b(pit_channel2, PIT_CALIBRATE_COUNT & 0xFF);
+    write_port_b(pit_channel2, PIT_CALIBRATE_COUNT >> 8);
+
+    uint64_t start = read_tsc();
+    uint32_t spins = 0;
+    while ((read_port_b(pit_gate) & PIT_GATE_OUTPUT2) == 0 && spins < PIT_CALIBRATE_SPINS) {
+        spins++;
+    }
+    uint64_t end = read_tsc();
+
+    write_port_b(pit_gate, gate);
+
+    if (spins >= PIT_CALIBRATE_SPINS) {
+        return 0;
+    }
+
+    // 50 ms worth of cycles, times 20. The exact count is 59659 / PIT_HZ
+    // seconds, 0.0005% off, which is well inside the TSC's own drift.
+    return (end - start) * 20;
+}
+
+void pit_oneshot(uint16_t count) {
+    if (pit_command == NULL) {
+        return;
+    }
+
+    write_port_b(pit_command, PIT_CMD_CHANNEL0_ONESHOT);
+    write_port_b(pit_channel0, count & 0xFF);
+    write_port_b(pit_channel0, count >> 8);
+}
@@ -0,0 +1,29 @@
+#ifndef PIT_H
+#define PIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIT_CHANNEL0_PORT   0x40
+#define PIT_CHANNEL2_PORT   0x42
+#define PIT_COMMAND_PORT    0x43
+#define PIT_GATE_PORT       0x61    // System control port B: channel 2 gate and output
+
+#define PIT_HZ              1193182
+#define PIT_MAX_COUNT       0xFFFF
+
+// The PIT is IRQ 0 on the master PIC.
+#define PIT_IRQ             0
+
+// Claims the PIT ports. Returns false if another driver holds them.
+bool pit_init(void);
+
+// Measures the TSC against a 50 ms count on channel 2. Returns cycles per
+// second, or 0 if the channel never reached its terminal count.
+uint64_t pit_calibrate_tsc(void);
+
+// Raises IRQ 0 once after `count` PIT input cycles (mode 0 on channel 0),
+// replacing any count in progress.
+void pit_oneshot(uint16_t count);
+
+#endif
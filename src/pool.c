@@ -0,0 +1,85 @@
+#include "pool.h"
+
+static inline uint64_t pool_pack(PoolBlock* block, uint32_t tag) {
+    return ((uint64_t)tag << 32) | (uint32_t)(uintptr_t)block;
+}
+
+static inline PoolBlock* pool_head_block(uint64_t head) {
+    return (PoolBlock*)(uintptr_t)(uint32_t)head;
+}
+
+static inline uint32_t pool_head_tag(uint64_t head) {
+    return (uint32_t)(head >> 32);
+}
+
+void pool_init(Pool* pool, void* storage, size_t block_size, uint32_t block_count) {
+    pool->storage = (uint8_t*)storage;
+    pool->block_size = block_size;
+    pool->block_count = block_count;
+
+    // Link the blocks in address order so a fresh pool hands them out from
+    // the front of the storage.
+    PoolBlock* first = NULL;
+    for (uint32_t i = block_count; i > 0; i--) {
+        PoolBlock* block = (PoolBlock*)(pool->storage + (size_t)(i - 1) * block_size);
+        block->next = first;
+        first = block;
+    }
+
+    atomic_store(&pool->free_count, block_count);
+    __atomic_store_n(&pool->head, pool_pack(first, 0), __ATOMIC_RELEASE);
+}
+
+void* pool_alloc(Pool* pool) {
+    uint64_t old_head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+
+    while (1) {
+        PoolBlock* block = pool_head_block(old_head);
+        if (block == NULL) {
+            return NULL;
+        }
+
+        // If another context pops this block first, `next` may already be
+        // stale or overwritten, but the tag has moved on and the exchange
+        // below fails. The storage is never unmapped, so the read is safe.
+        uint64_t new_head = pool_pack(block->next, pool_head_tag(old_head) + 1);
+        if (__atomic_compare_exchange_n(&pool->head, &old_head, new_head, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            atomic_fetch_sub(&pool->free_count, 1);
+            return block;
+        }
+    }
+}
+
+void pool_free(Pool* pool, void* block) {
+    if (block == NULL) {
+        return;
+    }
+
+    PoolBlock* freed = (PoolBlock*)block;
+    uint64_t old_head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+
+    while (1) {
+        freed->next = pool_head_block(old_head);
+        uint64_t new_head = pool_pack(freed, pool_head_tag(old_head));
+        if (__atomic_compare_exchange_n(&pool->head, &old_head, new_head, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            atomic_fetch_add(&pool->free_count, 1);
+            return;
+        }
+    }
+}
+
+bool pool_owns(const Pool* pool, const void* block) {
+    const uint8_t* address = (const uint8_t*)block;
+    const uint8_t* end = pool->storage + (size_t)pool->block_count * pool->block_size;
+
+    if (address < pool->storage || address >= end) {
+        return false;
+    }
+    return (size_t)(address - pool->storage) % pool->block_size == 0;
+}
+
+uint32_t pool_free_count(Pool* pool) {
+    return atomic_load(&pool->free_count);
+}
@@ -0,0 +1,43 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Fixed-size block pool over caller-provided storage. The free list is a
+// lock-free stack, so pool_alloc and pool_free may be called from interrupt
+// handlers while task code is in the middle of either; nothing here
+// disables interrupts or touches the heap.
+typedef struct PoolBlock {
+    struct PoolBlock* next;
+} PoolBlock;
+
+typedef struct {
+    // Top of the free list in the low word and a generation tag in the high
+    // word, swapped together with cmpxchg8b. Every pop bumps the tag, so a
+    // block taken and returned between another context's load and its
+    // compare-exchange cannot be mistaken for an unchanged head (ABA).
+    volatile uint64_t head;
+    atomic_uint_fast32_t free_count;
+    uint8_t* storage;
+    size_t block_size;
+    uint32_t block_count;
+} Pool;
+
+// Threads every block of `storage` onto the free list. The block size must
+// be a multiple of the pointer size; a typed array of the objects the pool
+// will hand out satisfies that.
+void pool_init(Pool* pool, void* storage, size_t block_size, uint32_t block_count);
+
+// Returns NULL when the pool is exhausted; pools never grow.
+void* pool_alloc(Pool* pool);
+
+void pool_free(Pool* pool, void* block);
+
+bool pool_owns(const Pool* pool, const void* block);
+
+uint32_t pool_free_count(Pool* pool);
+
+#endif
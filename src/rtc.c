@@ -2,87 +2,30 @@
 #include "io.h"
 #include "terminal.h"
 #include "memory.h"
+#include "slab.h"
+#include "timer.h"
+#include "clock.h"
+#include "thread.h"
 #include "idt.h"
 #include <stdbool.h>
 
 // Global tick counter for monotonic clock (kept for backward compatibility)
 volatile uint32_t system_tick_count = 0;
 
-MonotonicTime* monotonic_time = NULL;
-WakeUpList* wake_up_list = NULL;
+static KmemCache* rtc_driver_cache = NULL;
 
 // Initialize global monotonic time
 void monotonic_time_init_global(void) {
-    if (monotonic_time == NULL) {
-        monotonic_time = (MonotonicTime*)malloc(sizeof(MonotonicTime));
-        if (monotonic_time != NULL) {
-            atomic_store(&monotonic_time->tick_count, 0);
-        }
-    }
+    clock_init();
 }
 
 uint32_t monotonic_time_get_ticks_global(void) {
-    if (monotonic_time != NULL) {
-        return atomic_load(&monotonic_time->tick_count);
-    }
-    return 0;
+    return clock_ticks();
 }
 
+// Counts a periodic RTC interrupt; ignored once the clock runs tickless
 void monotonic_time_increment_global(void) {
-    if (monotonic_time != NULL) {
-        atomic_fetch_add(&monotonic_time->tick_count, 1);
-    }
-}
-
-// Initialize wake-up list
-void wake_up_list_init(void) {
-    if (wake_up_list == NULL) {
-        wake_up_list = (WakeUpList*)malloc(sizeof(WakeUpList));
-        if (wake_up_list != NULL) {
-            wake_up_list->entries = NULL;
-            atomic_store(&wake_up_list->entry_count, 0);
-        }
-    }
-}
-
-void wake_up_list_add(uint32_t wake_up_tick, void (*callback)(void* data), void* callback_data) {
-    if (wake_up_list == NULL) return;
-
-    WakeUpEntry* new_entry = (WakeUpEntry*)malloc(sizeof(WakeUpEntry));
-    if (new_entry == NULL) return;
-
-    new_entry->wake_up_tick = wake_up_tick;
-    new_entry->callback = callback;
-    new_entry->callback_data = callback_data;
-    new_entry->next = wake_up_list->entries;
-    wake_up_list->entries = new_entry;
-
-    atomic_fetch_add(&wake_up_list->entry_count, 1);
-}
-
-void wake_up_list_check_and_execute(void) {
-    if (wake_up_list == NULL) return;
-
-    uint32_t current_tick = monotonic_time_get_ticks_global();
-    WakeUpEntry* current = wake_up_list->entries;
-    WakeUpEntry** prev_ptr = &wake_up_list->entries;
-
-    while (current) {
-        if (current->wake_up_tick <= current_tick) {
-            if (current->callback) {
-                current->callback(current->callback_data);
-            }
-
-            *prev_ptr = current->next;
-            WakeUpEntry* to_free = current;
-            current = current->next;
-            free(to_free);
-            atomic_fetch_sub(&wake_up_list->entry_count, 1);
-        } else {
-            prev_ptr = &current->next;
-            current = current->next;
-        }
-    }
+    clock_periodic_tick();
 }
 
 RTCDriver* init_rtc() {
@@ -99,7 +42,11 @@ RTCDriver* init_rtc() {
         return NULL;
     }
     
-    RTCDriver* rtc = (RTCDriver*)malloc(sizeof(RTCDriver));
+    if (rtc_driver_cache == NULL) {
+        rtc_driver_cache = kmem_cache_create("rtc_driver", sizeof(RTCDriver), sizeof(void*));
+    }
+
+    RTCDriver* rtc = (RTCDriver*)kmem_cache_alloc(rtc_driver_cache);
     if (rtc == NULL) {
         output_string("Failed to allocate memory for RTC driver\n");
         release_port(control_port);
@@ -116,6 +63,16 @@ RTCDriver* init_rtc() {
     return rtc;
 }
 
+void release_rtc(RTCDriver* rtc) {
+    if (rtc == NULL) {
+        return;
+    }
+
+    release_port(rtc->control_port);
+    release_port(rtc->data_port);
+    kmem_cache_free(rtc_driver_cache, rtc);
+}
+
 uint8_t read_cmos_register(RTCDriver* rtc, uint8_t reg) {
     if (rtc == NULL) {
         return 0;
@@ -251,7 +208,7 @@ int enable_rtc_interrupts(RTCDriver* rtc, interrupt_handler_t handler) {
         return -1;
     }
 
-    // Set up periodic interrupts in CMOS register A for 256 Hz
+    // Set up periodic interrupts in CMOS register A for RTC_PERIODIC_HZ
     uint8_t reg_a = read_cmos_register(rtc, CMOS_REG_A);
 
     reg_a = (reg_a & 0xF0) | 0x08;  
@@ -310,56 +267,45 @@ void acknowledge_rtc_interrupt(void) {
 }
 
 uint32_t get_system_ticks(void) {
-    return system_tick_count;
+    return clock_ticks();
+}
+
+// The timer only has to be pending for tickless idle to wake up for it
+static void sleep_timer_expired(TimerNode* timer) {
+    (void)timer;
 }
 
 void sleep_ticks(uint32_t ticks) {
     if (ticks == 0) return;
 
-    uint32_t start_tick = system_tick_count;
-    uint32_t target_tick = start_tick + ticks;
+    // Let other threads run instead of halting the whole CPU
+    if (thread_scheduler_running()) {
+        thread_sleep_ticks(ticks);
+        return;
+    }
 
-    // Enable interrupts globally before entering sleep loop
-    __asm__ volatile ("sti");
+    uint32_t target_tick = clock_ticks() + ticks;
 
-    uint32_t current_tick = start_tick;
-    uint32_t loop_counter = 0;
-    const uint32_t MAX_LOOP_COUNT = 1000000; 
+    // The node lives on this stack frame
+    TimerNode timer;
+    timer_init(&timer, sleep_timer_expired);
+    timer_add(&system_timer_wheel, &timer, target_tick);
 
-    while (current_tick < target_tick && loop_counter < MAX_LOOP_COUNT) {
-        __asm__ volatile ("hlt");  
-        current_tick = system_tick_count;
-        loop_counter++;
+    while ((int32_t)(clock_ticks() - target_tick) < 0) {
+        clock_run_timers();
+        __asm__ volatile ("cli");
+        clock_idle();
     }
 
-    if (loop_counter >= MAX_LOOP_COUNT) {
-        output_string("WARNING: Sleep function timeout - tick counter may not be working\n");
-    }
-}
-
-// Callback function to wake up the executor when sleep is complete
-static void sleep_callback(void* data) {
-    (void)data; 
-    executor_wake_up();
+    timer_cancel(&system_timer_wheel, &timer);
 }
 
 void sleep_seconds(uint32_t seconds) {
-    uint32_t ticks = seconds * 256;
-    uint32_t target_tick = monotonic_time_get_ticks_global() + ticks;
-
-    // Add to wake-up list to wake up the executor when sleep is complete
-    wake_up_list_add(target_tick, sleep_callback, NULL);
-
-    // Now we wait by letting the executor handle it
-    // In a real scenario, this would be part of a future that waits
-    for (volatile uint32_t i = 0; monotonic_time_get_ticks_global() < target_tick; i++) {
-        // Busy wait for demonstration
-        // In async system, this would be handled by the executor
-    }
+    sleep_ticks(seconds * CLOCK_TICK_HZ);
 }
 
 void sleep_seconds_async(uint32_t seconds) {
-    uint32_t ticks = seconds * 256;
+    uint32_t ticks = seconds * CLOCK_TICK_HZ;
     Future* sleep_future = sleep_future_create(ticks);
     if (sleep_future != NULL) {
         Executor* executor = get_global_executor();
@@ -371,27 +317,19 @@ void sleep_seconds_async(uint32_t seconds) {
 static FutureState async_rtc_future_poll(Future* future, void* context) {
     AsyncRTCFuture* async_rtc = (AsyncRTCFuture*)future;
 
-    // For simplicity, we'll consider the RTC read as immediately available
-    // In a real implementation, this would check if the RTC is ready
-    if (async_rtc->rtc != NULL && async_rtc->seconds != NULL &&
-        async_rtc->minutes != NULL && async_rtc->hours != NULL) {
-
-        // Perform the RTC read
-        int result = read_rtc_time(async_rtc->rtc, async_rtc->seconds,
-                                  async_rtc->minutes, async_rtc->hours);
+    ASYNC_BEGIN(&async_rtc->frame, context);
 
-        // If read was successful, mark as ready
-        if (result != -1) {
-            return FUTURE_READY;
-        }
+    // The read fails while an update is in progress; try again on the next pass
+    while (read_rtc_time(async_rtc->rtc, async_rtc->seconds,
+                         async_rtc->minutes, async_rtc->hours) == -1) {
+        ASYNC_YIELD();
     }
 
-    return FUTURE_PENDING;
+    ASYNC_END();
 }
 
 static void async_rtc_future_cleanup(Future* future) {
-    // Free the async RTC future
-    free(future);
+    async_frame_cleanup(&((AsyncRTCFuture*)future)->frame);
 }
 
 static const FutureVTable async_rtc_future_vtable = {
@@ -400,6 +338,10 @@ static const FutureVTable async_rtc_future_vtable = {
 };
 
 Future* async_rtc_read_time_create(RTCDriver* rtc, uint8_t* seconds, uint8_t* minutes, uint8_t* hours) {
+    if (rtc == NULL || seconds == NULL || minutes == NULL || hours == NULL) {
+        return NULL;
+    }
+
     AsyncRTCFuture* async_rtc = (AsyncRTCFuture*)malloc(sizeof(AsyncRTCFuture));
     if (!async_rtc) {
         return NULL;
@@ -408,6 +350,7 @@ Future* async_rtc_read_time_create(RTCDriver* rtc, uint8_t* seconds, uint8_t* mi
     async_rtc->base.vtable = &async_rtc_future_vtable;
     async_rtc->base.is_completed = false;
     async_rtc->base.waker = NULL;
+    async_frame_init(&async_rtc->frame);
     async_rtc->rtc = rtc;
     async_rtc->seconds = seconds;
     async_rtc->minutes = minutes;
@@ -7,6 +7,7 @@
 #include "port_manager.h"
 #include "idt.h"
 #include "async_executor.h"  
+#include "coroutine.h"
 
 #define CMOS_REG_SECONDS        0x00
 #define CMOS_REG_MINUTES        0x02
@@ -25,6 +26,9 @@
 
 #define NMI_DISABLE_MASK        0x80
 
+// Rate of the periodic interrupt set up by enable_rtc_interrupts
+#define RTC_PERIODIC_HZ         256
+
 typedef struct {
     PortHandle* control_port;  
     PortHandle* data_port;     
@@ -33,6 +37,8 @@ typedef struct {
 
 RTCDriver* init_rtc();
 
+void release_rtc(RTCDriver* rtc);
+
 uint8_t read_cmos_register(RTCDriver* rtc, uint8_t reg);
 
 void write_cmos_register(RTCDriver* rtc, uint8_t reg, uint8_t value);
@@ -56,6 +62,7 @@ void acknowledge_rtc_interrupt(void);
 // Async RTC functionality
 typedef struct {
     Future base;
+    AsyncFrame frame;
     RTCDriver* rtc;
     uint8_t* seconds;
     uint8_t* minutes;
@@ -68,40 +75,17 @@ extern volatile uint32_t system_tick_count;
 
 uint32_t get_system_ticks(void);
 
+// Blocks the caller. Once the scheduler runs, only the calling thread
+// sleeps; before that the CPU halts between interrupts.
 void sleep_ticks(uint32_t ticks);
 
 void sleep_seconds(uint32_t seconds);
 
 void sleep_seconds_async(uint32_t seconds);
 
-// Async time management
-typedef struct {
-    atomic_uint_fast32_t tick_count;
-} MonotonicTime;
-
-extern MonotonicTime* monotonic_time;
-
+// Async time management, in CLOCK_TICK_HZ ticks. Wrappers over clock.h.
 void monotonic_time_init_global(void);
 uint32_t monotonic_time_get_ticks_global(void);
 void monotonic_time_increment_global(void);
 
-// Wake-up list for sleep futures
-typedef struct WakeUpEntry {
-    uint32_t wake_up_tick;
-    void (*callback)(void* data);
-    void* callback_data;
-    struct WakeUpEntry* next;
-} WakeUpEntry;
-
-typedef struct {
-    WakeUpEntry* entries;
-    atomic_uint_fast32_t entry_count;
-} WakeUpList;
-
-extern WakeUpList* wake_up_list;
-
-void wake_up_list_init(void);
-void wake_up_list_add(uint32_t wake_up_tick, void (*callback)(void* data), void* callback_data);
-void wake_up_list_check_and_execute(void);
-
 #endif
\ No newline at end of file
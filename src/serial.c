@@ -0,0 +1,497 @@
+#include "serial.h"
+#include "io.h"
+#include "idt.h"
+#include "memory.h"
+#include "spinlock.h"
+#include <stdatomic.h>
+
+#define UART_DATA(base)             (base)
+#define UART_INTERRUPT_ENABLE(base) ((base) + 1)
+#define UART_INTERRUPT_ID(base)     ((base) + 2)
+#define UART_FIFO_CONTROL(base)     ((base) + 2)
+#define UART_LINE_STATUS(base)      ((base) + 5)
+
+#define UART_IER_RX_DATA            0x01    // Also enables the character timeout
+#define UART_IER_THRE               0x02
+#define UART_IER_LINE_STATUS        0x04
+
+#define UART_IIR_NONE_PENDING       0x01
+#define UART_IIR_ID_MASK            0x0E
+#define UART_IIR_THRE               0x02
+#define UART_IIR_RX_DATA            0x04
+#define UART_IIR_LINE_STATUS        0x06
+#define UART_IIR_RX_TIMEOUT         0x0C
+
+// Enable, clear the receive FIFO only, interrupt at 8 bytes
+#define UART_FCR_RX_TRIGGER_8       0x83
+
+#define UART_LSR_DATA_READY         0x01
+#define UART_LSR_OVERRUN            0x02
+#define UART_LSR_THRE               0x20
+
+#define SERIAL_TX_MASK (SERIAL_TX_RING_SIZE - 1)
+#define SERIAL_RX_MASK (SERIAL_RX_RING_SIZE - 1)
+
+// Tasks on any CPU write and read, and the interrupt handler runs on the
+// BSP, so serial_lock, taken with interrupts off, covers both rings' index
+// updates, the IER copy, the waiter lists and the line state. The indices
+// stay atomic for the lock-free position queries.
+static Spinlock serial_lock = SPINLOCK_INIT;
+
+static char serial_tx_ring[SERIAL_TX_RING_SIZE];
+static atomic_uint_fast32_t serial_tx_head;
+static atomic_uint_fast32_t serial_tx_tail;
+
+static SerialWaiter* serial_tx_waiters;
+static uint8_t serial_ier;
+
+// The other way round: the interrupt handler produces, readers consume.
+static char serial_rx_ring[SERIAL_RX_RING_SIZE];
+static atomic_uint_fast32_t serial_rx_head;
+static atomic_uint_fast32_t serial_rx_tail;
+static atomic_uint_fast32_t serial_rx_dropped;
+static atomic_uint_fast32_t serial_rx_overruns;
+
+static SerialWaiter* serial_rx_waiters;
+
+// A '\n' straight after a '\r' ends no line of its own
+static bool serial_line_after_cr;
+
+static inline bool serial_position_reached(uint32_t position, uint32_t until) {
+    return (int32_t)(position - until) >= 0;
+}
+
+static void serial_set_ier(uint8_t ier) {
+    if (ier != serial_ier) {
+        serial_ier = ier;
+        out_b(UART_INTERRUPT_ENABLE(SERIAL_COM1_PORT), ier);
+    }
+}
+
+// Wakes every waiter on `list` whose position has been reached.
+// serial_lock is held.
+static void serial_wake_waiters(SerialWaiter** list, uint32_t position) {
+    SerialWaiter** link = list;
+
+    while (*link != NULL) {
+        SerialWaiter* waiter = *link;
+        if (!serial_position_reached(position, waiter->until)) {
+            link = &waiter->next;
+            continue;
+        }
+
+        *link = waiter->next;
+        waiter->next = NULL;
+
+        Waker* waker = waiter->waker;
+        waiter->waker = NULL;
+        waker_wake(waker);
+        waker_drop(waker);
+    }
+}
+
+static bool serial_wait(SerialWaiter** list, atomic_uint_fast32_t* position,
+                        SerialWaiter* waiter, uint32_t until, Waker* waker) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+
+    if (serial_position_reached(atomic_load(position), until)) {
+        spin_unlock_irqrestore(&serial_lock, flags);
+        return false;
+    }
+
+    waiter->until = until;
+    if (waiter->waker == NULL) {
+        waiter->waker = waker_clone(waker);
+        waiter->next = *list;
+        *list = waiter;
+    }
+
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return true;
+}
+
+static void serial_cancel(SerialWaiter** list, SerialWaiter* waiter) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+
+    Waker* waker = waiter->waker;
+    if (waker != NULL) {
+        SerialWaiter** link = list;
+        while (*link != waiter) {
+            link = &(*link)->next;
+        }
+        *link = waiter->next;
+        waiter->next = NULL;
+        waiter->waker = NULL;
+    }
+
+    spin_unlock_irqrestore(&serial_lock, flags);
+
+    if (waker != NULL) {
+        waker_drop(waker);
+    }
+}
+
+// Moves up to a FIFO's worth of bytes into the UART, which must report its
+// transmit FIFO empty. serial_lock is held.
+static void serial_tx_fill(void) {
+    uint32_t tail = atomic_load_explicit(&serial_tx_tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&serial_tx_head, memory_order_acquire);
+
+    for (uint32_t n = 0; tail != head && n < SERIAL_FIFO_DEPTH; n++) {
+        out_b(UART_DATA(SERIAL_COM1_PORT), serial_tx_ring[tail & SERIAL_TX_MASK]);
+        tail++;
+    }
+    atomic_store_explicit(&serial_tx_tail, tail, memory_order_release);
+
+    // Only ask for the THR-empty interrupt while there is more to send
+    if (tail != head) {
+        serial_set_ier(serial_ier | UART_IER_THRE);
+    } else {
+        serial_set_ier(serial_ier & ~UART_IER_THRE);
+    }
+
+    serial_wake_waiters(&serial_tx_waiters, tail);
+}
+
+void serial_rx_receive(void) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    uint32_t head = atomic_load_explicit(&serial_rx_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&serial_rx_tail, memory_order_acquire);
+    uint32_t received = 0;
+    uint32_t overruns = 0;
+
+    // Every LSR read clears the overrun bit, so count it on each one.
+    for (;;) {
+        uint8_t lsr = in_b(UART_LINE_STATUS(SERIAL_COM1_PORT));
+        if (lsr & UART_LSR_OVERRUN) {
+            overruns++;
+        }
+        if ((lsr & UART_LSR_DATA_READY) == 0) {
+            break;
+        }
+
+        char c = (char)in_b(UART_DATA(SERIAL_COM1_PORT));
+        if (head - tail == SERIAL_RX_RING_SIZE) {
+            atomic_fetch_add_explicit(&serial_rx_dropped, 1, memory_order_relaxed);
+            continue;
+        }
+        serial_rx_ring[head & SERIAL_RX_MASK] = c;
+        head++;
+        received++;
+    }
+
+    if (overruns != 0) {
+        atomic_fetch_add_explicit(&serial_rx_overruns, overruns, memory_order_relaxed);
+    }
+    if (received != 0) {
+        atomic_store_explicit(&serial_rx_head, head, memory_order_release);
+        serial_wake_waiters(&serial_rx_waiters, head);
+    }
+
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+int serial_enable_interrupts(void) {
+    IrqId serial_irq;
+    serial_irq.type = IRQ_PIC1;
+    serial_irq.index = SERIAL_IRQ;
+
+    if (register_interrupt_handler_irq(serial_irq, serial_interrupt_handler) != 0) {
+        return -1;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    out_b(UART_FIFO_CONTROL(SERIAL_COM1_PORT), UART_FCR_RX_TRIGGER_8);
+    serial_set_ier(serial_ier | UART_IER_RX_DATA | UART_IER_LINE_STATUS);
+    spin_unlock_irqrestore(&serial_lock, flags);
+
+    pic_unmask_irq(SERIAL_IRQ);
+    return 0;
+}
+
+void serial_interrupt_handler(void) {
+    uint8_t iir;
+
+    while (((iir = in_b(UART_INTERRUPT_ID(SERIAL_COM1_PORT))) & UART_IIR_NONE_PENDING) == 0) {
+        switch (iir & UART_IIR_ID_MASK) {
+            case UART_IIR_RX_DATA:
+            case UART_IIR_RX_TIMEOUT:
+                // Either the FIFO reached its trigger level or bytes below
+                // it have sat for four character times: take them all.
+                serial_rx_receive();
+                break;
+            case UART_IIR_THRE: {
+                uint32_t flags = spin_lock_irqsave(&serial_lock);
+                serial_tx_fill();
+                spin_unlock_irqrestore(&serial_lock, flags);
+                break;
+            }
+            case UART_IIR_LINE_STATUS:
+                if (in_b(UART_LINE_STATUS(SERIAL_COM1_PORT)) & UART_LSR_OVERRUN) {
+                    atomic_fetch_add_explicit(&serial_rx_overruns, 1, memory_order_relaxed);
+                }
+                break;
+            default:
+                // Modem status, which this driver never enables; stop
+                // here rather than spin.
+                return;
+        }
+    }
+}
+
+size_t serial_tx_write(const char* data, size_t len, uint32_t* end) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    uint32_t head = atomic_load_explicit(&serial_tx_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&serial_tx_tail, memory_order_acquire);
+    uint32_t space = SERIAL_TX_RING_SIZE - (head - tail);
+
+    size_t count = len < space ? len : space;
+    for (size_t i = 0; i < count; i++) {
+        serial_tx_ring[(head + i) & SERIAL_TX_MASK] = data[i];
+    }
+    head += count;
+    atomic_store_explicit(&serial_tx_head, head, memory_order_release);
+    *end = head;
+
+    // An idle transmitter raises no interrupt, so start it here. A busy one
+    // has the THR-empty interrupt enabled and picks the bytes up itself.
+    if ((serial_ier & UART_IER_THRE) == 0 &&
+        (in_b(UART_LINE_STATUS(SERIAL_COM1_PORT)) & UART_LSR_THRE) != 0) {
+        serial_tx_fill();
+    } else {
+        serial_set_ier(serial_ier | UART_IER_THRE);
+    }
+
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return count;
+}
+
+uint32_t serial_tx_position(void) {
+    return atomic_load(&serial_tx_head);
+}
+
+bool serial_tx_wait(SerialWaiter* waiter, uint32_t until, Waker* waker) {
+    return serial_wait(&serial_tx_waiters, &serial_tx_tail, waiter, until, waker);
+}
+
+void serial_tx_cancel(SerialWaiter* waiter) {
+    serial_cancel(&serial_tx_waiters, waiter);
+}
+
+// serial_lock is held.
+static size_t serial_rx_take(char* buffer, size_t len) {
+    uint32_t tail = atomic_load_explicit(&serial_rx_tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&serial_rx_head, memory_order_acquire);
+
+    size_t count = head - tail;
+    if (count > len) {
+        count = len;
+    }
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = serial_rx_ring[(tail + i) & SERIAL_RX_MASK];
+    }
+    atomic_store_explicit(&serial_rx_tail, tail + count, memory_order_release);
+
+    return count;
+}
+
+size_t serial_rx_read(char* buffer, size_t len) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    size_t count = serial_rx_take(buffer, len);
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return count;
+}
+
+// Takes the next byte of a line, swallowing the '\n' of a "\r\n" pair.
+// Returns false if none has arrived yet.
+static bool serial_rx_take_line_char(char* c) {
+    uint32_t flags = spin_lock_irqsave(&serial_lock);
+    bool taken = false;
+
+    while (serial_rx_take(c, 1) != 0) {
+        bool after_cr = serial_line_after_cr;
+        serial_line_after_cr = *c == '\r';
+        if (*c != '\n' || !after_cr) {
+            taken = true;
+            break;
+        }
+    }
+
+    spin_unlock_irqrestore(&serial_lock, flags);
+    return taken;
+}
+
+bool serial_rx_wait(SerialWaiter* waiter, Waker* waker) {
+    uint32_t tail = atomic_load_explicit(&serial_rx_tail, memory_order_relaxed);
+    return serial_wait(&serial_rx_waiters, &serial_rx_head, waiter, tail + 1, waker);
+}
+
+void serial_rx_cancel(SerialWaiter* waiter) {
+    serial_cancel(&serial_rx_waiters, waiter);
+}
+
+uint32_t serial_rx_dropped_count(void) {
+    return atomic_load(&serial_rx_dropped) + atomic_load(&serial_rx_overruns);
+}
+
+// Queues as much as fits, then sleeps until the bytes are out or, while
+// some are still to be queued, until half the ring is free again.
+static FutureState async_serial_write_poll(Future* future, void* context) {
+    AsyncSerialWriteFuture* serial_future = (AsyncSerialWriteFuture*)future;
+
+    while (1) {
+        if (serial_future->written < serial_future->len) {
+            serial_future->written += serial_tx_write(serial_future->data + serial_future->written,
+                                                      serial_future->len - serial_future->written,
+                                                      &serial_future->end);
+        }
+
+        bool queued = serial_future->written == serial_future->len;
+        uint32_t until = queued ? serial_future->end
+                                : serial_future->end - SERIAL_TX_RING_SIZE / 2;
+
+        if (serial_tx_wait(&serial_future->waiter, until, (Waker*)context)) {
+            return FUTURE_PENDING;
+        }
+        if (queued) {
+            return FUTURE_READY;
+        }
+    }
+}
+
+static void async_serial_write_cleanup(Future* future) {
+    AsyncSerialWriteFuture* serial_future = (AsyncSerialWriteFuture*)future;
+
+    // Bytes already queued still go out
+    serial_tx_cancel(&serial_future->waiter);
+}
+
+static const FutureVTable async_serial_write_vtable = {
+    .poll = async_serial_write_poll,
+    .cleanup = async_serial_write_cleanup
+};
+
+Future* async_serial_write_create(const char* data, size_t len) {
+    AsyncSerialWriteFuture* serial_future = (AsyncSerialWriteFuture*)malloc(sizeof(AsyncSerialWriteFuture));
+    if (!serial_future) {
+        return NULL;
+    }
+
+    serial_future->base.vtable = &async_serial_write_vtable;
+    serial_future->base.is_completed = false;
+    serial_future->base.waker = NULL;
+    serial_future->data = data;
+    serial_future->len = len;
+    serial_future->written = 0;
+    // An empty write completes once everything queued before it is out
+    serial_future->end = serial_tx_position();
+    serial_future->waiter.next = NULL;
+    serial_future->waiter.waker = NULL;
+
+    return (Future*)serial_future;
+}
+
+static FutureState async_serial_read_poll(Future* future, void* context) {
+    AsyncSerialReadFuture* read_future = (AsyncSerialReadFuture*)future;
+
+    while (1) {
+        size_t count = serial_rx_read(read_future->buffer, read_future->len);
+        if (count != 0 || read_future->len == 0) {
+            *read_future->received = count;
+            return FUTURE_READY;
+        }
+        if (serial_rx_wait(&read_future->waiter, (Waker*)context)) {
+            return FUTURE_PENDING;
+        }
+    }
+}
+
+static void async_serial_read_cleanup(Future* future) {
+    serial_rx_cancel(&((AsyncSerialReadFuture*)future)->waiter);
+}
+
+static const FutureVTable async_serial_read_vtable = {
+    .poll = async_serial_read_poll,
+    .cleanup = async_serial_read_cleanup
+};
+
+Future* async_serial_read_create(char* buffer, size_t len, size_t* received) {
+    AsyncSerialReadFuture* read_future = (AsyncSerialReadFuture*)malloc(sizeof(AsyncSerialReadFuture));
+    if (!read_future) {
+        return NULL;
+    }
+
+    read_future->base.vtable = &async_serial_read_vtable;
+    read_future->base.is_completed = false;
+    read_future->base.waker = NULL;
+    read_future->buffer = buffer;
+    read_future->len = len;
+    read_future->received = received;
+    read_future->waiter.next = NULL;
+    read_future->waiter.waker = NULL;
+
+    return (Future*)read_future;
+}
+
+// Takes bytes one at a time, so whatever follows the line stays in the ring
+// for the next reader.
+static FutureState async_serial_read_line_poll(Future* future, void* context) {
+    AsyncSerialReadLineFuture* line_future = (AsyncSerialReadLineFuture*)future;
+
+    while (1) {
+        char c;
+        if (!serial_rx_take_line_char(&c)) {
+            if (serial_rx_wait(&line_future->waiter, (Waker*)context)) {
+                return FUTURE_PENDING;
+            }
+            continue;
+        }
+
+        if (c == '\r' || c == '\n') {
+            break;
+        }
+
+        line_future->buffer[line_future->length++] = c;
+        if (line_future->length == line_future->size - 1) {
+            // Full: the rest of the line comes with the next read
+            break;
+        }
+    }
+
+    line_future->buffer[line_future->length] = '\0';
+    *line_future->line_length = line_future->length;
+    return FUTURE_READY;
+}
+
+static void async_serial_read_line_cleanup(Future* future) {
+    serial_rx_cancel(&((AsyncSerialReadLineFuture*)future)->waiter);
+}
+
+static const FutureVTable async_serial_read_line_vtable = {
+    .poll = async_serial_read_line_poll,
+    .cleanup = async_serial_read_line_cleanup
+};
+
+Future* async_serial_read_line_create(char* buffer, size_t size, size_t* length) {
+    if (buffer == NULL || size < 2) {
+        return NULL;
+    }
+
+    AsyncSerialReadLineFuture* line_future =
+        (AsyncSerialReadLineFuture*)malloc(sizeof(AsyncSerialReadLineFuture));
+    if (!line_future) {
+        return NULL;
+    }
+
+    line_future->base.vtable = &async_serial_read_line_vtable;
+    line_future->base.is_completed = false;
+    line_future->base.waker = NULL;
+    line_future->buffer = buffer;
+    line_future->size = size;
+    line_future->length = 0;
+    line_future->line_length = length;
+    line_future->waiter.next = NULL;
+    line_future->waiter.waker = NULL;
+
+    return (Future*)line_future;
+}
@@ -0,0 +1,111 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "async_executor.h"
+
+// Interrupt-driven driver for COM1, on top of the port set up by
+// init_serial. Transmitted bytes are queued in a kernel ring and moved into
+// the 16550 FIFO, a FIFO's worth at a time, by the THR-empty interrupt. The
+// polled write_serial used by output_string bypasses the ring, so the two
+// streams may interleave. Received bytes raise an interrupt only once the
+// RX FIFO reaches its trigger level, or after the line goes quiet with
+// fewer queued, and each interrupt empties the FIFO into a receive ring.
+// Every call below is safe from any CPU.
+#define SERIAL_COM1_PORT        0x3F8
+#define SERIAL_IRQ              4
+#define SERIAL_FIFO_DEPTH       16
+#define SERIAL_TX_RING_SIZE     1024
+#define SERIAL_RX_RING_SIZE     1024
+
+_Static_assert((SERIAL_TX_RING_SIZE & (SERIAL_TX_RING_SIZE - 1)) == 0,
+               "the ring is indexed by masking");
+_Static_assert((SERIAL_RX_RING_SIZE & (SERIAL_RX_RING_SIZE - 1)) == 0,
+               "the ring is indexed by masking");
+
+// Parks a waker until a ring position reaches `until`: the transmit ring's
+// read side or the receive ring's write side. Embed one in whatever waits.
+typedef struct SerialWaiter {
+    struct SerialWaiter* next;
+    uint32_t until;
+    Waker* waker;               // Cloned reference; NULL when not waiting
+} SerialWaiter;
+
+// Registers the IRQ 4 handler, sets the RX trigger level, enables the
+// receive interrupts and unmasks IRQ 4. Returns 0 on success.
+int serial_enable_interrupts(void);
+
+void serial_interrupt_handler(void);
+
+// Queues up to `len` bytes without blocking and starts the transmitter.
+// Returns the number queued; `end` receives the ring position just past
+// the last of them.
+size_t serial_tx_write(const char* data, size_t len, uint32_t* end);
+
+// Ring position just past the last byte queued so far.
+uint32_t serial_tx_position(void);
+
+// Returns false if every byte before `until` has reached the UART already.
+// Otherwise arranges for `waker` to be woken when they have, and returns
+// true. Re-arming a waiting waiter only moves its position.
+bool serial_tx_wait(SerialWaiter* waiter, uint32_t until, Waker* waker);
+
+void serial_tx_cancel(SerialWaiter* waiter);
+
+// Moves whatever the RX FIFO holds into the receive ring and wakes readers.
+// The interrupt handler's receive path.
+void serial_rx_receive(void);
+
+// Takes up to `len` received bytes without blocking. There is one reader:
+// concurrent readers would split the stream between them.
+size_t serial_rx_read(char* buffer, size_t len);
+
+// Returns false if a byte is already waiting. Otherwise arranges for
+// `waker` to be woken when one arrives, and returns true.
+bool serial_rx_wait(SerialWaiter* waiter, Waker* waker);
+
+void serial_rx_cancel(SerialWaiter* waiter);
+
+// Bytes lost to a full receive ring or a UART overrun.
+uint32_t serial_rx_dropped_count(void);
+
+// Completes once all of `data` has been handed to the UART. `data` must
+// stay valid until then; nothing is written to the screen.
+typedef struct {
+    Future base;
+    const char* data;
+    size_t len;
+    size_t written;             // Bytes queued in the ring so far
+    uint32_t end;               // Ring position after the last queued byte
+    SerialWaiter waiter;
+} AsyncSerialWriteFuture;
+
+Future* async_serial_write_create(const char* data, size_t len);
+
+// Completes with at least one byte, as many as are waiting up to `len`.
+typedef struct {
+    Future base;
+    char* buffer;
+    size_t len;
+    size_t* received;
+    SerialWaiter waiter;
+} AsyncSerialReadFuture;
+
+Future* async_serial_read_create(char* buffer, size_t len, size_t* received);
+
+// Completes with one line, NUL-terminated and without its "\r", "\n" or
+// "\r\n". A line that does not fit `size` is returned in pieces.
+typedef struct {
+    Future base;
+    char* buffer;
+    size_t size;
+    size_t length;
+    size_t* line_length;
+    SerialWaiter waiter;
+} AsyncSerialReadLineFuture;
+
+Future* async_serial_read_line_create(char* buffer, size_t size, size_t* length);
+
+#endif
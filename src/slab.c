@@ -0,0 +1,223 @@
+#include "slab.h"
+#include "memory.h"
+#include "memory_profile.h"
+#include "page_allocator.h"
+#include "terminal.h"
+#include "thread.h"
+#include <stdbool.h>
+
+static inline size_t slab_align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static inline Slab* slab_of(void* object) {
+    return (Slab*)((uintptr_t)object & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+#ifdef MEMORY_PROFILE
+// Profiled caches append a tag to every object; the caller sees the object
+// size it asked for.
+#define SLAB_PROFILE_TAG_SIZE sizeof(MemoryProfileTag)
+
+static inline MemoryProfileTag* slab_profile_tag(KmemCache* cache, void* object) {
+    return (MemoryProfileTag*)((uint8_t*)object + cache->object_size - SLAB_PROFILE_TAG_SIZE);
+}
+
+#define SLAB_PROFILE_ALLOC(cache, object) \
+    memory_profile_record_alloc(slab_profile_tag((cache), (object)), __builtin_return_address(0), \
+                                (cache)->object_size - SLAB_PROFILE_TAG_SIZE)
+#define SLAB_PROFILE_FREE(cache, object) memory_profile_record_free(slab_profile_tag((cache), (object)))
+#else
+#define SLAB_PROFILE_TAG_SIZE 0
+#define SLAB_PROFILE_ALLOC(cache, object) ((void)0)
+#define SLAB_PROFILE_FREE(cache, object) ((void)0)
+#endif
+
+static void slab_list_push(Slab** head, Slab* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_list_remove(Slab** head, Slab* slab) {
+    if (slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+KmemCache* kmem_cache_create(const char* name, size_t object_size, size_t align) {
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+    if (object_size < sizeof(void*)) {
+        object_size = sizeof(void*);
+    }
+
+    object_size = slab_align_up(object_size + SLAB_PROFILE_TAG_SIZE, align);
+    size_t object_offset = slab_align_up(sizeof(Slab), align);
+
+    if (object_offset + object_size > SLAB_SIZE) {
+        return NULL;
+    }
+
+    KmemCache* cache = (KmemCache*)malloc(sizeof(KmemCache));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    cache->name = name;
+    cache->object_size = object_size;
+    cache->object_offset = object_offset;
+    cache->objects_per_slab = (SLAB_SIZE - object_offset) / object_size;
+    cache->partial_slabs = NULL;
+    cache->full_slabs = NULL;
+    cache->empty_slab = NULL;
+    cache->slab_count = 0;
+    spin_lock_init(&cache->lock);
+
+    return cache;
+}
+
+static Slab* slab_create(KmemCache* cache) {
+    Slab* slab = (Slab*)alloc_pages(0);
+    if (slab == NULL) {
+        return NULL;
+    }
+
+    slab->cache = cache;
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->in_use = 0;
+    slab->free_objects = NULL;
+
+    // Thread the free list back to front so objects are handed out in
+    // address order.
+    uint8_t* objects = (uint8_t*)slab + cache->object_offset;
+    for (uint32_t i = cache->objects_per_slab; i > 0; i--) {
+        void** object = (void**)(objects + (i - 1) * cache->object_size);
+        *object = slab->free_objects;
+        slab->free_objects = object;
+    }
+
+    cache->slab_count++;
+    return slab;
+}
+
+static void slab_release(KmemCache* cache, Slab* slab) {
+    cache->slab_count--;
+    free_pages(slab, 0);
+}
+
+void* kmem_cache_alloc(KmemCache* cache) {
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    // Caches are shared between threads and CPUs; stay on the CPU while
+    // holding the lock
+    preempt_disable();
+    spin_lock(&cache->lock);
+
+    Slab* slab = cache->partial_slabs;
+    if (slab == NULL) {
+        if (cache->empty_slab != NULL) {
+            slab = cache->empty_slab;
+            cache->empty_slab = NULL;
+        } else {
+            slab = slab_create(cache);
+            if (slab == NULL) {
+                spin_unlock(&cache->lock);
+                preempt_enable();
+                return NULL;
+            }
+        }
+        slab_list_push(&cache->partial_slabs, slab);
+    }
+
+    void** object = (void**)slab->free_objects;
+    slab->free_objects = *object;
+    slab->in_use++;
+
+    if (slab->free_objects == NULL) {
+        slab_list_remove(&cache->partial_slabs, slab);
+        slab_list_push(&cache->full_slabs, slab);
+    }
+
+    SLAB_PROFILE_ALLOC(cache, object);
+    spin_unlock(&cache->lock);
+    preempt_enable();
+    return object;
+}
+
+void kmem_cache_free(KmemCache* cache, void* object) {
+    if (cache == NULL || object == NULL) {
+        return;
+    }
+
+    Slab* slab = slab_of(object);
+    if (slab->cache != cache) {
+        output_string("kmem_cache_free: object does not belong to cache ");
+        output_string(cache->name);
+        output_string("\n");
+        return;
+    }
+
+    preempt_disable();
+    spin_lock(&cache->lock);
+    SLAB_PROFILE_FREE(cache, object);
+    bool was_full = slab->free_objects == NULL;
+
+    *(void**)object = slab->free_objects;
+    slab->free_objects = object;
+    slab->in_use--;
+
+    if (was_full) {
+        slab_list_remove(&cache->full_slabs, slab);
+        slab_list_push(&cache->partial_slabs, slab);
+    }
+
+    if (slab->in_use == 0) {
+        slab_list_remove(&cache->partial_slabs, slab);
+        if (cache->empty_slab == NULL) {
+            cache->empty_slab = slab;
+        } else {
+            slab_release(cache, slab);
+        }
+    }
+    spin_unlock(&cache->lock);
+    preempt_enable();
+}
+
+void kmem_cache_destroy(KmemCache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    while (cache->partial_slabs != NULL) {
+        Slab* slab = cache->partial_slabs;
+        slab_list_remove(&cache->partial_slabs, slab);
+        slab_release(cache, slab);
+    }
+
+    while (cache->full_slabs != NULL) {
+        Slab* slab = cache->full_slabs;
+        slab_list_remove(&cache->full_slabs, slab);
+        slab_release(cache, slab);
+    }
+
+    if (cache->empty_slab != NULL) {
+        slab_release(cache, cache->empty_slab);
+    }
+
+    free(cache);
+}
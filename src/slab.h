@@ -0,0 +1,42 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "spinlock.h"
+
+// Every slab is one page from the page allocator, so an object's slab is
+// found by masking its address.
+#define SLAB_SIZE 4096
+
+typedef struct KmemCache KmemCache;
+
+typedef struct Slab {
+    KmemCache* cache;
+    struct Slab* next;
+    struct Slab* prev;
+    void* free_objects;
+    uint32_t in_use;
+} Slab;
+
+struct KmemCache {
+    const char* name;
+    size_t object_size;
+    size_t object_offset;       // Offset of the first object inside a slab
+    uint32_t objects_per_slab;
+    Slab* partial_slabs;        // Slabs with at least one free object
+    Slab* full_slabs;
+    Slab* empty_slab;           // One fully free slab kept to absorb alloc/free churn
+    uint32_t slab_count;
+    Spinlock lock;              // Taken with preemption disabled
+};
+
+KmemCache* kmem_cache_create(const char* name, size_t object_size, size_t align);
+
+void* kmem_cache_alloc(KmemCache* cache);
+
+void kmem_cache_free(KmemCache* cache, void* object);
+
+void kmem_cache_destroy(KmemCache* cache);
+
+#endif
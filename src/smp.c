@@ -0,0 +1,532 @@
+#include "smp.h"
+#include "lapic.h"
+#include "async_executor.h"
+#include "coroutine.h"
+#include "clock.h"
+#include "gdt.h"
+#include "idt.h"
+#include "page_allocator.h"
+#include "memory.h"
+#include "terminal.h"
+#include "libc.h"
+#include "io.h"
+#include <stddef.h>
+
+#define MP_SIGNATURE            0x5F504D5F      // "_MP_"
+#define MP_CONFIG_SIGNATURE     0x504D4350      // "PCMP"
+#define MP_ENTRY_PROCESSOR      0
+#define MP_PROCESSOR_SIZE       20
+#define MP_OTHER_ENTRY_SIZE     8
+#define MP_CPU_ENABLED          0x01
+#define MP_CPU_BSP              0x02
+
+#define BIOS_EBDA_SEGMENT       0x40E
+#define BIOS_BASE_MEMORY_KB     0x413
+#define BIOS_ROM_START          0xF0000
+#define BIOS_ROM_SIZE           0x10000
+
+#define SMP_AP_START_TIMEOUT    (CLOCK_TICK_HZ / 10)
+
+#define SMP_BENCH_CHUNK_ITERATIONS 4096
+
+typedef struct {
+    uint32_t signature;
+    uint32_t config_table;
+    uint8_t length;             // In 16-byte units
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t default_config;     // Non-zero: a standard layout and no table
+    uint8_t features[4];
+} __attribute__((packed)) MpFloatingPointer;
+
+typedef struct {
+    uint32_t signature;
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t extended_length;
+    uint8_t extended_checksum;
+    uint8_t reserved;
+} __attribute__((packed)) MpConfigTable;
+
+typedef struct {
+    uint8_t type;
+    uint8_t apic_id;
+    uint8_t apic_version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed)) MpProcessorEntry;
+
+// Layout of ap_trampoline_params in ap_trampoline.s.
+typedef struct {
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t cr0;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t cpu;
+    uint32_t apic_id;           // The only AP that may use the block
+    uint32_t apic_id_register;  // Physical address of the local APIC ID
+    atomic_uint claimed;        // Set by that AP, or by the BSP giving up
+} ApTrampolineParams;
+
+_Static_assert(sizeof(ApTrampolineParams) == 36, "the block is .skip 36 in ap_trampoline.s");
+
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_params[];
+extern uint8_t ap_trampoline_end[];
+
+static Cpu cpus[SMP_MAX_CPUS];
+static Executor ap_executors[SMP_MAX_CPUS];
+static uint8_t apic_to_cpu[256];
+
+// Until a second CPU is started every caller is the BSP, and
+// smp_cpu_index does not touch the local APIC.
+static atomic_uint cpus_started = 1;
+static atomic_uint cpus_online = 1;
+static atomic_uint cpus_active = SMP_MAX_CPUS;
+
+static uint32_t lapic_id_register;
+
+// An AP claimed its parameters but never came online; its slot and the
+// parameter block may still be in use, so no more APs are started.
+static bool ap_start_stuck = false;
+
+static inline uint32_t smp_read_cr0(void) {
+    uint32_t value;
+    __asm__ volatile ("movl %%cr0, %0" : "=r" (value));
+    return value;
+}
+
+static inline uint32_t smp_read_cr3(void) {
+    uint32_t value;
+    __asm__ volatile ("movl %%cr3, %0" : "=r" (value));
+    return value;
+}
+
+static inline uint32_t smp_read_cr4(void) {
+    uint32_t value;
+    __asm__ volatile ("movl %%cr4, %0" : "=r" (value));
+    return value;
+}
+
+static bool mp_checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+static const MpFloatingPointer* mp_scan(uint32_t start, uint32_t length) {
+    for (uint32_t addr = start; addr + sizeof(MpFloatingPointer) <= start + length; addr += 16) {
+        const MpFloatingPointer* pointer = (const MpFloatingPointer*)(uintptr_t)addr;
+        if (pointer->signature == MP_SIGNATURE && pointer->length != 0 &&
+            mp_checksum_ok(pointer, pointer->length * 16u)) {
+            return pointer;
+        }
+    }
+    return NULL;
+}
+
+// The floating pointer is in the first KiB of the EBDA, the last KiB of
+// base memory or the BIOS ROM, in that order of preference.
+static const MpConfigTable* mp_find_config(void) {
+    const MpFloatingPointer* pointer = NULL;
+
+    uint32_t ebda = (uint32_t)*(volatile uint16_t*)BIOS_EBDA_SEGMENT << 4;
+    if (ebda != 0) {
+        pointer = mp_scan(ebda, 1024);
+    }
+    if (pointer == NULL) {
+        uint32_t base_kb = *(volatile uint16_t*)BIOS_BASE_MEMORY_KB;
+        if (base_kb > 1) {
+            pointer = mp_scan((base_kb - 1) * 1024, 1024);
+        }
+    }
+    if (pointer == NULL) {
+        pointer = mp_scan(BIOS_ROM_START, BIOS_ROM_SIZE);
+    }
+
+    if (pointer == NULL || pointer->default_config != 0 || pointer->config_table == 0) {
+        return NULL;
+    }
+
+    const MpConfigTable* config = (const MpConfigTable*)(uintptr_t)pointer->config_table;
+    if (config->signature != MP_CONFIG_SIGNATURE || !mp_checksum_ok(config, config->length)) {
+        return NULL;
+    }
+    return config;
+}
+
+// Busy-waits at least `ticks` whole ticks. The clock must be running.
+static void smp_delay_ticks(uint32_t ticks) {
+    uint32_t start = clock_ticks();
+    while (clock_ticks() - start <= ticks) {
+        __asm__ volatile ("pause");
+    }
+}
+
+static void smp_wake_interrupt(void) {
+    Cpu* cpu = &cpus[smp_cpu_index()];
+
+    if (cpu->executor != NULL) {
+        executor_notify(cpu->executor);
+    }
+    lapic_eoi();
+}
+
+// First C code on an AP, on its own stack with paging on and interrupts
+// off. Never returns.
+static void smp_ap_main(uint32_t index) {
+    Cpu* cpu = &cpus[index];
+
+    gdt_load();
+    idt_load();
+    lapic_enable();
+
+    atomic_store(&cpu->online, true);
+    __asm__ volatile ("sti");
+
+    executor_run(cpu->executor);
+}
+
+static bool smp_start_ap(uint8_t apic_id) {
+    uint32_t index = atomic_load(&cpus_started);
+    if (index >= SMP_MAX_CPUS) {
+        return false;
+    }
+
+    void* stack = alloc_pages(SMP_AP_STACK_ORDER);
+    if (stack == NULL) {
+        return false;
+    }
+
+    Cpu* cpu = &cpus[index];
+    cpu->index = index;
+    cpu->apic_id = apic_id;
+    cpu->stack = stack;
+    atomic_store(&cpu->online, false);
+    cpu->executor = &ap_executors[index];
+    executor_init(cpu->executor);
+    cpu->executor->cpu = index;
+    apic_to_cpu[apic_id] = (uint8_t)index;
+
+    // One AP starts at a time, so the block is reused
+    ApTrampolineParams* params = (ApTrampolineParams*)(uintptr_t)
+        (SMP_TRAMPOLINE_ADDR + (uint32_t)(ap_trampoline_params - ap_trampoline_start));
+    params->cr3 = smp_read_cr3();
+    params->cr4 = smp_read_cr4();
+    params->cr0 = smp_read_cr0();
+    params->stack = (uint32_t)(uintptr_t)stack + (PAGE_SIZE << SMP_AP_STACK_ORDER);
+    params->entry = (uint32_t)(uintptr_t)smp_ap_main;
+    params->cpu = index;
+    params->apic_id = apic_id;
+    params->apic_id_register = lapic_id_register;
+    atomic_store(&params->claimed, 0);
+
+    atomic_store(&cpus_started, index + 1);
+
+    // INIT, 10 ms, then STARTUP, repeated once if the AP missed it
+    lapic_send_init(apic_id);
+    smp_delay_ticks(CLOCK_TICK_HZ / 100);
+    for (int attempt = 0; attempt < 2 && !atomic_load(&cpu->online); attempt++) {
+        lapic_send_startup(apic_id, SMP_TRAMPOLINE_ADDR);
+        smp_delay_ticks(1);
+    }
+
+    uint32_t start = clock_ticks();
+    while (!atomic_load(&cpu->online) && clock_ticks() - start < SMP_AP_START_TIMEOUT) {
+        __asm__ volatile ("pause");
+    }
+
+    if (!atomic_load(&cpu->online)) {
+        // Withdraw the parameters. If the AP has not claimed them yet it
+        // never will: arriving late, it finds them claimed or addressed to
+        // another APIC ID and halts in the trampoline before touching its
+        // stack, so the slot and the block are free for the next AP.
+        if (atomic_exchange(&params->claimed, 1) == 0) {
+            atomic_store(&cpus_started, index);
+            apic_to_cpu[apic_id] = 0;
+            cpu->executor = NULL;
+            cpu->stack = NULL;
+            free_pages(stack, SMP_AP_STACK_ORDER);
+            return false;
+        }
+
+        // It claimed them just now and is on its way
+        start = clock_ticks();
+        while (!atomic_load(&cpu->online) && clock_ticks() - start < SMP_AP_START_TIMEOUT) {
+            __asm__ volatile ("pause");
+        }
+        if (!atomic_load(&cpu->online)) {
+            ap_start_stuck = true;
+            return false;
+        }
+    }
+
+    atomic_fetch_add(&cpus_online, 1);
+    return true;
+}
+
+void smp_init(void) {
+    Cpu* bsp = &cpus[0];
+    bsp->index = 0;
+    bsp->stack = NULL;
+    bsp->executor = get_global_executor();
+    atomic_store(&bsp->online, true);
+
+    const MpConfigTable* config = mp_find_config();
+    if (config == NULL) {
+        output_string("SMP: no MP configuration table, running on one CPU\n");
+        return;
+    }
+
+    uint32_t lapic_address = config->lapic_address != 0 ? config->lapic_address : LAPIC_DEFAULT_BASE;
+    if (!lapic_init(lapic_address)) {
+        output_string("SMP: no usable local APIC, running on one CPU\n");
+        return;
+    }
+
+    bsp->apic_id = lapic_id();
+    lapic_id_register = lapic_address + LAPIC_REG_ID;
+    apic_to_cpu[bsp->apic_id] = 0;
+    register_interrupt_handler(SMP_WAKE_VECTOR, smp_wake_interrupt);
+
+    memcpy((void*)(uintptr_t)SMP_TRAMPOLINE_ADDR, ap_trampoline_start,
+           (size_t)(ap_trampoline_end - ap_trampoline_start));
+
+    const uint8_t* entry = (const uint8_t*)(config + 1);
+    for (uint32_t i = 0; i < config->entry_count; i++) {
+        if (entry[0] != MP_ENTRY_PROCESSOR) {
+            entry += MP_OTHER_ENTRY_SIZE;
+            continue;
+        }
+
+        const MpProcessorEntry* processor = (const MpProcessorEntry*)entry;
+        entry += MP_PROCESSOR_SIZE;
+
+        if (!(processor->flags & MP_CPU_ENABLED) || (processor->flags & MP_CPU_BSP) ||
+            processor->apic_id == bsp->apic_id) {
+            continue;
+        }
+
+        if (!smp_start_ap(processor->apic_id)) {
+            output_string("SMP: processor with APIC ID ");
+            put_u32(processor->apic_id);
+            output_string(" did not start\n");
+        }
+        if (ap_start_stuck) {
+            output_string("SMP: not starting any more processors\n");
+            break;
+        }
+    }
+
+    output_string("SMP: ");
+    put_u32(smp_cpu_count());
+    output_string(" CPU(s) online\n");
+}
+
+uint32_t smp_cpu_count(void) {
+    return atomic_load(&cpus_online);
+}
+
+uint32_t smp_cpu_index(void) {
+    if (atomic_load_explicit(&cpus_started, memory_order_relaxed) <= 1) {
+        return 0;
+    }
+    return apic_to_cpu[lapic_id()];
+}
+
+Cpu* smp_cpu(uint32_t index) {
+    return index < SMP_MAX_CPUS ? &cpus[index] : NULL;
+}
+
+void smp_send_wake(uint32_t index) {
+    lapic_send_ipi(cpus[index].apic_id, SMP_WAKE_VECTOR);
+}
+
+// CPUs that may run tasks: the first `cpus_active` of those online.
+static uint32_t smp_active_count(void) {
+    uint32_t online = atomic_load(&cpus_online);
+    uint32_t active = atomic_load(&cpus_active);
+    return active < online ? active : online;
+}
+
+void smp_wake_idle(uint32_t from) {
+    uint32_t active = smp_active_count();
+
+    for (uint32_t i = 0; i < active; i++) {
+        Executor* executor = cpus[i].executor;
+        // Clearing the flag claims the wake-up, so one IPI per halt
+        if (i != from && executor != NULL && atomic_load(&executor->parked) &&
+            atomic_exchange(&executor->parked, false)) {
+            smp_send_wake(i);
+            return;
+        }
+    }
+}
+
+uint32_t smp_steal_work(Executor* thief) {
+    uint32_t active = smp_active_count();
+    uint32_t self = thief->cpu;
+
+    if (active <= 1 || self >= active) {
+        return 0;
+    }
+
+    for (uint32_t i = 1; i < active; i++) {
+        Cpu* victim = &cpus[(self + i) % active];
+        if (victim->executor == NULL || !atomic_load(&victim->online)) {
+            continue;
+        }
+
+        uint32_t stolen = executor_steal(thief, victim->executor);
+        if (stolen != 0) {
+            return stolen;
+        }
+    }
+    return 0;
+}
+
+void smp_set_active_cpus(uint32_t count) {
+    atomic_store(&cpus_active, count > 0 ? count : 1);
+}
+
+// Scaling benchmark: CPU-bound tasks that yield after every chunk of work,
+// so idle CPUs can steal them between chunks.
+
+typedef struct {
+    Future base;
+    AsyncFrame frame;
+    uint32_t chunk;
+    uint32_t chunks;
+    uint32_t state;
+} BenchTask;
+
+static atomic_uint bench_remaining;
+
+static uint32_t bench_work(uint32_t state) {
+    for (uint32_t i = 0; i < SMP_BENCH_CHUNK_ITERATIONS; i++) {
+        state = state * 1664525u + 1013904223u;
+    }
+    return state;
+}
+
+static FutureState bench_task_poll(Future* future, void* context) {
+    BenchTask* task = (BenchTask*)future;
+
+    ASYNC_BEGIN(&task->frame, context);
+    for (task->chunk = 0; task->chunk < task->chunks; task->chunk++) {
+        task->state = bench_work(task->state);
+        ASYNC_YIELD();
+    }
+    ASYNC_END();
+}
+
+static void bench_task_cleanup(Future* future) {
+    async_frame_cleanup(&((BenchTask*)future)->frame);
+}
+
+// The executor is done with the future once it is dropped, so the run
+// ends here rather than at completion: the array is freed afterwards.
+static void bench_task_drop(Future* future) {
+    (void)future;
+    atomic_fetch_sub(&bench_remaining, 1);
+}
+
+static const FutureVTable bench_task_vtable = {
+    .poll = bench_task_poll,
+    .cleanup = bench_task_cleanup,
+    .drop = bench_task_drop
+};
+
+// The kernel is linked without libgcc, so avoid 64-bit division: scale
+// both sides down until they fit the 32-bit divide.
+static uint32_t smp_scaled_ratio(uint64_t numerator, uint64_t denominator, uint32_t scale) {
+    while ((numerator >> 24) != 0 || (denominator >> 24) != 0) {
+        numerator >>= 1;
+        denominator >>= 1;
+    }
+    if (denominator == 0) {
+        return 0;
+    }
+    return (uint32_t)numerator * scale / (uint32_t)denominator;
+}
+
+void smp_scaling_benchmark(uint32_t tasks, uint32_t chunks) {
+    Executor* executor = cpus[0].executor != NULL ? cpus[0].executor : get_global_executor();
+    uint32_t cpu_count = smp_cpu_count();
+    uint64_t base_cycles = 0;
+
+    BenchTask* bench = (BenchTask*)malloc(tasks * sizeof(BenchTask));
+    if (bench == NULL) {
+        output_string("SMP benchmark: out of memory\n");
+        return;
+    }
+
+    output_string("SMP benchmark: ");
+    put_u32(tasks);
+    output_string(" tasks of ");
+    put_u32(chunks);
+    output_string(" chunks on 1 to ");
+    put_u32(cpu_count);
+    output_string(" CPU(s)\n");
+
+    for (uint32_t active = 1; active <= cpu_count; active++) {
+        smp_set_active_cpus(active);
+        atomic_store(&bench_remaining, tasks);
+
+        for (uint32_t i = 0; i < tasks; i++) {
+            BenchTask* task = &bench[i];
+            task->base.vtable = &bench_task_vtable;
+            task->base.is_completed = false;
+            task->base.waker = NULL;
+            async_frame_init(&task->frame);
+            task->chunks = chunks;
+            task->state = i;
+            executor_spawn(executor, &task->base);
+        }
+
+        // The BSP takes part like any other CPU: poll, hand out surplus,
+        // and steal back once its own queue runs dry.
+        uint64_t start = read_tsc();
+        while (atomic_load(&bench_remaining) != 0) {
+            executor_poll_ready(executor);
+            if (executor_has_ready(executor)) {
+                smp_wake_idle(0);
+            } else if (smp_steal_work(executor) == 0) {
+                __asm__ volatile ("pause");
+            }
+        }
+        uint64_t cycles = read_tsc() - start;
+        if (active == 1) {
+            base_cycles = cycles;
+        }
+
+        uint32_t speedup = smp_scaled_ratio(base_cycles, cycles, 100);
+        output_string("  ");
+        put_u32(active);
+        output_string(" CPU(s): ");
+        put_u32((uint32_t)(cycles >> 20));
+        output_string("M cycles, ");
+        put_u32(smp_scaled_ratio((uint64_t)tasks * chunks << 20, cycles, 1));
+        output_string(" chunks/Mcycle, speedup ");
+        put_u32(speedup / 100);
+        output_string(speedup % 100 < 10 ? ".0" : ".");
+        put_u32(speedup % 100);
+        output_string("\n");
+    }
+
+    smp_set_active_cpus(SMP_MAX_CPUS);
+    free(bench);
+}
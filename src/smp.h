@@ -0,0 +1,70 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Symmetric multiprocessing. smp_init finds the processors in the BIOS's
+// MP configuration table and starts every application processor (AP) with
+// INIT and STARTUP IPIs through the local APIC. Each AP gets its own stack
+// and its own Executor, and runs that executor for good; the bootstrap
+// processor (BSP, CPU 0) keeps the global executor, the clock and every
+// kernel thread.
+//
+// Work moves between CPUs by stealing: an executor with nothing to poll
+// takes half of the runnable tasks of another, and a busy one wakes a
+// parked CPU to come and take some. A task stays on the executor that took
+// it until it is stolen again.
+#define SMP_MAX_CPUS            8
+#define SMP_WAKE_VECTOR         0xF0
+
+// The STARTUP IPI takes a page number below 1 MiB; low memory is never
+// handed out by the page allocator.
+#define SMP_TRAMPOLINE_ADDR     0x8000
+#define SMP_AP_STACK_ORDER      2           // 16 KiB, as for a thread
+
+typedef struct Executor Executor;
+
+typedef struct {
+    uint32_t index;
+    uint8_t apic_id;
+    atomic_bool online;
+    void* stack;                // NULL for the BSP, which keeps the boot stack
+    Executor* executor;
+} Cpu;
+
+// Call on the BSP once paging, the heap, the clock and the executor are up
+// and interrupts are on; it waits for the clock while starting each AP.
+void smp_init(void);
+
+// Processors running their executor, the BSP included.
+uint32_t smp_cpu_count(void);
+
+// Index of the calling CPU, 0 on the BSP and before smp_init.
+uint32_t smp_cpu_index(void);
+
+Cpu* smp_cpu(uint32_t index);
+
+// Sends the wake-up IPI, which ends the target's halt and has its executor
+// poll again.
+void smp_send_wake(uint32_t index);
+
+// Wakes one parked CPU other than `from` that may steal work.
+void smp_wake_idle(uint32_t from);
+
+// Steals runnable tasks for `thief` from the first other CPU that has
+// some. Returns the number of tasks taken.
+uint32_t smp_steal_work(Executor* thief);
+
+// Limits stealing, and so task execution, to the CPUs with index below
+// `count`. Tasks already on the others stay there.
+void smp_set_active_cpus(uint32_t count);
+
+// Runs `tasks` CPU-bound tasks of `chunks` yields each on the BSP's
+// executor with 1, 2, ... smp_cpu_count() CPUs allowed to steal them, and
+// prints the time and speedup of each run. Call from the boot thread
+// before the executor thread starts.
+void smp_scaling_benchmark(uint32_t tasks, uint32_t chunks);
+
+#endif
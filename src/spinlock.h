@@ -0,0 +1,82 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "io.h"
+#include "smp.h"
+
+// Busy-waiting locks for state shared between CPUs. A spinlock does not
+// keep the holder on its CPU or mask interrupts by itself: take it with
+// spin_lock_irqsave when an interrupt handler on the same CPU can want it,
+// and inside preempt_disable when a thread switch could leave it held.
+typedef struct {
+    atomic_flag locked;
+} Spinlock;
+
+#define SPINLOCK_INIT { ATOMIC_FLAG_INIT }
+
+static inline void spin_lock_init(Spinlock* lock) {
+    atomic_flag_clear(&lock->locked);
+}
+
+static inline void spin_lock(Spinlock* lock) {
+    while (atomic_flag_test_and_set_explicit(&lock->locked, memory_order_acquire)) {
+        __asm__ volatile ("pause");
+    }
+}
+
+static inline void spin_unlock(Spinlock* lock) {
+    atomic_flag_clear_explicit(&lock->locked, memory_order_release);
+}
+
+static inline uint32_t spin_lock_irqsave(Spinlock* lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(Spinlock* lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+// Re-entrant on the CPU that holds it, for state whose users call back into
+// themselves: timer callbacks that re-arm timers, an interrupt handler
+// printing while the code it interrupted was printing. Re-entry gets no
+// protection from the outer holder; it only avoids deadlocking on it.
+typedef struct {
+    atomic_uint owner;          // Holding CPU's index plus one; 0 when free
+    uint32_t depth;
+} RecursiveSpinlock;
+
+#define RECURSIVE_SPINLOCK_INIT { 0, 0 }
+
+static inline void recursive_spin_lock(RecursiveSpinlock* lock) {
+    uint32_t self = smp_cpu_index() + 1;
+    uint32_t flags = irq_save();
+
+    // Interrupts stay off until the depth is recorded, so a handler on this
+    // CPU never sees the lock owned with a depth of zero.
+    if (atomic_load_explicit(&lock->owner, memory_order_relaxed) != self) {
+        unsigned int expected = 0;
+        while (!atomic_compare_exchange_weak_explicit(&lock->owner, &expected, self,
+                                                      memory_order_acquire, memory_order_relaxed)) {
+            expected = 0;
+            __asm__ volatile ("pause");
+        }
+    }
+    lock->depth++;
+
+    irq_restore(flags);
+}
+
+static inline void recursive_spin_unlock(RecursiveSpinlock* lock) {
+    uint32_t flags = irq_save();
+    if (--lock->depth == 0) {
+        atomic_store_explicit(&lock->owner, 0, memory_order_release);
+    }
+    irq_restore(flags);
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "terminal.h"
 #include "io.h"
+#include "thread.h"
+#include "spinlock.h"
 
 static uint16_t* vga_buffer = (uint16_t*)VGA_BUFFER;
 static uint8_t terminal_row = 0;
@@ -194,14 +196,28 @@ void init_output() {
     init_serial();
 }
 
+// Threads and CPUs may print concurrently; a switch mid-line would corrupt
+// the cursor, so output is not preempted and other CPUs wait their turn.
+// The lock is re-entrant on its CPU so an interrupt handler that prints
+// cannot deadlock against the code it interrupted.
+static RecursiveSpinlock output_lock = RECURSIVE_SPINLOCK_INIT;
+
 void output_char(char c) {
+    preempt_disable();
+    recursive_spin_lock(&output_lock);
     terminal_put_char(c);
 
     write_serial(c);
+    recursive_spin_unlock(&output_lock);
+    preempt_enable();
 }
 
 void output_string(const char* str) {
+    preempt_disable();
+    recursive_spin_lock(&output_lock);
     write_string(str);
     
     write_serial_string(str);
+    recursive_spin_unlock(&output_lock);
+    preempt_enable();
 }
\ No newline at end of file
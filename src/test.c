@@ -2,12 +2,27 @@
 #include "terminal.h"
 #include "io.h"
 #include "memory.h"
+#include "arena.h"
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#define TEST_ARENA_CHUNK_SIZE (16 * 1024)
 
 static int tests_passed = 0;
 static int tests_failed = 0;
 
+static Arena test_scratch_arena;
+static bool test_scratch_ready = false;
+
+void* test_alloc(size_t size) {
+    if (!test_scratch_ready) {
+        arena_init(&test_scratch_arena, TEST_ARENA_CHUNK_SIZE);
+        test_scratch_ready = true;
+    }
+    return arena_alloc(&test_scratch_arena, size, 8);
+}
+
 void test_assert(int condition, const char* message, const char* file, int line) {
     if (condition) {
         output_string("PASS: ");
@@ -72,8 +87,10 @@ void run_tests(test_entry_t* tests, int num_tests) {
         output_string("Running test: ");
         output_string(tests[i].name);
         output_string("\n");
-        
+
+        ArenaScope scope = arena_scope_begin(&test_scratch_arena);
         tests[i].func();
+        arena_scope_end(&test_scratch_arena, scope);
     }
     
     output_string("\nTest Results: ");
@@ -2,6 +2,7 @@
 #define TEST_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef void (*test_func_t)(void);
 
@@ -12,6 +13,9 @@ typedef struct {
 
 void run_tests(test_entry_t* tests, int num_tests);
 
+// Scratch memory for the running test, released when the test returns.
+void* test_alloc(size_t size);
+
 void test_assert(int condition, const char* message, const char* file, int line);
 void test_assert_equal(int expected, int actual, const char* message, const char* file, int line);
 
@@ -28,6 +32,7 @@ void test_assert_equal(int expected, int actual, const char* message, const char
 #define TEST_ENTRY(name) {#name, test_##name}
 
 void run_memory_tests();
+void run_memory_benchmarks();
 void exit_after_all_tests(int exit_code);
 
 #endif
\ No newline at end of file
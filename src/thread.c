@@ -0,0 +1,422 @@
+#include "thread.h"
+#include "io.h"
+#include "memory.h"
+#include "terminal.h"
+#include "smp.h"
+#include <stddef.h>
+
+#define THREAD_INITIAL_EFLAGS 0x002     // Reserved bit 1 set, interrupts off
+
+// Stands in for the current thread from boot, so preempt_disable works
+// before thread_init and the boot context keeps its own stack afterwards.
+static Thread thread_boot = { .state = THREAD_RUNNING, .name = "boot" };
+
+static Thread* thread_running = &thread_boot;
+static Thread* thread_idle = NULL;
+static bool thread_started = false;
+static volatile bool thread_need_resched = false;
+static uint32_t thread_next_id = 1;
+
+// Run queue and zombie list; only touched with interrupts off.
+static Thread* run_queue_head = NULL;
+static Thread* run_queue_tail = NULL;
+static Thread* thread_zombies = NULL;
+
+static void run_queue_push(Thread* thread) {
+    thread->next = NULL;
+    if (run_queue_tail != NULL) {
+        run_queue_tail->next = thread;
+    } else {
+        run_queue_head = thread;
+    }
+    run_queue_tail = thread;
+}
+
+static Thread* run_queue_pop(void) {
+    Thread* thread = run_queue_head;
+    if (thread != NULL) {
+        run_queue_head = thread->next;
+        if (run_queue_head == NULL) {
+            run_queue_tail = NULL;
+        }
+        thread->next = NULL;
+    }
+    return thread;
+}
+
+// Tickless only: with threads waiting, the PIT must fire by the end of the
+// slice even if no timer is due; otherwise the next timer deadline will do.
+static void thread_arm_clock(void) {
+    if (clock_tickless()) {
+        clock_arm_event(run_queue_head != NULL ? THREAD_SLICE_TICKS : TIMER_WHEEL_SLOTS);
+    }
+}
+
+// Picks the next thread and switches to it. Call with interrupts off. The
+// outgoing thread is requeued if it is still running; a thread that
+// blocked or exited has already recorded where it went.
+static void thread_schedule(void) {
+    Thread* previous = thread_running;
+    Thread* next = run_queue_pop();
+
+    thread_need_resched = false;
+
+    if (next == NULL) {
+        if (previous->state == THREAD_RUNNING) {
+            return;
+        }
+        next = thread_idle;
+    }
+
+    if (previous->state == THREAD_RUNNING) {
+        previous->state = THREAD_READY;
+        if (previous != thread_idle) {
+            run_queue_push(previous);
+        }
+    }
+
+    next->state = THREAD_RUNNING;
+    next->slice_start = clock_ticks();
+    thread_arm_clock();
+
+    if (next != previous) {
+        thread_running = next;
+        context_switch(&previous->esp, next->esp);
+    }
+}
+
+static void thread_make_ready(Thread* thread) {
+    bool queue_was_empty = run_queue_head == NULL;
+
+    thread->state = THREAD_READY;
+    run_queue_push(thread);
+
+    if (thread_running == thread_idle) {
+        thread_need_resched = true;
+    } else if (queue_was_empty) {
+        // The running thread now has to share the CPU: start its slice
+        thread_running->slice_start = clock_ticks();
+        thread_arm_clock();
+    }
+}
+
+// Frees the stacks of exited threads. Never runs on a dying stack: a
+// thread only becomes a zombie once it has switched away for good.
+static void thread_reap(void) {
+    uint32_t flags = irq_save();
+    Thread* zombie = thread_zombies;
+    thread_zombies = NULL;
+    irq_restore(flags);
+
+    while (zombie != NULL) {
+        Thread* next = zombie->next;
+        if (zombie->stack != NULL) {
+            free_pages(zombie->stack, THREAD_STACK_ORDER);
+            free(zombie);
+        }
+        zombie = next;
+    }
+}
+
+static void thread_sleep_expired(TimerNode* timer) {
+    Thread* thread = TIMER_CONTAINER(timer, Thread, sleep_timer);
+
+    if (thread->state == THREAD_BLOCKED) {
+        thread_make_ready(thread);
+    }
+}
+
+static void thread_trampoline(void) {
+    Thread* thread = thread_running;
+
+    irq_restore(thread->start_flags);
+    thread->entry(thread->arg);
+    thread_exit();
+}
+
+static void thread_idle_main(void* arg) {
+    (void)arg;
+
+    while (1) {
+        thread_reap();
+
+        uint32_t flags = irq_save();
+        if (run_queue_head == NULL) {
+            // A wake-up from the interrupt that ends the halt switches away
+            // on the way out of the handler.
+            clock_idle();
+        } else {
+            thread_schedule();
+            irq_restore(flags);
+        }
+    }
+}
+
+// Sets up a thread that is not yet on the run queue.
+static Thread* thread_alloc(const char* name, void (*entry)(void* arg), void* arg) {
+    Thread* thread = (Thread*)malloc(sizeof(Thread));
+    if (thread == NULL) {
+        return NULL;
+    }
+    thread->stack = alloc_pages(THREAD_STACK_ORDER);
+    if (thread->stack == NULL) {
+        free(thread);
+        return NULL;
+    }
+
+    thread->state = THREAD_READY;
+    thread->name = name;
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->preempt_count = 0;
+    thread->next = NULL;
+    timer_init(&thread->sleep_timer, thread_sleep_expired);
+
+    // The frame context_switch pops, returning into the trampoline with
+    // the stack aligned as if it had been called.
+    uint32_t top = ((uint32_t)(uintptr_t)thread->stack + THREAD_STACK_SIZE) & ~(uint32_t)15;
+    uint32_t* frame = (uint32_t*)(uintptr_t)top;
+    *--frame = 0;                                   // Trampoline's return address
+    *--frame = (uint32_t)(uintptr_t)thread_trampoline;
+    *--frame = 0;                                   // ebp
+    *--frame = 0;                                   // ebx
+    *--frame = 0;                                   // esi
+    *--frame = 0;                                   // edi
+    *--frame = THREAD_INITIAL_EFLAGS;
+    thread->esp = (uint32_t)(uintptr_t)frame;
+
+    uint32_t flags = irq_save();
+    thread->id = thread_next_id++;
+    thread->start_flags = flags;
+    irq_restore(flags);
+
+    return thread;
+}
+
+void thread_init(void) {
+    thread_boot.id = 0;
+    thread_boot.preempt_count = 0;
+    timer_init(&thread_boot.sleep_timer, thread_sleep_expired);
+
+    // The idle thread is never queued; it runs when nothing else can and
+    // manages the interrupt flag itself.
+    thread_idle = thread_alloc("idle", thread_idle_main, NULL);
+    if (thread_idle == NULL) {
+        output_string("Threads: failed to create the idle thread\n");
+        return;
+    }
+    thread_idle->start_flags = 0;
+    thread_started = true;
+
+    output_string("Threads: scheduler started, slice ");
+    put_u32(THREAD_SLICE_TICKS);
+    output_string(" ticks\n");
+}
+
+bool thread_scheduler_running(void) {
+    return thread_started;
+}
+
+Thread* thread_create(const char* name, void (*entry)(void* arg), void* arg) {
+    thread_reap();
+
+    Thread* thread = thread_alloc(name, entry, arg);
+    if (thread == NULL) {
+        return NULL;
+    }
+
+    uint32_t flags = irq_save();
+    thread_make_ready(thread);
+    irq_restore(flags);
+
+    return thread;
+}
+
+Thread* thread_current(void) {
+    return thread_running;
+}
+
+void thread_yield(void) {
+    if (!thread_started) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    thread_schedule();
+    irq_restore(flags);
+}
+
+void thread_exit(void) {
+    __asm__ volatile ("cli");
+
+    Thread* thread = thread_running;
+    thread->state = THREAD_DEAD;
+    thread->next = thread_zombies;
+    thread_zombies = thread;
+
+    thread_schedule();
+
+    // Not reached: nothing switches back to a dead thread
+    while (1) {
+        __asm__ volatile ("hlt");
+    }
+}
+
+void thread_sleep_ticks(uint32_t ticks) {
+    if (ticks == 0) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    Thread* thread = thread_running;
+
+    thread->state = THREAD_BLOCKED;
+    timer_add(&system_timer_wheel, &thread->sleep_timer, clock_ticks() + ticks);
+    thread_schedule();
+
+    irq_restore(flags);
+}
+
+void thread_timer_tick(void) {
+    if (!thread_started) {
+        return;
+    }
+
+    if (run_queue_head != NULL &&
+        (thread_running == thread_idle ||
+         clock_ticks() - thread_running->slice_start >= THREAD_SLICE_TICKS)) {
+        thread_need_resched = true;
+    }
+
+    // The one-shot has fired; keep slices and timers covered
+    thread_arm_clock();
+}
+
+void thread_interrupt_exit(void) {
+    if (smp_cpu_index() != 0) {
+        return;
+    }
+
+    if (thread_need_resched && thread_running->preempt_count == 0) {
+        thread_schedule();
+    }
+}
+
+// Application processors run no threads, so there is nothing to disable
+void preempt_disable(void) {
+    if (smp_cpu_index() != 0) {
+        return;
+    }
+    thread_running->preempt_count++;
+}
+
+void preempt_enable(void) {
+    if (smp_cpu_index() != 0) {
+        return;
+    }
+
+    Thread* thread = thread_running;
+
+    if (--thread->preempt_count == 0 && thread_need_resched) {
+        uint32_t flags = irq_save();
+        // With interrupts off the caller may be a handler or hold state
+        // an interrupt could see; the switch waits for a later chance.
+        if ((flags & EFLAGS_IF) != 0 && thread_need_resched) {
+            thread_schedule();
+        }
+        irq_restore(flags);
+    }
+}
+
+void wait_queue_init(WaitQueue* queue) {
+    queue->head = NULL;
+    queue->tail = NULL;
+}
+
+void wait_queue_sleep(WaitQueue* queue) {
+    Thread* thread = thread_running;
+
+    thread->state = THREAD_BLOCKED;
+    thread->next = NULL;
+    if (queue->tail != NULL) {
+        queue->tail->next = thread;
+    } else {
+        queue->head = thread;
+    }
+    queue->tail = thread;
+
+    thread_schedule();
+}
+
+static Thread* wait_queue_pop(WaitQueue* queue) {
+    Thread* thread = queue->head;
+    if (thread != NULL) {
+        queue->head = thread->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+    return thread;
+}
+
+bool wait_queue_wake_one(WaitQueue* queue) {
+    uint32_t flags = irq_save();
+    Thread* thread = wait_queue_pop(queue);
+    if (thread != NULL) {
+        thread_make_ready(thread);
+    }
+    irq_restore(flags);
+
+    return thread != NULL;
+}
+
+void wait_queue_wake_all(WaitQueue* queue) {
+    uint32_t flags = irq_save();
+    Thread* thread;
+    while ((thread = wait_queue_pop(queue)) != NULL) {
+        thread_make_ready(thread);
+    }
+    irq_restore(flags);
+}
+
+void semaphore_init(Semaphore* semaphore, uint32_t count) {
+    semaphore->count = count;
+    wait_queue_init(&semaphore->waiters);
+}
+
+void semaphore_down(Semaphore* semaphore) {
+    uint32_t flags = irq_save();
+    while (semaphore->count == 0) {
+        wait_queue_sleep(&semaphore->waiters);
+    }
+    semaphore->count--;
+    irq_restore(flags);
+}
+
+void semaphore_up(Semaphore* semaphore) {
+    uint32_t flags = irq_save();
+    semaphore->count++;
+    wait_queue_wake_one(&semaphore->waiters);
+    irq_restore(flags);
+}
+
+void mutex_init(Mutex* mutex) {
+    mutex->owner = NULL;
+    wait_queue_init(&mutex->waiters);
+}
+
+void mutex_lock(Mutex* mutex) {
+    uint32_t flags = irq_save();
+    while (mutex->owner != NULL) {
+        wait_queue_sleep(&mutex->waiters);
+    }
+    mutex->owner = thread_running;
+    irq_restore(flags);
+}
+
+void mutex_unlock(Mutex* mutex) {
+    uint32_t flags = irq_save();
+    mutex->owner = NULL;
+    wait_queue_wake_one(&mutex->waiters);
+    irq_restore(flags);
+}
@@ -0,0 +1,128 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+#include "clock.h"
+#include "page_allocator.h"
+
+// Preemptive kernel threads on the bootstrap processor. Each thread has its
+// own stack and the scheduler runs them round robin, switching when a
+// thread blocks, yields or uses up its time slice. Slices are enforced by the system clock
+// interrupt: the PIT one-shot when tickless, the periodic RTC otherwise.
+// Preemption happens on the way out of an interrupt handler, after the EOI,
+// and never while the running thread holds a preempt_disable count.
+//
+// Code written for a single context (the heap, slab caches, page allocator
+// and terminal) disables preemption around its shared state, and takes a
+// spinlock as well since other CPUs share it too. Everything that is
+// already interrupt-safe is thread-safe too. Application processors
+// only run executors (see smp.h); nothing here may be called from them,
+// except preempt_disable and preempt_enable, which do nothing there.
+// Stacks come whole from the page allocator: a fault on a demand-paged
+// stack would have nowhere to push its frame.
+#define THREAD_STACK_ORDER  2
+#define THREAD_STACK_SIZE   (PAGE_SIZE << THREAD_STACK_ORDER)
+#define THREAD_SLICE_TICKS  (CLOCK_TICK_HZ / 100)
+
+typedef enum {
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+} ThreadState;
+
+typedef struct Thread {
+    uint32_t esp;               // Saved stack pointer while switched out
+    ThreadState state;
+    uint32_t id;
+    const char* name;
+    void (*entry)(void* arg);
+    void* arg;
+    uint32_t start_flags;       // EFLAGS of the creator; sets the initial IF
+    void* stack;                // NULL for the boot thread
+    uint32_t preempt_count;
+    uint32_t slice_start;       // Tick the current time slice began
+    struct Thread* next;        // Run queue, wait queue or zombie list link
+    TimerNode sleep_timer;
+} Thread;
+
+// Switches stacks: saves the callee-saved registers and EFLAGS on the
+// current stack, stores it in `*save_esp` and resumes the thread whose
+// stack is `load_esp`. Defined in context_switch.s.
+void context_switch(uint32_t* save_esp, uint32_t load_esp);
+
+// Turns the boot context into the first thread and creates the idle
+// thread. Call once the heap is up.
+void thread_init(void);
+
+bool thread_scheduler_running(void);
+
+// Creates a ready thread running `entry(arg)`. It starts with interrupts
+// enabled if they were enabled in the caller. Returns NULL when out of
+// memory.
+Thread* thread_create(const char* name, void (*entry)(void* arg), void* arg);
+
+Thread* thread_current(void);
+
+void thread_yield(void);
+
+// Ends the calling thread; its stack is freed later by another thread.
+void thread_exit(void) __attribute__((noreturn));
+
+// Blocks the calling thread for at least `ticks` monotonic ticks.
+void thread_sleep_ticks(uint32_t ticks);
+
+// Called from the system clock interrupt: ends the running thread's slice
+// once it has run THREAD_SLICE_TICKS with others waiting.
+void thread_timer_tick(void);
+
+// Called by the interrupt entry code after the EOI: switches threads if a
+// reschedule is due and the interrupted thread allows it.
+void thread_interrupt_exit(void);
+
+// Nest. Switches that became due while disabled happen on the outermost
+// preempt_enable, unless interrupts are off.
+void preempt_disable(void);
+void preempt_enable(void);
+
+// Threads blocked on some condition, woken in FIFO order. Waking is safe
+// from interrupt handlers.
+typedef struct {
+    Thread* head;
+    Thread* tail;
+} WaitQueue;
+
+void wait_queue_init(WaitQueue* queue);
+
+// Blocks the calling thread until woken. Call with interrupts off, after
+// checking the condition; returns with them still off.
+void wait_queue_sleep(WaitQueue* queue);
+
+// Returns false if nobody was waiting.
+bool wait_queue_wake_one(WaitQueue* queue);
+
+void wait_queue_wake_all(WaitQueue* queue);
+
+// Counting semaphore. semaphore_up is safe from interrupt handlers.
+typedef struct {
+    uint32_t count;
+    WaitQueue waiters;
+} Semaphore;
+
+void semaphore_init(Semaphore* semaphore, uint32_t count);
+void semaphore_down(Semaphore* semaphore);
+void semaphore_up(Semaphore* semaphore);
+
+// Sleeping lock for threads. Not recursive; not for interrupt handlers.
+typedef struct {
+    Thread* owner;
+    WaitQueue waiters;
+} Mutex;
+
+void mutex_init(Mutex* mutex);
+void mutex_lock(Mutex* mutex);
+void mutex_unlock(Mutex* mutex);
+
+#endif
@@ -0,0 +1,198 @@
+#include "timer.h"
+#include "io.h"
+
+#define TIMER_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+TimerWheel system_timer_wheel;
+
+static inline void timer_link(TimerNode** head, TimerNode* timer) {
+    timer->next = *head;
+    if (*head != NULL) {
+        (*head)->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+}
+
+static inline void timer_unlink(TimerNode* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+static inline uint32_t timer_lock(TimerWheel* wheel) {
+    uint32_t flags = irq_save();
+    recursive_spin_lock(&wheel->lock);
+    return flags;
+}
+
+static inline void timer_unlock(TimerWheel* wheel, uint32_t flags) {
+    recursive_spin_unlock(&wheel->lock);
+    irq_restore(flags);
+}
+
+// Files the timer into the lowest level whose span covers its deadline.
+// The caller holds the wheel's lock.
+static void timer_enqueue(TimerWheel* wheel, TimerNode* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel->current;
+
+    if ((int32_t)delta < 0) {
+        // Already due: the slot about to be processed
+        expires = wheel->current;
+        delta = 0;
+    } else if (delta > TIMER_WHEEL_MAX_DELTA) {
+        expires = wheel->current + TIMER_WHEEL_MAX_DELTA;
+        delta = TIMER_WHEEL_MAX_DELTA;
+    }
+
+    uint32_t level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1u << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    uint32_t slot = (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK;
+    timer_link(&wheel->slots[level][slot], timer);
+}
+
+void timer_wheel_init(TimerWheel* wheel, uint32_t now) {
+    wheel->current = now;
+    wheel->pending = 0;
+    atomic_store(&wheel->lock.owner, 0);
+    wheel->lock.depth = 0;
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (uint32_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot] = NULL;
+        }
+    }
+}
+
+void timer_init(TimerNode* timer, timer_callback_t callback) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+}
+
+bool timer_pending(const TimerNode* timer) {
+    return timer->pprev != NULL;
+}
+
+void timer_add(TimerWheel* wheel, TimerNode* timer, uint32_t expires) {
+    uint32_t flags = timer_lock(wheel);
+
+    if (timer_pending(timer)) {
+        timer_unlink(timer);
+    } else {
+        wheel->pending++;
+    }
+
+    timer->expires = expires;
+    timer_enqueue(wheel, timer);
+
+    timer_unlock(wheel, flags);
+}
+
+bool timer_cancel(TimerWheel* wheel, TimerNode* timer) {
+    uint32_t flags = timer_lock(wheel);
+
+    bool was_pending = timer_pending(timer);
+    if (was_pending) {
+        timer_unlink(timer);
+        wheel->pending--;
+    }
+
+    timer_unlock(wheel, flags);
+    return was_pending;
+}
+
+// Re-files every timer of one upper-level slot into the levels below.
+static void timer_cascade(TimerWheel* wheel, uint32_t level, uint32_t slot) {
+    TimerNode* timer = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+
+    while (timer != NULL) {
+        TimerNode* next = timer->next;
+        timer_enqueue(wheel, timer);
+        timer = next;
+    }
+}
+
+static void timer_wheel_tick(TimerWheel* wheel) {
+    uint32_t tick = wheel->current;
+    uint32_t slot = tick & TIMER_SLOT_MASK;
+
+    // At each wrap of a level, bring the next slot of the level above down.
+    for (uint32_t level = 1; level < TIMER_WHEEL_LEVELS && slot == 0; level++) {
+        slot = (tick >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK;
+        timer_cascade(wheel, level, slot);
+    }
+
+    // Detach the due slot onto a local list, so a callback that cancels
+    // another timer due in the same tick unlinks it from here.
+    TimerNode* expired = wheel->slots[0][tick & TIMER_SLOT_MASK];
+    wheel->slots[0][tick & TIMER_SLOT_MASK] = NULL;
+    if (expired != NULL) {
+        expired->pprev = &expired;
+    }
+
+    // Move on first, so callbacks that re-arm for a passed deadline land in
+    // the next tick rather than the slot being emptied.
+    wheel->current = tick + 1;
+
+    while (expired != NULL) {
+        TimerNode* timer = expired;
+        timer_unlink(timer);
+        wheel->pending--;
+        timer->callback(timer);
+    }
+}
+
+uint32_t timer_wheel_next_event(TimerWheel* wheel, uint32_t limit) {
+    uint32_t flags = timer_lock(wheel);
+    uint32_t current = wheel->current;
+
+    if (limit > TIMER_WHEEL_SLOTS) {
+        limit = TIMER_WHEEL_SLOTS;
+    }
+    uint32_t next = current + limit;
+
+    // Level 0 holds exactly the deadlines of the next TIMER_WHEEL_SLOTS
+    // ticks. An upper-level timer is cascaded before it is due, so if its
+    // cascade is not within that lap, neither is its deadline.
+    for (uint32_t i = 0; wheel->pending != 0 && i < limit; i++) {
+        uint32_t tick = current + i;
+        uint32_t slot = tick & TIMER_SLOT_MASK;
+
+        if (wheel->slots[0][slot] != NULL) {
+            next = tick;
+            break;
+        }
+
+        bool cascades = false;
+        for (uint32_t level = 1; level < TIMER_WHEEL_LEVELS && slot == 0; level++) {
+            slot = (tick >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK;
+            cascades |= wheel->slots[level][slot] != NULL;
+        }
+        if (cascades) {
+            next = tick;
+            break;
+        }
+    }
+
+    timer_unlock(wheel, flags);
+    return next;
+}
+
+void timer_wheel_advance(TimerWheel* wheel, uint32_t now) {
+    uint32_t flags = timer_lock(wheel);
+
+    while ((int32_t)(now - wheel->current) >= 0) {
+        timer_wheel_tick(wheel);
+    }
+
+    timer_unlock(wheel, flags);
+}
@@ -0,0 +1,77 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "spinlock.h"
+
+// Hierarchical timing wheel over monotonic ticks. Level 0 has one slot per
+// tick for the next TIMER_WHEEL_SLOTS ticks; each level above covers
+// TIMER_WHEEL_SLOTS times the span of the one below, and its slots are
+// cascaded down as the wheel reaches them. Adding, cancelling and expiring
+// a timer are O(1); a timer is moved at most once per level. Deadlines past
+// the top level's span are parked in its farthest slot and re-filed when
+// that slot cascades.
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_MAX_DELTA ((1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+typedef struct TimerNode TimerNode;
+
+// Runs in the interrupt handler that advances the wheel, with interrupts
+// off. The timer is no longer pending and may be re-added from here.
+typedef void (*timer_callback_t)(TimerNode* timer);
+
+// Embed a TimerNode in the object that owns the deadline and recover the
+// object in the callback with TIMER_CONTAINER. Nothing is allocated.
+struct TimerNode {
+    TimerNode* next;
+    TimerNode** pprev;          // Link pointing at this node; NULL when idle
+    uint32_t expires;
+    timer_callback_t callback;
+};
+
+#define TIMER_CONTAINER(timer, type, member) \
+    ((type*)((uint8_t*)(timer) - offsetof(type, member)))
+
+// Interrupts are off and the lock held for every operation, callbacks
+// included; the lock is re-entrant so a callback can use the wheel.
+typedef struct {
+    uint32_t current;           // Next tick to be processed
+    uint32_t pending;
+    RecursiveSpinlock lock;
+    TimerNode* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} TimerWheel;
+
+// Driven on monotonic ticks by the system clock, see clock.h.
+extern TimerWheel system_timer_wheel;
+
+void timer_wheel_init(TimerWheel* wheel, uint32_t now);
+
+void timer_init(TimerNode* timer, timer_callback_t callback);
+
+// Arms the timer for tick `expires`, moving it if it is already pending.
+// Deadlines already passed fire on the next tick processed.
+void timer_add(TimerWheel* wheel, TimerNode* timer, uint32_t expires);
+
+// Returns true if the timer was pending, in which case its callback will
+// not run. Safe to call on an idle timer.
+bool timer_cancel(TimerWheel* wheel, TimerNode* timer);
+
+bool timer_pending(const TimerNode* timer);
+
+// Returns the first tick, from the next one to be processed up to `limit`
+// ticks ahead, at which the wheel has work: a timer to expire or an upper
+// slot to cascade. A cascade may be earlier than the deadline it carries;
+// waking for it just finds nothing due. `limit` is capped at
+// TIMER_WHEEL_SLOTS, the furthest the scan can see; returns current + limit
+// if none.
+uint32_t timer_wheel_next_event(TimerWheel* wheel, uint32_t limit);
+
+// Processes every tick up to and including `now`, running callbacks of
+// expired timers. Called from the timer interrupt handler.
+void timer_wheel_advance(TimerWheel* wheel, uint32_t now);
+
+#endif